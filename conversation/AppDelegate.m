@@ -34,7 +34,9 @@
 #import "ChatMessageView.h"
 #import "IRCConnection.h"
 #import "IRCConversation.h"
+#import "IRCMessageStore.h"
 #import <FCModel/FCModel.h>
+#import <AFNetworking/AFNetworkReachabilityManager.h>
 #import <DLImageLoader/DLImageView.h>
 
 @implementation AppDelegate
@@ -69,6 +71,9 @@
     splitViewController.delegate = self;
 */
 
+    // Watch the network so clients waiting to reconnect can try again as soon as it comes back
+    [[AFNetworkReachabilityManager sharedManager] startMonitoring];
+    
     // Load default defaults
     [[NSUserDefaults standardUserDefaults] registerDefaults:[NSDictionary dictionaryWithContentsOfFile:[[NSBundle mainBundle] pathForResource:@"Defaults" ofType:@"plist"]]];
     
@@ -109,7 +114,9 @@
     NSString *documentsPath = [NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES) objectAtIndex:0];
     NSString *dbPath = [documentsPath stringByAppendingPathComponent:@"messages.sqlite3"];
     
-    [FCModel openDatabaseAtPath:dbPath withSchemaBuilder:^(FMDatabase *db, int *schemaVersion) {
+    [FCModel openDatabaseAtPath:dbPath withDatabaseInitializer:^(FMDatabase *db) {
+        [IRCMessageStore configureDatabase:db];
+    } schemaBuilder:^(FMDatabase *db, int *schemaVersion) {
         [db beginTransaction];
         
         // My custom failure handling. Yours may vary.
@@ -139,10 +146,112 @@
             
             *schemaVersion = 1;
         }
+        
+        if (*schemaVersion < 2) {
+            /* History is loaded a page at a time per conversation, newest first. */
+            if (! [db executeUpdate:@"CREATE INDEX IF NOT EXISTS IDX_2 ON IRCMessage (conversation, timestamp);"]) failedAt(3);
+            
+            *schemaVersion = 2;
+        }
+        
+        /* Full text index of the messages. It reads the text from IRCMessage itself and is kept up to date by triggers. */
+        NSArray *searchIndexStatements = @[
+            @"CREATE VIRTUAL TABLE IF NOT EXISTS IRCMessageSearch USING fts4(content=\"IRCMessage\", message, tokenize=unicode61);",
+            @"CREATE TRIGGER IF NOT EXISTS IRCMessageSearch_BD BEFORE DELETE ON IRCMessage BEGIN"
+            @"    DELETE FROM IRCMessageSearch WHERE docid = old.id;"
+            @"END;",
+            @"CREATE TRIGGER IF NOT EXISTS IRCMessageSearch_BU BEFORE UPDATE ON IRCMessage BEGIN"
+            @"    DELETE FROM IRCMessageSearch WHERE docid = old.id;"
+            @"END;",
+            @"CREATE TRIGGER IF NOT EXISTS IRCMessageSearch_AU AFTER UPDATE ON IRCMessage BEGIN"
+            @"    INSERT INTO IRCMessageSearch (docid, message) VALUES (new.id, new.message);"
+            @"END;",
+            @"CREATE TRIGGER IF NOT EXISTS IRCMessageSearch_AI AFTER INSERT ON IRCMessage BEGIN"
+            @"    INSERT INTO IRCMessageSearch (docid, message) VALUES (new.id, new.message);"
+            @"END;",
+            /* Index the history stored before the search table existed. */
+            @"INSERT INTO IRCMessageSearch (IRCMessageSearch) VALUES ('rebuild');"
+        ];
+        
+        if (*schemaVersion < 3) {
+            for (NSUInteger i = 0; i < searchIndexStatements.count; i++) {
+                if (! [db executeUpdate:searchIndexStatements[i]]) failedAt(4 + (int)i);
+            }
+            
+            *schemaVersion = 3;
+        }
+        
+        if (*schemaVersion < 4) {
+            /* Conversations and hostmasks are stored once and messages refer to them by number. The network of a message
+             is that of its conversation, and the tags are a binary property list. Tags saved before were the description
+             of the dictionary, which cannot be read back, so they are dropped. */
+            if (! [db executeUpdate:
+                   @"CREATE TABLE IRCMessageConversation ("
+                   @"    id                     INTEGER PRIMARY KEY,"
+                   @"    identifier             TEXT NOT NULL UNIQUE,"
+                   @"    client                 TEXT NOT NULL DEFAULT ''"
+                   @");"
+                   ]) failedAt(10);
+            
+            if (! [db executeUpdate:
+                   @"CREATE TABLE IRCMessageSender ("
+                   @"    id                     INTEGER PRIMARY KEY,"
+                   @"    hostmask               TEXT NOT NULL UNIQUE"
+                   @");"
+                   ]) failedAt(11);
+            
+            if (! [db executeUpdate:
+                   @"CREATE TABLE IRCMessageCompact ("
+                   @"    id                     INTEGER PRIMARY KEY,"
+                   @"    conversation           INTEGER NOT NULL,"
+                   @"    timestamp              REAL NOT NULL,"
+                   @"    messageType            INTEGER NOT NULL DEFAULT 0,"
+                   @"    sender                 INTEGER NULL,"
+                   @"    kickedUser             INTEGER NULL,"
+                   @"    message                TEXT NOT NULL DEFAULT '',"
+                   @"    tags                   BLOB NULL,"
+                   @"    isServerMessage        NUMERIC NOT NULL DEFAULT 0"
+                   @");"
+                   ]) failedAt(12);
+            
+            if (! [db executeUpdate:@"INSERT INTO IRCMessageConversation (identifier, client) SELECT conversation, MAX(client) FROM IRCMessage GROUP BY conversation;"]) failedAt(13);
+            
+            if (! [db executeUpdate:
+                   @"INSERT INTO IRCMessageSender (hostmask)"
+                   @"    SELECT sender FROM IRCMessage WHERE sender != ''"
+                   @"    UNION SELECT kickedUser FROM IRCMessage WHERE kickedUser IS NOT NULL AND kickedUser != '';"
+                   ]) failedAt(14);
+            
+            if (! [db executeUpdate:
+                   @"INSERT INTO IRCMessageCompact (id, conversation, timestamp, messageType, sender, kickedUser, message, tags, isServerMessage)"
+                   @"    SELECT IRCMessage.id, IRCMessageConversation.id, IRCMessage.timestamp, IRCMessage.messageType, sender.id, kickedUser.id,"
+                   @"           IRCMessage.message, NULL, IRCMessage.isServerMessage"
+                   @"    FROM IRCMessage"
+                   @"    JOIN IRCMessageConversation ON IRCMessageConversation.identifier = IRCMessage.conversation"
+                   @"    LEFT JOIN IRCMessageSender AS sender ON sender.hostmask = IRCMessage.sender"
+                   @"    LEFT JOIN IRCMessageSender AS kickedUser ON kickedUser.hostmask = IRCMessage.kickedUser;"
+                   ]) failedAt(15);
+            
+            /* Dropping the old table takes its indexes and triggers with it, the search index is built again on the new one. */
+            if (! [db executeUpdate:@"DROP TABLE IRCMessageSearch;"]) failedAt(16);
+            if (! [db executeUpdate:@"DROP TABLE IRCMessage;"]) failedAt(17);
+            if (! [db executeUpdate:@"ALTER TABLE IRCMessageCompact RENAME TO IRCMessage;"]) failedAt(18);
+            
+            /* Paging through a conversation and trimming it both look up messages by conversation, newest first. */
+            if (! [db executeUpdate:@"CREATE INDEX IF NOT EXISTS IDX_3 ON IRCMessage (conversation, timestamp);"]) failedAt(19);
+            
+            for (NSUInteger i = 0; i < searchIndexStatements.count; i++) {
+                if (! [db executeUpdate:searchIndexStatements[i]]) failedAt(20 + (int)i);
+            }
+            
+            *schemaVersion = 4;
+        }
     
         [db commit];
     }];
     
+    [[IRCMessageStore sharedStore] openSnapshotReaderAtPath:dbPath];
+    
     return YES;
 }
 
@@ -185,14 +294,11 @@
     if (self.conversationsController.currentConversation) {
         ChatMessageView *messageView;
         DLImageView *imageView;
-        for (UIView *view in self.conversationsController.currentConversation.contentView.subviews) {
-            if ([NSStringFromClass(view.class) isEqualToString:@"ChatMessageView"]) {
-                messageView = (ChatMessageView*)view;
-                for (UIView *view2 in messageView.subviews) {
-                    if ([NSStringFromClass(view2.class) isEqualToString:@"DLImageView"]) {
-                        imageView = (DLImageView*)view2;
-                        imageView.image = nil;
-                    }
+        for (messageView in self.conversationsController.currentConversation.contentView.visibleMessageViews) {
+            for (UIView *view2 in messageView.subviews) {
+                if ([NSStringFromClass(view2.class) isEqualToString:@"DLImageView"]) {
+                    imageView = (DLImageView*)view2;
+                    imageView.image = nil;
                 }
             }
         }
@@ -214,7 +320,7 @@
     _conversationsController.currentConversation = nil;
     [[AppPreferences sharedPrefs] savePrefs];
     
-    [_conversationsController saveHistoricMessages];
+    [[IRCMessageStore sharedStore] flush];
 }
 
 - (void)applicationWillEnterForeground:(UIApplication *)application
@@ -258,16 +364,13 @@
     int i=0;
     ChatMessageView *messageView;
     DLImageView *imageView;
-    for (UIView *view in self.conversationsController.currentConversation.contentView.subviews) {
-        if ([NSStringFromClass(view.class) isEqualToString:@"ChatMessageView"]) {
-            messageView = (ChatMessageView*)view;
-            i=0;
-            for (UIView *view2 in messageView.subviews) {
-                if ([NSStringFromClass(view2.class) isEqualToString:@"DLImageView"]) {
-                    imageView = (DLImageView*)view2;
-                    [imageView displayImageFromUrl:[messageView.images[i] absoluteString]];
-                    i++;
-                }
+    for (messageView in self.conversationsController.currentConversation.contentView.visibleMessageViews) {
+        i=0;
+        for (UIView *view2 in messageView.subviews) {
+            if ([NSStringFromClass(view2.class) isEqualToString:@"DLImageView"]) {
+                imageView = (DLImageView*)view2;
+                [imageView displayImageFromUrl:[messageView.images[i] absoluteString]];
+                i++;
             }
         }
     }
@@ -278,7 +381,7 @@
     // Called when the application is about to terminate. Save data if appropriate. See also applicationDidEnterBackground:
     [_conversationsController disconnect];
     
-    [_conversationsController saveHistoricMessages];
+    [[IRCMessageStore sharedStore] flushAndWait];
 }
 
 - (BOOL)application:(UIApplication *)application openURL:(NSURL *)url
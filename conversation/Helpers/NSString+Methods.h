@@ -42,13 +42,17 @@
 - (BOOL) isValidUsername;
 - (BOOL) isValidWildcardIgnoreMask;
 - (BOOL)isEqualToStringCaseInsensitive:(NSString *)compareString;
+- (NSString *)stringByFoldingCaseMapping:(IRCClient *)client;
+- (BOOL)isEqualToName:(NSString *)name onClient:(IRCClient *)client;
 
 - (NSData *)dataUsingEncodingFromConfiguration:(IRCConnectionConfiguration *)configuration;
 - (NSString *)stringByEscapingCertainCharacters;
 - (NSString*)stringByTruncatingToWidth:(CGFloat)width withAttributes:(NSDictionary *)attributes;
 - (BOOL)getUserHostComponents:(NSString **)nickname username:(NSString **)username hostname:(NSString **)hostname onClient:(IRCClient *)client;
 
++ (NSStringEncoding)encodingFromConfiguration:(IRCConnectionConfiguration *)configuration;
 + (NSString *) stringWithCString:(const char *)string usingEncodingPreference:(IRCConnectionConfiguration *)configuration;
++ (NSString *) stringWithBytes:(const char *)bytes length:(NSUInteger)length usingEncodingPreference:(IRCConnectionConfiguration *)configuration;
 - (NSString *)removeIRCFormatting;
 
 @end
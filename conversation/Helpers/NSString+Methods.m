@@ -30,66 +30,38 @@
 
 #import "NSString+Methods.h"
 #import "IRCClient.h"
+#import "IRCParser.h"
+#import "IRCValidation.h"
 #include <arpa/inet.h>
 
 #define specialChars [NSArray arrayWithObjects: @"\\", @"^", @"$", @"[", @"]", nil]
 
 @implementation NSString (Helpers)
 
-- (BOOL) isValidChannelName:(IRCClient *)client
+/*!
+ *    @brief  Run a byte range validation function on the UTF-8 contents of a string, without copying it to the heap where possible.
+ */
+static inline BOOL IRCValidateString(NSString *string, const IRCValidationTable *table, BOOL (*validate)(const IRCValidationTable *, IRCByteRange))
 {
-    /* Get the channel prefix characters allowed by the server */
-    NSString *acceptedChannelPrefixesByServer = [IRCClient getChannelPrefixCharacters:client];
-    
-    /* Turn both strings into character arrays for parsing */
-    char* prefixes = malloc([acceptedChannelPrefixesByServer length]);
-    strcpy(prefixes, [acceptedChannelPrefixesByServer UTF8String]);
-    char* prefixesBeforeIteration = prefixes;
-    
-    char*  channel = malloc([self length]+1);
-    strcpy(channel, [self UTF8String]);
-    char* channelBeforeIteration = channel;
-    
-    /* Some IRC bouncers prefix special channels with a '~' we will skip this */
-    if (*channel == '~') {
-        channel++;
-    }
-    
-    BOOL channelHasPrefix = NO;
-    
-    /* Iterate over prefixes accepted by the server and set YES if we find a match. */
-    while (*prefixes != '\0') {
-        if (*prefixes == *channel) {
-            channelHasPrefix = YES;
-            break;
+    const char *bytes = CFStringGetCStringPtr((__bridge CFStringRef)string, kCFStringEncodingUTF8);
+    char buffer[256];
+    if (bytes == NULL) {
+        if ([string getCString:buffer maxLength:sizeof(buffer) encoding:NSUTF8StringEncoding]) {
+            bytes = buffer;
+        } else {
+            bytes = [string UTF8String];
         }
-        prefixes++;
     }
-    if (channelHasPrefix) {
-        /* Continue iterating on the channel name and halt if we find an invalid character */
-        while (*channel != '\0') {
-            if (*channel == ' ' || *channel == '\007' || *channel == ',') {
-                channel = channelBeforeIteration;
-                free(channel);
-                prefixes = prefixesBeforeIteration;
-                free(prefixes);
-                return NO;
-            }
-            channel++;
-        }
-        channel = channelBeforeIteration;
-        free(channel);
-        prefixes = prefixesBeforeIteration;
-        free(prefixes);
-        return YES;
-    } else {
-        channel = channelBeforeIteration;
-        free(channel);
-        prefixes = prefixesBeforeIteration;
-        free(prefixes);
+    if (bytes == NULL) {
         return NO;
     }
-    return NO;
+    return validate(table, (IRCByteRange){ bytes, strlen(bytes) });
+}
+
+- (BOOL) isValidChannelName:(IRCClient *)client
+{
+    const IRCValidationTable *table = client ? [client validationTable] : IRCDefaultValidationTable();
+    return IRCValidateString(self, table, IRCIsValidChannelName);
 }
 
 - (BOOL) isValidServerAddress
@@ -122,43 +94,13 @@
 
 - (BOOL) isValidNickname:(IRCClient *)client
 {
-    int maxNickLength = [[[client featuresSupportedByServer] objectForKey:@"NICKLEN"] intValue];
-    if (maxNickLength == 0) {
-        maxNickLength = 16;
-    }
-    
-    // Check length
-    if (self.length < 2 || self.length > maxNickLength)
-        return NO;
-
-    return YES;
+    const IRCValidationTable *table = client ? [client validationTable] : IRCDefaultValidationTable();
+    return ([self length] >= 2 && [self length] <= table->maximumNicknameLength);
 }
 
 - (BOOL)isValidUsername
 {
-    /* Validate that length is 1 or larger */
-    if (self.length < 1) {
-        return NO;
-    }
-    
-    /* Parse username and ensure it does not contain carriage return, line feed, @, or !. */
-    const char* username = [self UTF8String];
-    while (*username != '\0') {
-        if (*username == '\010' || *username == '\014' || *username == '@' || *username == '!') {
-            return NO;
-        }
-        username++;
-    }
-    return YES;
-}
-
--(BOOL)isValidHostname
-{
-    if ([self length] < 1 || [self length] > 255) return NO;
-    NSCharacterSet *hostnameCharacterSet = ((AppDelegate *)[UIApplication sharedApplication].delegate).ircCharacterSets.hostnameCharacterSet;
-    if ([self rangeOfCharacterFromSet:hostnameCharacterSet].location != NSNotFound) return NO;
-    
-    return YES;
+    return IRCValidateString(self, IRCDefaultValidationTable(), IRCIsValidUsername);
 }
 
 - (BOOL)isValidWildcardIgnoreMask
@@ -175,12 +117,7 @@
 
 + (NSString *) stringWithCString:(const char *)string usingEncodingPreference:(IRCConnectionConfiguration *)configuration
 {
-    NSStringEncoding encoding;
-    if (configuration && configuration.socketEncodingType) {
-        encoding = configuration.socketEncodingType;
-    } else {
-        encoding = NSUTF8StringEncoding;
-    }
+    NSStringEncoding encoding = [NSString encodingFromConfiguration:configuration];
     NSString *encodedString;
     encodedString = [NSString stringWithCString:string encoding:encoding];
     if (encodedString == nil) {
@@ -189,14 +126,28 @@
     return encodedString;
 }
 
-- (NSData *)dataUsingEncodingFromConfiguration:(IRCConnectionConfiguration *)configuration
++ (NSString *) stringWithBytes:(const char *)bytes length:(NSUInteger)length usingEncodingPreference:(IRCConnectionConfiguration *)configuration
+{
+    NSStringEncoding encoding = [NSString encodingFromConfiguration:configuration];
+    NSString *encodedString;
+    encodedString = [[NSString alloc] initWithBytes:bytes length:length encoding:encoding];
+    if (encodedString == nil) {
+        encodedString = [[NSString alloc] initWithBytes:bytes length:length encoding:NSASCIIStringEncoding];
+    }
+    return encodedString;
+}
+
++ (NSStringEncoding)encodingFromConfiguration:(IRCConnectionConfiguration *)configuration
 {
-    NSStringEncoding encoding;
     if (configuration && configuration.socketEncodingType) {
-        encoding = configuration.socketEncodingType;
-    } else {
-        encoding = NSUTF8StringEncoding;
+        return configuration.socketEncodingType;
     }
+    return NSUTF8StringEncoding;
+}
+
+- (NSData *)dataUsingEncodingFromConfiguration:(IRCConnectionConfiguration *)configuration
+{
+    NSStringEncoding encoding = [NSString encodingFromConfiguration:configuration];
     return [self dataUsingEncoding:encoding allowLossyConversion:NO];
 }
 
@@ -233,29 +184,55 @@
     return truncatedString;
 }
 
+- (NSString *)stringByFoldingCaseMapping:(IRCClient *)client
+{
+    /* Fold the string to lowercase the way the server compares nicknames and channel names. Servers that do not
+     announce a CASEMAPPING use rfc1459, where []\^ are the uppercase equivalents of {}|~ */
+    IRCCaseMapping caseMapping = client ? client.caseMapping : CASEMAPPING_RFC1459;
+    
+    NSUInteger length = [self length];
+    unichar stackBuffer[64];
+    unichar *characters = length <= 64 ? stackBuffer : malloc(length * sizeof(unichar));
+    [self getCharacters:characters range:NSMakeRange(0, length)];
+    
+    for (NSUInteger i = 0; i < length; i++) {
+        characters[i] = IRCFoldCharacter(characters[i], caseMapping);
+    }
+    
+    NSString *foldedString = [NSString stringWithCharacters:characters length:length];
+    if (characters != stackBuffer) {
+        free(characters);
+    }
+    return foldedString;
+}
+
 - (BOOL)isEqualToStringCaseInsensitive:(NSString *)compareString
 {
 	return ([self caseInsensitiveCompare:compareString] == NSOrderedSame);
 }
 
+- (BOOL)isEqualToName:(NSString *)name onClient:(IRCClient *)client
+{
+    return [client name:self isEqualToName:name];
+}
+
 - (BOOL)getUserHostComponents:(NSString **)nickname username:(NSString **)username hostname:(NSString **)hostname onClient:(IRCClient *)client
 {
-    NSCharacterSet *hostmaskCharacterSet = [NSCharacterSet characterSetWithCharactersInString:@"!@"];
-    NSArray *components = [self componentsSeparatedByCharactersInSet:hostmaskCharacterSet];
-    
-    if ([components count] != 3) return NO;
-    
-    *nickname = [components objectAtIndex:0];
-    *username = [components objectAtIndex:1];
-    *hostname = [components objectAtIndex:2];
-    
-    #define AssertValidInput(x) if (x == NO) return NO
+    const char *hostmask = [self UTF8String];
+    IRCByteRange nicknameRange, usernameRange, hostnameRange;
+    if (hostmask == NULL || IRCSplitHostmask((IRCByteRange){ hostmask, strlen(hostmask) }, &nicknameRange, &usernameRange, &hostnameRange) == NO) {
+        return NO;
+    }
     
-    AssertValidInput([*nickname isValidNickname:client]);
-    AssertValidInput([*username isValidUsername]);
-    AssertValidInput([*hostname isValidHostname]);
+    IRCConnectionConfiguration *configuration = [client configuration];
+    *nickname = IRCStringFromByteRange(nicknameRange, configuration);
+    *username = IRCStringFromByteRange(usernameRange, configuration);
+    *hostname = IRCStringFromByteRange(hostnameRange, configuration);
     
-    return YES;
+    const IRCValidationTable *table = client ? [client validationTable] : IRCDefaultValidationTable();
+    return (IRCIsValidNickname(table, nicknameRange) &&
+            IRCIsValidUsername(table, usernameRange) &&
+            IRCIsValidHostname(table, hostnameRange));
 }
 
 /* 
@@ -33,13 +33,24 @@
 #import "IRCConversation.h"
 #import "IRCChannelConfiguration.h"
 #import "IRCUser.h"
+#import "IRCUserlistChange.h"
+#import "IRCMentionMatcher.h"
 
 @class IRCClient;
 
+/* The list replies users are staged from. Each has its own staging list, so a WHO that is still being
+ received never ends up in the userlist built from a NAMES reply, or the other way round. */
+typedef enum IRCUserlistReply : NSUInteger {
+    USERLIST_REPLY_NAMES,
+    USERLIST_REPLY_WHO
+} IRCUserlistReply;
+
 @interface IRCChannel : IRCConversation
 
 @property (nonatomic) NSString *topic;
-@property (nonatomic) NSMutableArray *users;
+@property (nonatomic, readonly) NSArray *users;
+@property (atomic, readonly) NSArray *userlistSnapshot;
+@property (nonatomic, readonly) IRCMentionMatcher *mentionMatcher;
 @property (nonatomic) NSMutableArray *channelModes;
 @property (nonatomic, assign) BOOL isJoinedByUser;
 
@@ -60,6 +71,20 @@
  */
 - (void)setTopic:(NSString *)topic;
 
+/*!
+ *    @brief  Add a user to the userlist, replacing any user already in the list with the same nickname.
+ *
+ *    @param user The user to add.
+ */
+- (void)addUser:(IRCUser *)user;
+
+/*!
+ *    @brief  Remove a user from the userlist.
+ *
+ *    @param user The user to remove.
+ */
+- (void)removeUser:(IRCUser *)user;
+
 /*!
  *    @brief  Remove a user from the userlist.
  *
@@ -67,6 +92,87 @@
  */
 - (void)removeUserByName:(NSString *)nickname;
 
+/*!
+ *    @brief  Remove all users from the userlist.
+ */
+- (void)removeAllUsers;
+
+/*!
+ *    @brief  Change the nickname of a user in the userlist.
+ *
+ *    @param user     The user to rename.
+ *    @param nickname The new nickname of the user.
+ */
+- (void)renameUser:(IRCUser *)user toNickname:(NSString *)nickname;
+
+/*!
+ *    @brief  Make changes to a user in the userlist and move it to its new position in the list.
+ *
+ *    @param user    The user to change.
+ *    @param changes A block that performs the changes to the user.
+ */
+- (void)modifyUser:(IRCUser *)user withChanges:(void (^)(void))changes;
+
+/*!
+ *    @brief  Group the following userlist changes into a single "userlistChanged" notification,
+ *            until a matching call to endUserlistUpdates.
+ */
+- (void)beginUserlistUpdates;
+
+/*!
+ *    @brief  Post the userlist changes made since the matching call to beginUserlistUpdates.
+ */
+- (void)endUserlistUpdates;
+
+/*!
+ *    @brief  Add a user to the staging list of a NAMES or WHO reply that is still being received.
+ *            The userlist itself is not changed until the staged users are committed.
+ *
+ *    @param user  The user to stage, replacing any staged user with the same nickname.
+ *    @param reply The reply the user was listed in.
+ */
+- (void)stageUser:(IRCUser *)user fromReply:(IRCUserlistReply)reply;
+
+/*!
+ *    @brief  Get a user from the staging list of a reply.
+ *
+ *    @param nickname The nickname of the user, compared using the casemapping of the server.
+ *    @param reply    The reply the user was listed in.
+ *
+ *    @return The staged user with this nickname, or nil if there is no such staged user.
+ */
+- (IRCUser *)stagedUserWithNickname:(NSString *)nickname fromReply:(IRCUserlistReply)reply;
+
+/*!
+ *    @brief  Apply the users staged from a reply to the userlist at once, sort it a single time and post a single "userlistChanged" notification.
+ *
+ *    @param reply   The reply that has ended.
+ *    @param replace Whether the staged users make up the whole channel, users that were not staged are removed from the userlist.
+ *    @param merge   A block that copies the details of a staged user onto the user already in the userlist with the same nickname.
+ */
+- (void)commitStagedUsersFromReply:(IRCUserlistReply)reply replacingUserlist:(BOOL)replace merge:(void (^)(IRCUser *user, IRCUser *stagedUser))merge;
+
+/*!
+ *    @brief  Drop the users staged from a reply without applying them, such as when the reply ended for another target.
+ *
+ *    @param reply The reply to drop the staged users of.
+ */
+- (void)discardStagedUsersFromReply:(IRCUserlistReply)reply;
+
+/*!
+ *    @brief  Key the userlist and the staged users again, such as after the casemapping of the server has changed.
+ */
+- (void)rebuildUserIndex;
+
+/*!
+ *    @brief  Get the user with a specific nickname from the userlist.
+ *
+ *    @param nickname The nickname of the user, compared using the casemapping of the server.
+ *
+ *    @return The user with this nickname, or nil if there is no such user in the channel.
+ */
+- (IRCUser *)userWithNickname:(NSString *)nickname;
+
 /*!
  *    @brief  Give a specific channel privilegie to one or more users.
  *
@@ -93,7 +199,8 @@
 - (BOOL)hasUserWithNick:(NSString *)nick;
 
 /*!
- *    @brief  Manually perform a sorting of the userlist.
+ *    @brief  Manually perform a sorting of the whole userlist.
+ *            The userlist is kept in order as it changes, this is only needed if users were changed outside of the channel.
  */
 - (void)sortUserlist;
 
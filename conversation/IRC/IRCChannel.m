@@ -31,6 +31,31 @@
 #import "IRCChannel.h"
 #import "IRCClient.h"
 #import "IRCConnection.h"
+#import "IRCCommandBatcher.h"
+
+static NSComparisonResult IRCCompareUsers(IRCUser *user, IRCUser *otherUser)
+{
+    /* Users are sorted by privilegie first, then by name. */
+    int privilege = [user channelPrivilege];
+    int otherPrivilege = [otherUser channelPrivilege];
+    if (privilege != otherPrivilege) {
+        return privilege > otherPrivilege ? NSOrderedAscending : NSOrderedDescending;
+    }
+    return [user.nick caseInsensitiveCompare:otherUser.nick];
+}
+
+@interface IRCChannel ()
+
+@property (nonatomic, strong) NSMutableArray *orderedUsers;
+@property (nonatomic, strong) NSMutableDictionary *userIndex;
+@property (nonatomic, strong) NSMutableArray *pendingUserlistChanges;
+@property (nonatomic, strong) NSMutableDictionary *stagedNAMESUsers;
+@property (nonatomic, strong) NSMutableDictionary *stagedWHOUsers;
+@property (nonatomic, assign) NSUInteger userlistUpdateDepth;
+@property (atomic, readwrite) NSArray *userlistSnapshot;
+@property (nonatomic, readwrite) IRCMentionMatcher *mentionMatcher;
+
+@end
 
 @implementation IRCChannel
 
@@ -41,7 +66,14 @@
         self.name = config.name;
         self.client = client;
         self.topic = nil;
-        self.users = [[NSMutableArray alloc] init];
+        self.orderedUsers = [[NSMutableArray alloc] init];
+        self.userIndex = [[NSMutableDictionary alloc] init];
+        self.pendingUserlistChanges = [[NSMutableArray alloc] init];
+        self.stagedNAMESUsers = [[NSMutableDictionary alloc] init];
+        self.stagedWHOUsers = [[NSMutableDictionary alloc] init];
+        self.userlistUpdateDepth = 0;
+        self.userlistSnapshot = @[];
+        self.mentionMatcher = [[IRCMentionMatcher alloc] initWithClient:client];
         self.configuration = config;
         self.channelModes = [[NSMutableArray alloc] init];
         return self;
@@ -54,69 +86,287 @@
     return [self.client isConnected] && self.isJoinedByUser;
 }
 
+- (NSArray *)users
+{
+    return self.orderedUsers;
+}
+
+- (NSUInteger)indexOfUser:(IRCUser *)user
+{
+    NSRange range = NSMakeRange(0, [self.orderedUsers count]);
+    NSUInteger index = [self.orderedUsers indexOfObject:user inSortedRange:range options:NSBinarySearchingFirstEqual usingComparator:^NSComparisonResult(id obj1, id obj2) {
+        return IRCCompareUsers(obj1, obj2);
+    }];
+    
+    /* Users that compare equal are not necessarily the same user, look through the run of equal users for this one. */
+    while (index != NSNotFound && index < range.length && IRCCompareUsers(self.orderedUsers[index], user) == NSOrderedSame) {
+        if (self.orderedUsers[index] == user) {
+            return index;
+        }
+        index++;
+    }
+    
+    /* The user has been changed without letting us know, fall back to looking for it. */
+    return [self.orderedUsers indexOfObjectIdenticalTo:user];
+}
+
+- (NSUInteger)insertionIndexForUser:(IRCUser *)user
+{
+    return [self.orderedUsers indexOfObject:user inSortedRange:NSMakeRange(0, [self.orderedUsers count]) options:NSBinarySearchingInsertionIndex | NSBinarySearchingLastEqual usingComparator:^NSComparisonResult(id obj1, id obj2) {
+        return IRCCompareUsers(obj1, obj2);
+    }];
+}
+
+- (void)addUser:(IRCUser *)user
+{
+    /* Users are indexed by the interned key of their nickname, the ordered list is kept separately for the userlist. */
+    NSString *key = [self.client keyForName:user.nick];
+    IRCUser *existingUser = [self.userIndex objectForKey:key];
+    
+    [self beginUserlistUpdates];
+    if (existingUser) {
+        [self removeUserFromOrderedList:existingUser];
+    } else {
+        [self.mentionMatcher addNicknameKey:key];
+    }
+    [self.userIndex setObject:user forKey:key];
+    
+    NSUInteger index = [self insertionIndexForUser:user];
+    [self.orderedUsers insertObject:user atIndex:index];
+    [self.pendingUserlistChanges addObject:[IRCUserlistChange changeWithType:USERLIST_INSERT fromIndex:NSNotFound toIndex:index user:user]];
+    [self endUserlistUpdates];
+}
+
+- (void)removeUserFromOrderedList:(IRCUser *)user
+{
+    NSUInteger index = [self indexOfUser:user];
+    if (index != NSNotFound) {
+        [self.orderedUsers removeObjectAtIndex:index];
+        [self.pendingUserlistChanges addObject:[IRCUserlistChange changeWithType:USERLIST_DELETE fromIndex:index toIndex:NSNotFound user:user]];
+    }
+}
+
+- (void)removeUser:(IRCUser *)user
+{
+    [self removeUserByName:user.nick];
+}
+
 - (void)removeUserByName:(NSString *)nickname
 {
     /* Shorthand method to remove a user from the userlist. */
-    for (IRCUser *user in self.users) {
-        if ([[user nick] isEqualToString:nickname]) {
-            [self.users removeObject:user];
-            break;
+    NSString *key = [self.client keyForName:nickname];
+    IRCUser *user = [self.userIndex objectForKey:key];
+    if (user) {
+        [self beginUserlistUpdates];
+        [self.userIndex removeObjectForKey:key];
+        [self.mentionMatcher removeNicknameKey:key];
+        [self removeUserFromOrderedList:user];
+        [self endUserlistUpdates];
+    }
+}
+
+- (void)removeAllUsers
+{
+    [self.userIndex removeAllObjects];
+    [self.orderedUsers removeAllObjects];
+    [self.pendingUserlistChanges removeAllObjects];
+    [self.stagedNAMESUsers removeAllObjects];
+    [self.stagedWHOUsers removeAllObjects];
+    [self.mentionMatcher setNicknameKeys:@[]];
+    [self postUserlistChanges:nil];
+}
+
+- (void)renameUser:(IRCUser *)user toNickname:(NSString *)nickname
+{
+    NSString *oldKey = [self.client keyForName:user.nick];
+    NSString *newKey = [self.client keyForName:nickname];
+    [self.userIndex removeObjectForKey:oldKey];
+    [self.mentionMatcher removeNicknameKey:oldKey];
+    [self modifyUser:user withChanges:^{
+        user.nick = nickname;
+    }];
+    [self.userIndex setObject:user forKey:newKey];
+    [self.mentionMatcher addNicknameKey:newKey];
+}
+
+- (void)modifyUser:(IRCUser *)user withChanges:(void (^)(void))changes
+{
+    /* Find the user while it is still in its sorted position, then move it only as far as it needs to go. */
+    NSUInteger fromIndex = [self indexOfUser:user];
+    changes();
+    if (fromIndex == NSNotFound) {
+        return;
+    }
+    
+    [self beginUserlistUpdates];
+    [self.orderedUsers removeObjectAtIndex:fromIndex];
+    NSUInteger toIndex = [self insertionIndexForUser:user];
+    [self.orderedUsers insertObject:user atIndex:toIndex];
+    
+    UserlistChangeType type = (fromIndex == toIndex) ? USERLIST_UPDATE : USERLIST_MOVE;
+    [self.pendingUserlistChanges addObject:[IRCUserlistChange changeWithType:type fromIndex:fromIndex toIndex:toIndex user:user]];
+    [self endUserlistUpdates];
+}
+
+- (void)rebuildUserIndex
+{
+    NSMutableDictionary *userIndex = [[NSMutableDictionary alloc] initWithCapacity:[self.orderedUsers count]];
+    for (IRCUser *user in self.orderedUsers) {
+        [userIndex setObject:user forKey:[self.client keyForName:user.nick]];
+    }
+    self.userIndex = userIndex;
+    [self.mentionMatcher setNicknameKeys:[userIndex allKeys]];
+    
+    self.stagedNAMESUsers = [self rekeyedStagedUsers:self.stagedNAMESUsers];
+    self.stagedWHOUsers = [self rekeyedStagedUsers:self.stagedWHOUsers];
+}
+
+- (NSMutableDictionary *)rekeyedStagedUsers:(NSDictionary *)stagedUsers
+{
+    NSMutableDictionary *rekeyedUsers = [[NSMutableDictionary alloc] initWithCapacity:[stagedUsers count]];
+    for (IRCUser *user in [stagedUsers allValues]) {
+        [rekeyedUsers setObject:user forKey:[self.client keyForName:user.nick]];
+    }
+    return rekeyedUsers;
+}
+
+- (IRCUser *)userWithNickname:(NSString *)nickname
+{
+    if (nickname == nil) return nil;
+    return [self.userIndex objectForKey:[self.client keyForName:nickname]];
+}
+
+- (NSMutableDictionary *)stagedUsersFromReply:(IRCUserlistReply)reply
+{
+    return reply == USERLIST_REPLY_WHO ? self.stagedWHOUsers : self.stagedNAMESUsers;
+}
+
+- (void)stageUser:(IRCUser *)user fromReply:(IRCUserlistReply)reply
+{
+    [[self stagedUsersFromReply:reply] setObject:user forKey:[self.client keyForName:user.nick]];
+}
+
+- (IRCUser *)stagedUserWithNickname:(NSString *)nickname fromReply:(IRCUserlistReply)reply
+{
+    if (nickname == nil) return nil;
+    return [[self stagedUsersFromReply:reply] objectForKey:[self.client keyForName:nickname]];
+}
+
+- (void)discardStagedUsersFromReply:(IRCUserlistReply)reply
+{
+    [[self stagedUsersFromReply:reply] removeAllObjects];
+}
+
+- (void)commitStagedUsersFromReply:(IRCUserlistReply)reply replacingUserlist:(BOOL)replace merge:(void (^)(IRCUser *user, IRCUser *stagedUser))merge
+{
+    NSMutableDictionary *stagedUsers = [self stagedUsersFromReply:reply];
+    if ([stagedUsers count] == 0 && replace == NO) {
+        return;
+    }
+    
+    /* Build the index and the ordering in one go rather than inserting the users one by one,
+     a join on a large channel would otherwise post thousands of single row changes. */
+    NSMutableDictionary *userIndex = replace ? [[NSMutableDictionary alloc] initWithCapacity:[stagedUsers count]] : self.userIndex;
+    [stagedUsers enumerateKeysAndObjectsUsingBlock:^(NSString *key, IRCUser *stagedUser, BOOL *stop) {
+        IRCUser *user = [self.userIndex objectForKey:key];
+        if (user) {
+            merge(user, stagedUser);
+            [userIndex setObject:user forKey:key];
+        } else {
+            [userIndex setObject:stagedUser forKey:key];
         }
+    }];
+    [stagedUsers removeAllObjects];
+    
+    self.userIndex = userIndex;
+    self.orderedUsers = [[userIndex allValues] mutableCopy];
+    [self.mentionMatcher setNicknameKeys:[userIndex allKeys]];
+    [self sortUserlist];
+}
+
+- (BOOL)stringMentionsCurrentUser:(NSString *)string
+{
+    NSString *key = [self.client keyForName:self.client.currentUserOnConnection.nick];
+    if (key == nil) return NO;
+    return [self.mentionMatcher string:string mentionsNicknameKey:key];
+}
+
+- (void)beginUserlistUpdates
+{
+    self.userlistUpdateDepth++;
+}
+
+- (void)endUserlistUpdates
+{
+    if (self.userlistUpdateDepth == 0) return;
+    
+    self.userlistUpdateDepth--;
+    if (self.userlistUpdateDepth == 0 && [self.pendingUserlistChanges count] > 0) {
+        NSArray *changes = [self.pendingUserlistChanges copy];
+        [self.pendingUserlistChanges removeAllObjects];
+        [self postUserlistChanges:changes];
+    }
+}
+
+/*!
+ *    @brief  Let the interface know the userlist has changed.
+ *
+ *    @param changes The changes made since the last notification, in order. Nil if the userlist has to be reloaded as a whole.
+ */
+- (void)postUserlistChanges:(NSArray *)changes
+{
+    /* The userlist is only ever changed on the parsing queue, the interface works with immutable snapshots of it.
+     A snapshot is passed along with the changes that lead up to it, so the interface can tell whether it can apply the changes
+     on top of what it is currently showing or if it has to reload. */
+    NSArray *previousUsers = self.userlistSnapshot;
+    NSArray *users = [self.orderedUsers copy];
+    self.userlistSnapshot = users;
+    
+    NSMutableDictionary *userInfo = [@{ @"previousUsers": previousUsers, @"users": users } mutableCopy];
+    if (changes) {
+        userInfo[@"changes"] = changes;
     }
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [[NSNotificationCenter defaultCenter] postNotificationName:@"userlistChanged" object:self userInfo:userInfo];
+    });
 }
 
 - (void)givePrivilegieToUsers:(NSArray *)users toStatus:(int)status onChannel:(IRCChannel *)channel
 {
     /* This method takes an array of users and gives them the operator (+o) permission. 
-     with multiple users it will build a string like "+oooo user1 user2 user3 user4" and run the mode command. */
+     with multiple users it will build lines like "+oooo user1 user2 user3 user4", as many changes in a line as the server allows. */
     NSString *modeSymbol = [IRCUser statusToModeSymbol:status];
     if (modeSymbol) {
-        NSString *modeString = @"+";
-        NSString *userString = @"";
-        int i = 0;
-        while (i < [users count]) {
-            modeString = [modeString stringByAppendingString:modeSymbol];
-            userString = [userString stringByAppendingString:[NSString stringWithFormat:@" %@", [users objectAtIndex:i]]];
-            i++;
+        for (NSString *line in [[IRCCommandBatcher batcherForClient:channel.client] modeLinesForChannel:channel.name adding:YES mode:modeSymbol arguments:users]) {
+            [channel.client.connection send:line];
         }
-        [channel.client.connection send:[NSString stringWithFormat:@"MODE %@ %@%@", channel.name, modeString, userString]];
     }
 }
 
 - (void)revokePrivilegieFromUsers:(NSArray *)users toStatus:(int)status onChannel:(IRCChannel *)channel
 {
     /* This method takes an array of users and gives revokes operator permission (-o)
-     with multiple users it will build a string like "-oooo user1 user2 user3 user4" and run the mode command. */
+     with multiple users it will build lines like "-oooo user1 user2 user3 user4", as many changes in a line as the server allows. */
     NSString *modeSymbol = [IRCUser statusToModeSymbol:status];
     if (modeSymbol) {
-        NSString *modeString = @"-";
-        NSString *userString = @"";
-        int i = 0;
-        while (i < [users count]) {
-            modeString = [modeString stringByAppendingString:modeSymbol];
-            userString = [userString stringByAppendingString:[NSString stringWithFormat:@" %@", [users objectAtIndex:i]]];
-            i++;
+        for (NSString *line in [[IRCCommandBatcher batcherForClient:channel.client] modeLinesForChannel:channel.name adding:NO mode:modeSymbol arguments:users]) {
+            [channel.client.connection send:line];
         }
-        [channel.client.connection send:[NSString stringWithFormat:@"MODE %@ %@%@", channel.name, modeString, userString]];
     }
 }
 
 - (BOOL)hasUserWithNick:(NSString *)nick
 {
-    for (IRCUser *user in self.users) {
-        if ([user.nick isEqualToString:nick])
-            return YES;
-    }
-    return NO;
+    return [self userWithNickname:nick] != nil;
 }
 
 - (void)sortUserlist
 {
-    /* Sort the userlist, first by privilegie, then by name. */
-    NSSortDescriptor *nicknameSortDescriptor = [[NSSortDescriptor alloc] initWithKey:@"nick" ascending:YES selector:@selector(caseInsensitiveCompare:)];
-    NSSortDescriptor *privilegiesSortDescriptor = [[NSSortDescriptor alloc] initWithKey:@"channelPrivilege" ascending:NO];
-    NSArray *sortDescriptors = [[NSArray alloc] initWithObjects:privilegiesSortDescriptor,nicknameSortDescriptor,  nil];
-    self.users = [[self.users sortedArrayUsingDescriptors:sortDescriptors] mutableCopy];
+    [self.orderedUsers sortUsingComparator:^NSComparisonResult(id obj1, id obj2) {
+        return IRCCompareUsers(obj1, obj2);
+    }];
+    [self.pendingUserlistChanges removeAllObjects];
+    [self postUserlistChanges:nil];
 }
 
 @end
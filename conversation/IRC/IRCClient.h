@@ -31,6 +31,7 @@
 #import <Foundation/Foundation.h>
 #import "IRCConnectionConfiguration.h"
 #import "IRCMessageIndex.h"
+#import "IRCValidation.h"
 #import "Messages.h"
 #import "NSString+Methods.h"
 #import "SSKeychain.h"
@@ -41,6 +42,28 @@
 #define IRC_ITALICS     '\029'
 #define IRC_UNDERLINE   '\031'
 
+typedef enum IRCCaseMapping : NSUInteger {
+    CASEMAPPING_RFC1459,
+    CASEMAPPING_STRICT_RFC1459,
+    CASEMAPPING_ASCII
+} IRCCaseMapping;
+
+/*!
+ *    @brief  Fold a single character to lowercase the way a server compares nicknames and channel names.
+ *            In rfc1459 []\^ are the uppercase equivalents of {}|~, strict-rfc1459 leaves out ^ and ~.
+ */
+static inline unichar IRCFoldCharacter(unichar character, IRCCaseMapping caseMapping)
+{
+    if (character >= 'A' && character <= 'Z') {
+        return character + ('a' - 'A');
+    } else if (caseMapping != CASEMAPPING_ASCII && (character == '[' || character == ']' || character == '\\')) {
+        return character + ('{' - '[');
+    } else if (caseMapping == CASEMAPPING_RFC1459 && character == '^') {
+        return '~';
+    }
+    return character;
+}
+
 #define IRCv3CapabilityEnabled(x, y) [[x ircv3CapabilitiesSupportedByServer] indexOfObject:(y)] != NSNotFound
 
 @class IRCConnection;
@@ -71,6 +94,7 @@
 @property (nonatomic, strong) NSMutableDictionary *featuresSupportedByServer;
 @property (nonatomic, strong) NSMutableArray *ircv3CapabilitiesSupportedByServer;
 @property (nonatomic, strong) NSMutableDictionary *userModeCharacters;
+@property (nonatomic, readonly) IRCCaseMapping caseMapping;
 @property (nonatomic, retain) NSMutableArray *channels;
 @property (nonatomic, retain) NSMutableArray *queries;
 @property (nonatomic, strong) NSMutableDictionary *whoisRequests;
@@ -124,7 +148,7 @@
 /*!
  *    @brief  Parse a message from the server.
  *
- *    @param decodedData A string containing the decoded message from the server.
+ *    @param decodedData A null terminated line of raw data from the server, without the terminating CRLF.
  *
  *    @return An IRCMessage object with the basic parsed details of the message.
  */
@@ -149,6 +173,16 @@
  */
 - (void)validateQueryStatusOnAllItems;
 
+/*!
+ *    @brief  Count an ISON reply towards the query status check that is running. Runs on the connection queue.
+ *
+ *    @param nicknames The online nicknames in the reply.
+ *
+ *    @return The online nicknames of every reply of the check once the last one is in, nil while more are expected.
+ *            A reply that is not part of a check is returned as it is.
+ */
+- (NSArray *)onlineNicknamesAfterISONReply:(NSArray *)nicknames;
+
 /*!
  *    @brief  Disconnect from the server, sending the standard pre-configured quit message.
  */
@@ -209,6 +243,41 @@
  */
 - (BOOL)removeQuery:(IRCConversation *)query;
 
+/*!
+ *    @brief  Change the name of a query, such as when the user on the other end changes their nickname.
+ *
+ *    @param query The query to rename.
+ *    @param name  The new name of the query.
+ */
+- (void)renameQuery:(IRCConversation *)query toName:(NSString *)name;
+
+/*!
+ *    @brief  Get a channel or query on this client by its name.
+ *
+ *    @param name The channel name or nickname, compared using the casemapping of the server.
+ *
+ *    @return The channel or query with this name, or nil if there is none.
+ */
+- (IRCConversation *)conversationWithName:(NSString *)name;
+
+/*!
+ *    @brief  Get a channel on this client by its name, ignoring queries with the same name.
+ *
+ *    @param name The channel name, compared using the casemapping of the server.
+ *
+ *    @return The channel with this name, or nil if there is none.
+ */
+- (IRCChannel *)channelWithName:(NSString *)name;
+
+/*!
+ *    @brief  Get a channel or query on this client by the unique identifier of its configuration.
+ *
+ *    @param identifier The unique identifier of the channel or query configuration.
+ *
+ *    @return The channel or query with this identifier, or nil if there is none.
+ */
+- (IRCConversation *)conversationWithIdentifier:(NSString *)identifier;
+
 /*!
  *    @brief  Sort all channels in the conversation list alphabetically.
  *
@@ -223,6 +292,47 @@
  */
 - (NSMutableArray *)sortQueryItems;
 
+/*!
+ *    @brief  Get the channel name and nickname rules of the server, rebuilt whenever it announces CHANTYPES or NICKLEN.
+ *
+ *    @return The validation table of this client.
+ */
+- (const IRCValidationTable *)validationTable;
+
+/*!
+ *    @brief  Get the interned key of a nickname or channel name, folded using the CASEMAPPING of the server.
+ *            Names that are equal on this server always get the same key object, so keys can be compared by pointer.
+ *
+ *    @param name The nickname or channel name.
+ *
+ *    @return The key of the name.
+ */
+- (NSString *)keyForName:(NSString *)name;
+
+/*!
+ *    @brief  Compare two nicknames or channel names using the CASEMAPPING of the server.
+ *
+ *    @param name      The first name to compare.
+ *    @param otherName The second name to compare.
+ *
+ *    @return Boolean indicating whether the names refer to the same nickname or channel on this server.
+ */
+- (BOOL)name:(NSString *)name isEqualToName:(NSString *)otherName;
+
+/*!
+ *    @brief  Get the round trip time of the last PING we sent to the server.
+ *
+ *    @return The lag in seconds, or a negative number if it has not been measured on this connection yet.
+ */
+- (NSTimeInterval)lag;
+
+/*!
+ *    @brief  Get the round trip times of the recent PINGs we sent to the server.
+ *
+ *    @return An array of NSNumber objects with the lag in seconds, oldest first.
+ */
+- (NSArray *)lagHistory;
+
 /*!
  *    @brief  Get the received time of a message.
  *
@@ -39,22 +39,45 @@
 #import "ConsoleViewController.h"
 #import "WHOIS.h"
 #import "NSArray+Methods.h"
+#import "IRCParser.h"
+#import "IRCMessageResolver.h"
+#import "IRCCommandBatcher.h"
+#import "IRCReconnectEngine.h"
+#import "IRCLagMonitor.h"
+#import <AFNetworking/AFNetworkReachabilityManager.h>
 
 #define CONNECTION_RETRY_INTERVAL       30
 #define CONNECTION_RETRY_ATTEMPTS       10
-#define CONNECTION_IRC_PING_INTERVAL    280
+#define CONNECTION_IRC_PING_INTERVAL    60
 #define CONNECTION_IRC_PONG_INTERVAL    30
-#define CONNECTION_TIMEOUT_INTERVAL     300
+#define CONNECTION_KEEPALIVE_INTERVAL   5
+
+#define NAME_KEY_CACHE_LIMIT            8192
+#define ISON_RESPONSE_TIMEOUT           30
 
 @interface IRCClient ()
 
 @property (nonatomic, assign) BOOL connectionIsBeingClosed;
 @property (nonatomic, assign) NSInteger alternativeNickNameAttempts;
-@property (nonatomic, assign) int connectionRetries;
+@property (nonatomic, strong) IRCReconnectEngine *reconnectEngine;
+@property (nonatomic, strong) NSTimer *reconnectTimer;
+@property (nonatomic, strong) IRCLagMonitor *lagMonitor;
+@property (nonatomic, strong) NSTimer *keepAliveTimer;
+@property (nonatomic, readwrite) IRCCaseMapping caseMapping;
+@property (nonatomic, strong) NSMutableDictionary *nameKeys;
+@property (nonatomic, strong) NSMutableDictionary *internedNameKeys;
+@property (nonatomic, strong) NSMutableDictionary *conversationsByName;
+@property (nonatomic, strong) NSMutableDictionary *conversationsByIdentifier;
+@property (nonatomic, strong) NSMutableArray *onlineNicknames;
+@property (nonatomic, assign) NSUInteger pendingISONResponses;
+@property (nonatomic, assign) NSUInteger isonCheck;
 
 @end
 
 @implementation IRCClient
+{
+    IRCValidationTable _validationTable;
+}
 
 + (NSArray *) IRCv3CapabilitiesSupportedByApplication
 {
@@ -114,8 +137,26 @@
         self.featuresSupportedByServer          = [[NSMutableDictionary alloc] init];
         self.ircv3CapabilitiesSupportedByServer = [[NSMutableArray alloc] init];
         self.whoisRequests                      = [[NSMutableDictionary alloc] init];
+        self.nameKeys                           = [[NSMutableDictionary alloc] init];
+        self.internedNameKeys                   = [[NSMutableDictionary alloc] init];
+        self.conversationsByName                = [[NSMutableDictionary alloc] init];
+        self.conversationsByIdentifier          = [[NSMutableDictionary alloc] init];
+        self.caseMapping                        = CASEMAPPING_RFC1459;
+        _validationTable = *IRCDefaultValidationTable();
         self.console = nil;
         
+        /* Let messages loaded from the history find this client and its conversations. */
+        [[IRCMessageResolver sharedResolver] registerClient:self];
+        
+        self.reconnectEngine = [[IRCReconnectEngine alloc] initWithServers:[self serverAddresses]];
+        self.reconnectEngine.maximumAttempts = CONNECTION_RETRY_ATTEMPTS;
+        self.reconnectEngine.maximumDelay = CONNECTION_RETRY_INTERVAL;
+        self.lagMonitor = [[IRCLagMonitor alloc] initWithPingInterval:CONNECTION_IRC_PING_INTERVAL pongTimeout:CONNECTION_IRC_PONG_INTERVAL];
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(networkReachabilityDidChange:)
+                                                     name:AFNetworkingReachabilityDidChangeNotification
+                                                   object:nil];
+        
         return self;
     }
     return nil;
@@ -133,7 +174,29 @@
         [[NSNotificationCenter defaultCenter] postNotificationName:@"clientWillConnect" object:self];
     });
     
-    [self.connection connectToHost:self.configuration.serverAddress onPort:self.configuration.connectionPort useSSL:self.configuration.connectUsingSecureLayer];
+    /* Networks with more than one server are connected to on the one that has been working best. */
+    [self.reconnectEngine setServers:[self serverAddresses]];
+    NSString *serverAddress = [self.reconnectEngine serverForNextAttempt];
+    [self.connection connectToHost:serverAddress onPort:self.configuration.connectionPort useSSL:self.configuration.connectUsingSecureLayer];
+}
+
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+/*!
+ *    @brief  Get the addresses of the servers of this network, the configured server first.
+ *
+ *    @return An array of server addresses.
+ */
+- (NSArray *)serverAddresses
+{
+    NSArray *addresses = self.configuration.serverAddress ? @[self.configuration.serverAddress] : @[];
+    if (self.configuration.alternativeServerAddresses) {
+        addresses = [addresses arrayByAddingObjectsFromArray:self.configuration.alternativeServerAddresses];
+    }
+    return addresses;
 }
 
 - (void)clientDidConnect
@@ -179,78 +242,86 @@
 
 - (IRCMessage *)clientDidReceiveData:(const char*)cline
 {
-    NSString *line = [NSString stringWithCString:cline usingEncodingPreference:self.configuration];
-    NSLog(@"<< %@", line);
+#ifdef DEBUG
+    NSLog(@"<< %s", cline);
+#endif
     
-    BOOL isServerMessage = NO;
-    line = [line removeIRCFormatting];
+    IRCParsedLine line;
+    if (IRCParseLine(cline, strlen(cline), &line) == NO) {
+        return nil;
+    }
     
-    NSMutableArray *lineComponents = [[line componentsSeparatedByString:@" "] mutableCopy];
+    BOOL isServerMessage = NO;
     
-    NSMutableDictionary *tagsList = [[NSMutableDictionary alloc] init];
-    if ([line hasPrefix:@"@"]) {
-        /* This message starts with a message tag ( http://ircv3.atheme.org/specification/message-tags-3.2 ) */
-        NSString *tagString = [[lineComponents objectAtIndex:0] substringFromIndex:1];
-        NSArray *tags = [tagString componentsSeparatedByString:@";"];
-        
-        for (NSString *tag in tags) {
-            if ([tag rangeOfString:@"="].location != NSNotFound) {
-                /* This tag has a value. We will save the key and value into the dictionary. */
-                NSArray *components = [tag componentsSeparatedByString:@"="];
-                [tagsList setObject:components[1] forKey:components[0]];
-            } else {
-                /* This tag does not have a value, only a key. We will save it in the dictionary
-                 with a default value of "1" */
-                [tagsList setObject:@"1" forKey:tag];
-            }
-        }
-        
-        [lineComponents removeObjectAtIndex:0];
+    NSMutableDictionary *tagsList;
+    if (line.tags.bytes) {
+        tagsList = IRCDictionaryFromTagsRange(line.tags, self.configuration);
+    } else {
+        tagsList = [[NSMutableDictionary alloc] init];
     }
     
-    NSString *sendermask = [lineComponents objectAtIndex:0];
     NSString *nickname = @"";
     NSString *username = @"";
     NSString *hostname = @"";
     
     BOOL messageWithoutRecipient = NO;
     
-    if ([sendermask hasPrefix:@":"]) {
-        sendermask = [sendermask substringFromIndex:1];
-        
-        isServerMessage = ! [sendermask getUserHostComponents:&nickname username:&username hostname:&hostname onClient:self];
-        
-        [lineComponents removeObjectAtIndex:0];
+    if (line.prefix.bytes) {
+        /* Server prefixes do not split into a nickname, username and hostname, or do not make a valid user */
+        IRCByteRange nicknameRange, usernameRange, hostnameRange;
+        isServerMessage = YES;
+        if (IRCSplitHostmask(line.prefix, &nicknameRange, &usernameRange, &hostnameRange)) {
+            nickname = IRCStringFromByteRange(nicknameRange, self.configuration);
+            username = IRCStringFromByteRange(usernameRange, self.configuration);
+            hostname = IRCStringFromByteRange(hostnameRange, self.configuration);
+            
+            isServerMessage = ! (IRCIsValidNickname(&_validationTable, nicknameRange) &&
+                                 IRCIsValidUsername(&_validationTable, usernameRange) &&
+                                 IRCIsValidHostname(&_validationTable, hostnameRange));
+        }
     } else {
         isServerMessage = YES;
         messageWithoutRecipient = YES;
     }
     
-    NSString *command = [lineComponents objectAtIndex:0];
-    [lineComponents removeObjectAtIndex:0];
-    NSInteger numericReplyAsNumber = [command integerValue];
-    
-    if (numericReplyAsNumber != 0 && [[lineComponents objectAtIndex:1] hasPrefix:@":"] == NO) {
-        
-        [lineComponents removeObjectAtIndex:0];
-    }
+    NSInteger numericReplyAsNumber = IRCNumericReplyFromCommand(line.command);
     
-    NSString *recipient = [lineComponents objectAtIndex:0];
+    /* The trailing parameter is counted as the last parameter, and is the only one that may have been prefixed by a colon. */
+    NSUInteger parameterCount = line.parameterCount + (line.hasTrailing ? 1 : 0);
+    #define parameterAtIndex(x) ((x) < line.parameterCount ? line.parameters[(x)] : line.trailing)
+    #define parameterIsTrailing(x) ((x) >= line.parameterCount)
     
-    if ([lineComponents count] > 1 && messageWithoutRecipient == NO) {
-        if ([[lineComponents objectAtIndex:0] hasPrefix:@":"] == NO) {
-            [lineComponents removeObjectAtIndex:0];
-        }
+    /* Numeric replies are addressed to our own nickname first, skip it unless it is all there is. */
+    NSUInteger recipientIndex = 0;
+    if (numericReplyAsNumber != 0 && parameterCount > 1 && parameterIsTrailing(1) == NO) {
+        recipientIndex = 1;
     }
     
-    if ([recipient hasPrefix:@":"]) {
-        recipient = [recipient substringFromIndex:1];
+    NSString *recipient = @"";
+    NSString *message = @"";
+    IRCByteRange recipientRange = { "", 0 };
+    if (recipientIndex < parameterCount) {
+        recipientRange = parameterAtIndex(recipientIndex);
+        if (parameterIsTrailing(recipientIndex)) {
+            /* The recipient is only the first word of a trailing parameter */
+            const char *space = memchr(recipientRange.bytes, ' ', recipientRange.length);
+            if (space) recipientRange.length = space - recipientRange.bytes;
+        }
+        recipient = IRCStringFromByteRange(recipientRange, self.configuration);
+        
+        NSUInteger messageIndex = recipientIndex;
+        if (recipientIndex + 1 < parameterCount && messageWithoutRecipient == NO && parameterIsTrailing(recipientIndex) == NO) {
+            messageIndex++;
+        }
+        
+        /* The message is the rest of the line from the first parameter that is not the recipient. */
+        const char *messageStart = parameterAtIndex(messageIndex).bytes;
+        message = IRCStringFromByteRange((IRCByteRange){ messageStart, line.end - messageStart }, self.configuration);
+        message = [message removeIRCFormatting];
     }
     
-    NSString *message = [lineComponents componentsJoinedByString:@" "];
-    if ([message hasPrefix:@":"]) {
-        message = [message substringFromIndex:1];
-    }
+    #undef parameterAtIndex
+    #undef parameterIsTrailing
     
     /* Get the timestamp from the message or create one if it is not available. */
     NSDate* datetime = [IRCClient getTimestampFromMessageTags:tagsList];
@@ -258,7 +329,7 @@
     
     conversation = [IRCConversation fromString:recipient withClient:self];
     if (conversation == nil) {
-        if ([recipient isValidChannelName:self]) {
+        if (IRCIsValidChannelName(&_validationTable, recipientRange)) {
             IRCChannelConfiguration *configuration = [[IRCChannelConfiguration alloc] init];
             configuration.name = recipient;
             conversation = [[IRCChannel alloc] initWithConfiguration:configuration withClient:self];
@@ -291,12 +362,18 @@
         [Messages clientReceivedRecoverableErrorFromServer:messageObject];
     }
     
-    MessageType commandIndexValue = [IRCMessageIndex indexValueFromString:command];
+    MessageType commandIndexValue = [IRCMessageIndex indexValueFromBytes:line.command.bytes length:line.command.length];
     switch (commandIndexValue) {
         case PING:
             [self.connection send:[NSString stringWithFormat:@"PONG :%@", message]];
             break;
             
+        case PONG:
+            @synchronized(self.lagMonitor) {
+                [self.lagMonitor receivedPongWithToken:message];
+            }
+            break;
+            
         case ERROR:
             [self clientDidDisconnectWithError:message];
             break;
@@ -363,7 +440,7 @@
             break;
         }
         case RPL_WELCOME:
-            self.connectionRetries = NO;
+            [self.reconnectEngine connectionDidRegister];
             self.isAttemptingRegistration = NO;
 
             /* The user might have some queries open from last time. Check if any of these users
@@ -373,6 +450,9 @@
             /* At this point we will enable the flood control. */
             [self.connection enableFloodControl];
             
+            /* Start pinging the server ourselves, so we notice when the connection is gone before the system does. */
+            [self startKeepAlive];
+            
             /* This server supports the ZNC advanced playback module. We will request all messages since the
              last time we received a message. Or from the start of the ZNC logs if we don't have a time on record. */
             if (IRCv3CapabilityEnabled(self, @"znc.in/playback")) {
@@ -414,11 +494,19 @@
         case RPL_WHOREPLY:
             [Messages clientReceivedWHOReply:messageObject] ;
             break;
+            
+        case RPL_ENDOFWHO:
+            [Messages clientReceivedWHOEndReply:messageObject];
+            break;
 
         case RPL_NAMREPLY:
             [Messages clientReceivedNAMEReply:messageObject];
             break;
             
+        case RPL_ENDOFNAMES:
+            [Messages clientReceivedNAMESEndReply:messageObject];
+            break;
+            
         case RPL_LIST:
             [Messages clientReceivedLISTReply:messageObject];
             break;
@@ -542,8 +630,6 @@
         case RPL_CREATIONTIME:
         case RPL_MOTDSTART:
         case RPL_ENDOFMOTD:
-        case RPL_ENDOFNAMES:
-        case RPL_ENDOFWHO:
         case RPL_TOPICWHOTIME:
             break;
             
@@ -570,6 +656,7 @@
     /* Split the string by spaces and iterate over the result. This will give us key value pairs seperated by '=' or
      just simply keys which we will translate to booleans */
     NSArray *features = [data componentsSeparatedByString:@" "];
+    BOOL validationRulesChanged = NO;
     
     for (NSString *feature in features) {
         if ([feature hasPrefix:@":"]) {
@@ -580,11 +667,123 @@
         if ([feature rangeOfString:@"="].location != NSNotFound) {
             NSArray *components = [feature componentsSeparatedByString:@"="];
             [self.featuresSupportedByServer setObject:[components objectAtIndex:1] forKey:[components objectAtIndex:0]];
+            
+            if ([components[0] isEqualToString:@"CHANTYPES"] || [components[0] isEqualToString:@"NICKLEN"]) {
+                validationRulesChanged = YES;
+            }
         } else {
             [self.featuresSupportedByServer setObject:@YES forKey:feature];
         }
     }
     [self setUsermodePrefixes];
+    [self setCaseMappingFromServer];
+    
+    if (validationRulesChanged) {
+        [self setValidationTableFromServer];
+    }
+}
+
+/*!
+ *    @brief  Rebuild the channel name and nickname rules from the CHANTYPES and NICKLEN announced by this server.
+ */
+- (void)setValidationTableFromServer
+{
+    NSString *channelPrefixes = [IRCClient getChannelPrefixCharacters:self];
+    NSUInteger maximumNicknameLength = [[self.featuresSupportedByServer objectForKey:@"NICKLEN"] integerValue];
+    IRCBuildValidationTable(&_validationTable, [channelPrefixes UTF8String], maximumNicknameLength);
+}
+
+- (const IRCValidationTable *)validationTable
+{
+    return &_validationTable;
+}
+
+/*!
+ *    @brief  Retrieve and update the casemapping used by this server to compare nicknames and channel names.
+ */
+- (void)setCaseMappingFromServer
+{
+    /* Servers that do not announce a CASEMAPPING use rfc1459 */
+    NSString *caseMappingString = [[self featuresSupportedByServer] objectForKey:@"CASEMAPPING"];
+    IRCCaseMapping caseMapping = CASEMAPPING_RFC1459;
+    if ([caseMappingString isEqualToString:@"ascii"]) {
+        caseMapping = CASEMAPPING_ASCII;
+    } else if ([caseMappingString isEqualToString:@"strict-rfc1459"]) {
+        caseMapping = CASEMAPPING_STRICT_RFC1459;
+    }
+    
+    if (caseMapping != self.caseMapping) {
+        self.caseMapping = caseMapping;
+        [self rebuildConversationIndex];
+        for (IRCChannel *channel in self.channels) {
+            [channel rebuildUserIndex];
+        }
+    }
+}
+
+- (void)setCaseMapping:(IRCCaseMapping)caseMapping
+{
+    @synchronized(self.nameKeys) {
+        if (caseMapping == _caseMapping) {
+            return;
+        }
+        
+        /* Keys folded with the old casemapping are no longer valid */
+        _caseMapping = caseMapping;
+        [self.nameKeys removeAllObjects];
+        [self.internedNameKeys removeAllObjects];
+    }
+}
+
+- (NSString *)keyForName:(NSString *)name
+{
+    if (name == nil) return nil;
+    
+    @synchronized(self.nameKeys) {
+        [self trimNameKeysLocked];
+        return [self keyForNameLocked:name];
+    }
+}
+
+/*!
+ *    @brief  Empty the key tables once they have grown too large. Only called before looking up keys,
+ *            so the keys handed out by a single lookup always come from the same table.
+ */
+- (void)trimNameKeysLocked
+{
+    if ([self.nameKeys count] >= NAME_KEY_CACHE_LIMIT) {
+        [self.nameKeys removeAllObjects];
+        [self.internedNameKeys removeAllObjects];
+    }
+}
+
+- (NSString *)keyForNameLocked:(NSString *)name
+{
+    /* The same spelling of a name is usually seen over and over again, only fold it the first time. */
+    NSString *key = [self.nameKeys objectForKey:name];
+    if (key) {
+        return key;
+    }
+    
+    NSString *foldedName = [name stringByFoldingCaseMapping:self];
+    key = [self.internedNameKeys objectForKey:foldedName];
+    if (key == nil) {
+        key = foldedName;
+        [self.internedNameKeys setObject:key forKey:key];
+    }
+    [self.nameKeys setObject:key forKey:[name copy]];
+    return key;
+}
+
+- (BOOL)name:(NSString *)name isEqualToName:(NSString *)otherName
+{
+    if (name == nil || otherName == nil) return NO;
+    
+    /* Both keys are looked up under the same lock, so the tables can not be flushed in between and the keys can be compared by pointer. */
+    @synchronized(self.nameKeys) {
+        [self trimNameKeysLocked];
+        return [self keyForNameLocked:name] == [self keyForNameLocked:otherName];
+    }
 }
 
 /*!
@@ -633,6 +832,7 @@
 
 - (void)clientDidDisconnect {
     [self outputToConsole:@"Disconnected"];
+    [self.reconnectEngine stop];
     [self clearStatus];
     dispatch_async(dispatch_get_main_queue(), ^{
         [[NSNotificationCenter defaultCenter] postNotificationName:@"clientDidDisonnect" object:self];
@@ -644,21 +844,36 @@
 {
     [self outputToConsole:[NSString stringWithFormat:@"Disconnected: %@", error]];
     [self clearStatus];
+    
+    /* The connection may report the same failure more than once, such as an ERROR followed by the socket closing.
+     The reconnect timer is only set later on the main thread, so whether a reconnect is already pending is taken
+     from the engine, which goes into its waiting state right here. */
     if ([self.configuration automaticallyReconnect]) {
+        NSTimeInterval delay = 0;
+        @synchronized(self.reconnectEngine) {
+            if (self.reconnectEngine.state == RECONNECT_STATE_WAITING) {
+                return;
+            }
+            delay = [self.reconnectEngine connectionDidFail];
+        }
         
-        if (self.connectionRetries >= CONNECTION_RETRY_ATTEMPTS) {
+        if (delay < 0) {
             self.willReconnect = NO;
-            self.connectionRetries = 0;
             [self outputToConsole:[NSString stringWithFormat:NSLocalizedString(@"Connection attempt failed %i times. Connection aborted.",
-																			   @"Connection attempt failed {number} times. Connection aborted."), self.connectionRetries]];
+																			   @"Connection attempt failed {number} times. Connection aborted."), (int)self.reconnectEngine.failedAttempts]];
         } else {
             self.willReconnect = YES;
-            [self outputToConsole:@"Retrying in 5 seconds.."];
-            [NSTimer scheduledTimerWithTimeInterval:5.0
-                                             target:self
-                                           selector:@selector(attemptClientReconnect)
-                                           userInfo:nil
-                                            repeats:NO];
+            [self outputToConsole:[NSString stringWithFormat:@"Retrying in %.0f seconds..", delay]];
+            
+            /* We are called from the socket queue, which has no run loop to schedule the timer on. */
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [self.reconnectTimer invalidate];
+                self.reconnectTimer = [NSTimer scheduledTimerWithTimeInterval:delay
+                                                                       target:self
+                                                                     selector:@selector(attemptClientReconnect)
+                                                                     userInfo:nil
+                                                                      repeats:NO];
+            });
         }
     }
     dispatch_async(dispatch_get_main_queue(), ^{
@@ -667,17 +882,104 @@
 }
 
 /*!
- *    @brief  Incement the recorded amount of connection retries and attempt another connection.
+ *    @brief  Make the next connection attempt chosen by the reconnect engine.
  */
 - (void)attemptClientReconnect
 {
-    self.connectionRetries++;
+    [self.reconnectTimer invalidate];
+    self.reconnectTimer = nil;
     [self connect];
 }
 
+/*!
+ *    @brief  Called when the device has gained or lost its network connection. When it comes back there is no
+ *            point in waiting out the backoff, we try again right away.
+ *
+ *    @param notification The reachability notification with the new status.
+ */
+- (void)networkReachabilityDidChange:(NSNotification *)notification
+{
+    AFNetworkReachabilityStatus status = [notification.userInfo[AFNetworkingReachabilityNotificationStatusItem] integerValue];
+    if (self.reconnectTimer && (status == AFNetworkReachabilityStatusReachableViaWiFi || status == AFNetworkReachabilityStatusReachableViaWWAN)) {
+        [self attemptClientReconnect];
+    }
+}
+
+- (NSTimeInterval)lag
+{
+    @synchronized(self.lagMonitor) {
+        return self.lagMonitor.lag;
+    }
+}
+
+- (NSArray *)lagHistory
+{
+    @synchronized(self.lagMonitor) {
+        return self.lagMonitor.lagHistory;
+    }
+}
+
+/*!
+ *    @brief  Start sending PINGs on a newly registered connection.
+ */
+- (void)startKeepAlive
+{
+    @synchronized(self.lagMonitor) {
+        [self.lagMonitor start];
+    }
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self.keepAliveTimer invalidate];
+        self.keepAliveTimer = [NSTimer scheduledTimerWithTimeInterval:CONNECTION_KEEPALIVE_INTERVAL
+                                                               target:self
+                                                             selector:@selector(keepAliveTimerTick)
+                                                             userInfo:nil
+                                                              repeats:YES];
+        [self keepAliveTimerTick];
+    });
+}
+
+/*!
+ *    @brief  Stop sending PINGs, such as when the connection was closed.
+ */
+- (void)stopKeepAlive
+{
+    @synchronized(self.lagMonitor) {
+        [self.lagMonitor stop];
+    }
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self.keepAliveTimer invalidate];
+        self.keepAliveTimer = nil;
+    });
+}
+
+/*!
+ *    @brief  Called every few seconds while connected. Sends a PING when one is due, or drops the connection if the
+ *            last one was not answered in time so the reconnect logic takes over.
+ */
+- (void)keepAliveTimerTick
+{
+    NSString *token = nil;
+    BOOL pongIsOverdue = NO;
+    @synchronized(self.lagMonitor) {
+        pongIsOverdue = [self.lagMonitor pongIsOverdue];
+        if (pongIsOverdue == NO) {
+            token = [self.lagMonitor pingTokenIfDue];
+        }
+    }
+    
+    if (pongIsOverdue) {
+        [self stopKeepAlive];
+        [self.connection abortWithError:[NSString stringWithFormat:NSLocalizedString(@"Ping timeout: %d seconds", @"Ping timeout: {number} seconds"), CONNECTION_IRC_PONG_INTERVAL]];
+    } else if (token) {
+        [self.connection send:[NSString stringWithFormat:@"PING :%@", token]];
+    }
+}
+
 - (void)stopReconnectAttempts
 {
-    self.connectionRetries = CONNECTION_RETRY_ATTEMPTS;
+    [self.reconnectTimer invalidate];
+    self.reconnectTimer = nil;
+    [self.reconnectEngine stop];
     self.willReconnect = NO;
     [self disconnect];
 }
@@ -687,6 +989,7 @@
  */
 - (void)clearStatus
 {
+    [self stopKeepAlive];
     self.isConnected =                      NO;
     self.isAttemptingRegistration =         NO;
     self.isAttemptingConnection =           NO;
@@ -698,17 +1001,23 @@
     self.featuresSupportedByServer = [[NSMutableDictionary alloc] init];
     self.ircv3CapabilitiesSupportedByServer = [[NSMutableArray alloc] init];
     self.whoisRequests = [[NSMutableDictionary alloc] init];
+    [self.connection performBlock:^{
+        self.onlineNicknames = nil;
+        self.pendingISONResponses = 0;
+    }];
     [self.connection disableFloodControl];
 	self.certificate = nil;
     
     for (IRCChannel *channel in self.channels) {
-        channel.users = [[NSMutableArray alloc] init];
+        [channel removeAllUsers];
         channel.channelModes = [[NSMutableArray alloc] init];
         channel.isJoinedByUser = NO;
     }
     
-    ConversationListViewController *controller = ((AppDelegate *)[UIApplication sharedApplication].delegate).conversationsController;
-    [controller reloadClient:self];
+    dispatch_async(dispatch_get_main_queue(), ^{
+        ConversationListViewController *controller = ((AppDelegate *)[UIApplication sharedApplication].delegate).conversationsController;
+        [controller reloadClient:self];
+    });
     
     [self validateQueryStatusOnAllItems];
 }
@@ -732,18 +1041,57 @@
         for (IRCConversation *query in self.queries) {
             query.conversationPartnerIsOnline = NO;
         }
-        ConversationListViewController *controller = ((AppDelegate *)[UIApplication sharedApplication].delegate).conversationsController;
-        [controller reloadClient:self];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            ConversationListViewController *controller = ((AppDelegate *)[UIApplication sharedApplication].delegate).conversationsController;
+            [controller reloadClient:self];
+        });
         return;
     }
     
-    /* We are connected and have query items. We will generate and send an ISON command to the server to check which of these users are currently online.
-     The result of this request will be handled by the "clientReceivedISONResponse" method in the "Messages" class. */
-    NSString *requestString = @"";
-    for (IRCConversation *query in self.queries) {
-        requestString = [requestString stringByAppendingString:[NSString stringWithFormat:@"%@ ", query.name]];
-    }
-    [self.connection send:[NSString stringWithFormat:@"ISON :%@", requestString]];
+    /* We are connected and have query items. We will generate and send ISON commands to the server to check which of these users are currently online,
+     as many nicknames in a line as fit. The results of these requests will be handled by the "clientReceivedISONResponse" method in the "Messages" class. */
+    NSArray *nicknames = [self.queries valueForKey:@"name"];
+    NSArray *lines = [[IRCCommandBatcher batcherForClient:self] isonLinesForNicknames:nicknames];
+    
+    /* The replies are counted on the connection queue where they arrive. A check that is still waiting for replies
+     is left to finish, starting another one would count its late replies against the new one. */
+    [self.connection performBlock:^{
+        if (self.pendingISONResponses > 0 || lines.count == 0)
+            return;
+        
+        self.onlineNicknames = [[NSMutableArray alloc] init];
+        self.pendingISONResponses = lines.count;
+        for (NSString *line in lines) {
+            [self.connection send:line];
+        }
+        
+        /* A server that never answers one of the lines would keep every later check from starting. */
+        NSUInteger check = ++self.isonCheck;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(ISON_RESPONSE_TIMEOUT * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+            [self.connection performBlock:^{
+                if (self.isonCheck != check || self.pendingISONResponses == 0)
+                    return;
+                
+                self.onlineNicknames = nil;
+                self.pendingISONResponses = 0;
+                [self validateQueryStatusOnAllItems];
+            }];
+        });
+    }];
+}
+
+- (NSArray *)onlineNicknamesAfterISONReply:(NSArray *)nicknames
+{
+    if (self.onlineNicknames == nil)
+        return nicknames;
+    
+    [self.onlineNicknames addObjectsFromArray:nicknames];
+    if (--self.pendingISONResponses > 0)
+        return nil;
+    
+    NSArray *onlineNicknames = self.onlineNicknames;
+    self.onlineNicknames = nil;
+    return onlineNicknames;
 }
 
 + (NSString *)getChannelPrefixCharacters:(IRCClient *)client
@@ -832,6 +1180,7 @@
     
     /* Add the channel to the channel list. */
     [self.channels addObject:channel];
+    [self indexConversation:channel];
     
     return YES;
 }
@@ -846,6 +1195,7 @@
             [self.connection send:[NSString stringWithFormat:@"PART %@ :%@", [channel name], [channel.client.configuration channelDepartMessage]]];
         }
         [self.channels removeObject:channelExists];
+        [self unindexConversation:channelExists];
         
         /* Remove from configuration too */
         NSMutableArray *channels = [[NSMutableArray alloc] init];
@@ -864,15 +1214,13 @@
 - (BOOL)addQuery:(IRCConversation *)query
 {
     /* Check if the query we are trying to add already exists in order to avoid duplicates. */
-    NSUInteger i = [self.queries indexOfObjectPassingTest:^BOOL(id element,NSUInteger idx,BOOL *stop) {
-        return [[element name] isEqualToString:query.name];
-    }];
-    if (i != NSNotFound) {
+    if ([self conversationWithName:query.name] != nil) {
         return NO;
     }
     
     /* Add the query to our list. */
     [self.queries addObject:query];
+    [self indexConversation:query];
     
     /* If we are on an active connection we will make a request to check if the user
      we initiated a query with is currently online. */
@@ -892,6 +1240,7 @@
             [self.connection send:[NSString stringWithFormat:@"PRIVMSG *playback :CLEAR %@", query.name]];
         }
         [self.queries removeObjectAtIndex:indexOfObject];
+        [self unindexConversation:query];
         
         /* Remove from configuration too */
         NSMutableArray *queries = [[NSMutableArray alloc] init];
@@ -906,16 +1255,105 @@
     return NO;
 }
 
+- (void)renameQuery:(IRCConversation *)query toName:(NSString *)name
+{
+    [self unindexConversation:query];
+    query.name = name;
+    [self indexConversation:query];
+}
+
+- (IRCConversation *)conversationWithName:(NSString *)name
+{
+    NSString *key = [self keyForName:name];
+    if (key == nil) return nil;
+    
+    @synchronized(self.conversationsByName) {
+        return [self.conversationsByName objectForKey:key];
+    }
+}
+
+- (IRCChannel *)channelWithName:(NSString *)name
+{
+    IRCConversation *conversation = [self conversationWithName:name];
+    if ([conversation isKindOfClass:[IRCChannel class]]) {
+        return (IRCChannel *)conversation;
+    }
+    return nil;
+}
+
+- (IRCConversation *)conversationWithIdentifier:(NSString *)identifier
+{
+    if (identifier == nil) return nil;
+    
+    @synchronized(self.conversationsByName) {
+        return [self.conversationsByIdentifier objectForKey:identifier];
+    }
+}
+
+/*!
+ *    @brief  Add a channel or query to the lookup tables by name and by identifier.
+ *
+ *    @param conversation The channel or query to add.
+ */
+- (void)indexConversation:(IRCConversation *)conversation
+{
+    NSString *key = [self keyForName:conversation.name];
+    @synchronized(self.conversationsByName) {
+        if (key) {
+            [self.conversationsByName setObject:conversation forKey:key];
+        }
+        if (conversation.configuration.uniqueIdentifier) {
+            [self.conversationsByIdentifier setObject:conversation forKey:conversation.configuration.uniqueIdentifier];
+        }
+    }
+}
+
+/*!
+ *    @brief  Remove a channel or query from the lookup tables by name and by identifier.
+ *
+ *    @param conversation The channel or query to remove.
+ */
+- (void)unindexConversation:(IRCConversation *)conversation
+{
+    NSString *key = [self keyForName:conversation.name];
+    @synchronized(self.conversationsByName) {
+        if (key && [self.conversationsByName objectForKey:key] == conversation) {
+            [self.conversationsByName removeObjectForKey:key];
+        }
+        if (conversation.configuration.uniqueIdentifier) {
+            [self.conversationsByIdentifier removeObjectForKey:conversation.configuration.uniqueIdentifier];
+        }
+    }
+}
+
+/*!
+ *    @brief  Rebuild the lookup tables from the channel and query lists, such as after the casemapping has changed.
+ */
+- (void)rebuildConversationIndex
+{
+    @synchronized(self.conversationsByName) {
+        [self.conversationsByName removeAllObjects];
+        [self.conversationsByIdentifier removeAllObjects];
+    }
+    for (IRCConversation *conversation in [self.channels arrayByAddingObjectsFromArray:self.queries]) {
+        [self indexConversation:conversation];
+    }
+}
+
 - (void)autojoin
 {
-    /* Iterate each channel in our list which has autojoin enabled and send a join request.
+    /* Iterate each channel in our list which has autojoin enabled and join them, as many channels in a JOIN as the server allows.
      We do not need to think about sending too many requests since this is taken care of by
      our flood control. */
+    NSMutableArray *channels = [[NSMutableArray alloc] init];
     for (IRCChannel *channel in self.channels) {
         if (channel.configuration.autoJoin) {
-            [self.connection send:[NSString stringWithFormat:@"JOIN %@", channel.name]];
+            [channels addObject:channel.name];
         }
     }
+    for (NSString *line in [[IRCCommandBatcher batcherForClient:self] joinLinesForChannels:channels]) {
+        [self.connection send:line];
+    }
 }
 
 - (void)outputToConsole:(NSString *)output
@@ -932,7 +1370,9 @@
                                                             withTags:@{}
                                                             isServerMessage:YES
                                                            onClient:self];
-    [self.console addMessage:message];
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self.console addMessage:message];
+    });
 }
 
 /*!
@@ -0,0 +1,134 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+#define IRC_MAXIMUM_LINE_LENGTH         512
+#define IRC_DEFAULT_MODES_PER_LINE      3
+#define IRC_DEFAULT_USERNAME_LENGTH     10
+#define IRC_DEFAULT_HOSTNAME_LENGTH     63
+
+@class IRCClient;
+
+/*!
+ *    @brief  Builds the lines for commands that can be too long for one line or can be packed into fewer lines,
+ *            within the limits the server announced in ISUPPORT.
+ *
+ *            Every line fits in 512 bytes with its CRLF, and lines the server relays to others, such as PRIVMSG,
+ *            also leave room for the ":nick!user@host " prefix the server puts in front of them.
+ */
+@interface IRCCommandBatcher : NSObject
+
+/*!
+ *    @brief  The number of mode changes with an argument allowed in one MODE line, from MODES.
+ */
+@property (nonatomic, readonly) NSUInteger modesPerLine;
+
+/*!
+ *    @brief  The number of bytes of our own prefix as the server relays it, ":nick!user@host " included.
+ */
+@property (nonatomic, readonly) NSUInteger prefixLength;
+
+/*!
+ *    @brief  Create a batcher with the limits of the server a client is connected to.
+ *
+ *    @param client The client to get the server limits, encoding and our own hostmask from.
+ *
+ *    @return A batcher for the lines of this client.
+ */
++ (instancetype)batcherForClient:(IRCClient *)client;
+
+/*!
+ *    @brief  Create a batcher from the ISUPPORT values of a server.
+ *
+ *    @param features The ISUPPORT values of the server, as in featuresSupportedByServer.
+ *    @param nickname Our nickname.
+ *    @param username Our username as the server shows it, or nil to assume the longest one allowed.
+ *    @param hostname Our hostname as the server shows it, or nil to assume the longest one allowed.
+ *    @param encoding The encoding the lines are sent in.
+ *
+ *    @return A batcher for these limits.
+ */
+- (instancetype)initWithFeatures:(NSDictionary *)features nickname:(NSString *)nickname username:(NSString *)username hostname:(NSString *)hostname encoding:(NSStringEncoding)encoding;
+
+/*!
+ *    @brief  Get the number of targets allowed in one line of a command, from TARGMAX or MAXTARGETS.
+ *
+ *    @param command The command, such as "JOIN".
+ *
+ *    @return The number of targets, NSUIntegerMax if the server sets no limit.
+ */
+- (NSUInteger)maximumTargetsForCommand:(NSString *)command;
+
+/*!
+ *    @brief  Split a message into as many PRIVMSG or NOTICE lines as it takes. Messages are split at the last
+ *            space that fits, or between two characters when a word is too long, never inside a character.
+ *
+ *    @param command The command, PRIVMSG or NOTICE.
+ *    @param target  The nickname or channel to send the message to.
+ *    @param text    The message, a single line.
+ *    @param ctcp    A CTCP command to wrap every line in, such as "ACTION", or nil to send plain text.
+ *
+ *    @return The lines to send, without CRLF.
+ */
+- (NSArray *)linesForCommand:(NSString *)command target:(NSString *)target text:(NSString *)text ctcp:(NSString *)ctcp;
+
+/*!
+ *    @brief  Join channels with as few JOIN lines as the target limit and the line length allow.
+ *
+ *    @param channels The names of the channels to join.
+ *
+ *    @return The lines to send, without CRLF.
+ */
+- (NSArray *)joinLinesForChannels:(NSArray *)channels;
+
+/*!
+ *    @brief  Set or unset a mode with an argument for a list of arguments, such as +o for several users,
+ *            with no more changes in one line than MODES allows.
+ *
+ *    @param channel   The channel to change the modes of.
+ *    @param adding    Whether to set the mode, or unset it.
+ *    @param mode      The mode character.
+ *    @param arguments The arguments, one for every change.
+ *
+ *    @return The lines to send, without CRLF.
+ */
+- (NSArray *)modeLinesForChannel:(NSString *)channel adding:(BOOL)adding mode:(NSString *)mode arguments:(NSArray *)arguments;
+
+/*!
+ *    @brief  Ask which of a list of nicknames are online, with as few ISON lines as the line length allows.
+ *
+ *    @param nicknames The nicknames to ask for.
+ *
+ *    @return The lines to send, without CRLF.
+ */
+- (NSArray *)isonLinesForNicknames:(NSArray *)nicknames;
+
+@end
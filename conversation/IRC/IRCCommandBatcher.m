@@ -0,0 +1,237 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "IRCCommandBatcher.h"
+#import "IRCClient.h"
+#import "IRCUser.h"
+#import "NSString+Methods.h"
+
+@implementation IRCCommandBatcher {
+    NSDictionary *_features;
+    NSStringEncoding _encoding;
+}
+
++ (instancetype)batcherForClient:(IRCClient *)client
+{
+    /* Lines are measured in the encoding IRCConnection sends them in. */
+    NSStringEncoding encoding = [NSString encodingFromConfiguration:client.configuration];
+    IRCUser *user = client.currentUserOnConnection;
+    return [[IRCCommandBatcher alloc] initWithFeatures:client.featuresSupportedByServer
+                                              nickname:user.nick
+                                              username:user.username
+                                              hostname:user.hostname
+                                              encoding:encoding];
+}
+
+- (instancetype)initWithFeatures:(NSDictionary *)features nickname:(NSString *)nickname username:(NSString *)username hostname:(NSString *)hostname encoding:(NSStringEncoding)encoding
+{
+    if ((self = [super init])) {
+        _features = [features copy];
+        _encoding = encoding;
+        
+        /* MODES without a value means there is no limit, a server that does not send it at all allows 3 per RFC1459. */
+        id modes = _features[@"MODES"];
+        if ([modes isKindOfClass:NSString.class] && [modes integerValue] > 0) {
+            _modesPerLine = [modes integerValue];
+        } else if (modes) {
+            _modesPerLine = NSUIntegerMax;
+        } else {
+            _modesPerLine = IRC_DEFAULT_MODES_PER_LINE;
+        }
+        
+        /* Until the server has shown us our own hostmask we leave room for the longest one it would. */
+        NSUInteger nicknameLength = [nickname lengthOfBytesUsingEncoding:encoding];
+        NSUInteger maximumNicknameLength = [_features[@"NICKLEN"] integerValue];
+        NSUInteger usernameLength = username.length ? [username lengthOfBytesUsingEncoding:encoding] : IRC_DEFAULT_USERNAME_LENGTH;
+        NSUInteger hostnameLength = hostname.length ? [hostname lengthOfBytesUsingEncoding:encoding] : IRC_DEFAULT_HOSTNAME_LENGTH;
+        _prefixLength = MAX(nicknameLength, maximumNicknameLength) + usernameLength + hostnameLength + 4;
+        return self;
+    }
+    return nil;
+}
+
+- (NSUInteger)maximumTargetsForCommand:(NSString *)command
+{
+    /* TARGMAX=PRIVMSG:4,NOTICE:4,JOIN: with an empty value for commands without a limit. */
+    id targetLimits = _features[@"TARGMAX"];
+    if ([targetLimits isKindOfClass:NSString.class]) {
+        for (NSString *targetLimit in [targetLimits componentsSeparatedByString:@","]) {
+            NSRange separator = [targetLimit rangeOfString:@":"];
+            if (separator.location == NSNotFound)
+                continue;
+            
+            if ([[targetLimit substringToIndex:separator.location] caseInsensitiveCompare:command] == NSOrderedSame) {
+                NSInteger limit = [[targetLimit substringFromIndex:separator.location + 1] integerValue];
+                return limit > 0 ? (NSUInteger)limit : NSUIntegerMax;
+            }
+        }
+        return NSUIntegerMax;
+    }
+    
+    /* Older servers only announce MAXTARGETS, which applies to messages. */
+    id maximumTargets = _features[@"MAXTARGETS"];
+    if ([maximumTargets isKindOfClass:NSString.class] && [maximumTargets integerValue] > 0 &&
+        ([command caseInsensitiveCompare:@"PRIVMSG"] == NSOrderedSame || [command caseInsensitiveCompare:@"NOTICE"] == NSOrderedSame)) {
+        return [maximumTargets integerValue];
+    }
+    return NSUIntegerMax;
+}
+
+/*!
+ *    @brief  The bytes left for a line without its CRLF, and without our prefix if the server relays it to others.
+ */
+- (NSUInteger)lineBudgetRelayed:(BOOL)relayed
+{
+    NSUInteger budget = IRC_MAXIMUM_LINE_LENGTH - 2;
+    return relayed ? budget - MIN(_prefixLength, budget) : budget;
+}
+
+- (NSUInteger)lengthOfString:(NSString *)string
+{
+    return [string lengthOfBytesUsingEncoding:_encoding];
+}
+
+- (NSArray *)linesForCommand:(NSString *)command target:(NSString *)target text:(NSString *)text ctcp:(NSString *)ctcp
+{
+    NSString *head = [NSString stringWithFormat:@"%@ %@ :", command, target];
+    NSString *tail = @"";
+    if (ctcp) {
+        head = [head stringByAppendingFormat:@"\001%@ ", ctcp];
+        tail = @"\001";
+    }
+    
+    NSUInteger overhead = [self lengthOfString:head] + [self lengthOfString:tail];
+    NSUInteger budget = [self lineBudgetRelayed:YES];
+    if (overhead >= budget || [self lengthOfString:text] + overhead <= budget) {
+        return @[[NSString stringWithFormat:@"%@%@%@", head, text, tail]];
+    }
+    NSUInteger available = budget - overhead;
+    
+    /* Walk the text a character at a time, a character being everything that is drawn as one such as a flag or
+     an accented letter, so no line ends in the middle of a multibyte sequence. */
+    NSMutableArray *lines = [[NSMutableArray alloc] init];
+    NSUInteger length = text.length;
+    NSUInteger start = 0;
+    NSUInteger index = 0;
+    NSUInteger bytes = 0;
+    NSUInteger lastSpace = NSNotFound;
+    while (index < length) {
+        NSRange character = [text rangeOfComposedCharacterSequenceAtIndex:index];
+        NSUInteger characterLength = [self lengthOfString:[text substringWithRange:character]];
+        
+        if (bytes + characterLength > available && index > start) {
+            /* Break at the last space if there is one, the space itself is dropped. */
+            NSUInteger end = lastSpace != NSNotFound ? lastSpace : index;
+            [lines addObject:[NSString stringWithFormat:@"%@%@%@", head, [text substringWithRange:NSMakeRange(start, end - start)], tail]];
+            start = lastSpace != NSNotFound ? lastSpace + 1 : index;
+            lastSpace = NSNotFound;
+            bytes = [self lengthOfString:[text substringWithRange:NSMakeRange(start, index - start)]];
+            continue;
+        }
+        
+        if ([text characterAtIndex:index] == ' ' && index > start) {
+            lastSpace = index;
+        }
+        bytes += characterLength;
+        index = NSMaxRange(character);
+    }
+    if (start < length) {
+        [lines addObject:[NSString stringWithFormat:@"%@%@%@", head, [text substringFromIndex:start], tail]];
+    }
+    return lines;
+}
+
+/*!
+ *    @brief  Split items into groups that each fit in one line, with no more than a number of items in a group.
+ *            Every item takes its own length, the separator in front of it and a fixed number of bytes more.
+ */
+- (NSArray *)groupsOfItems:(NSArray *)items lineLength:(NSUInteger)lineLength separator:(NSString *)separator itemOverhead:(NSUInteger)itemOverhead maximumItems:(NSUInteger)maximumItems budget:(NSUInteger)budget
+{
+    NSMutableArray *groups = [[NSMutableArray alloc] init];
+    NSUInteger separatorLength = [self lengthOfString:separator];
+    
+    NSMutableArray *group = [[NSMutableArray alloc] init];
+    NSUInteger groupLength = lineLength;
+    for (NSString *item in items) {
+        NSUInteger itemLength = [self lengthOfString:item] + itemOverhead;
+        if (group.count > 0 && (group.count == maximumItems || groupLength + separatorLength + itemLength > budget)) {
+            [groups addObject:group];
+            group = [[NSMutableArray alloc] init];
+            groupLength = lineLength;
+        }
+        groupLength += group.count ? separatorLength + itemLength : itemLength;
+        [group addObject:item];
+    }
+    if (group.count > 0) {
+        [groups addObject:group];
+    }
+    return groups;
+}
+
+- (NSArray *)joinLinesForChannels:(NSArray *)channels
+{
+    NSArray *groups = [self groupsOfItems:channels lineLength:[self lengthOfString:@"JOIN "] separator:@"," itemOverhead:0
+                             maximumItems:[self maximumTargetsForCommand:@"JOIN"] budget:[self lineBudgetRelayed:NO]];
+    
+    NSMutableArray *lines = [[NSMutableArray alloc] initWithCapacity:groups.count];
+    for (NSArray *group in groups) {
+        [lines addObject:[@"JOIN " stringByAppendingString:[group componentsJoinedByString:@","]]];
+    }
+    return lines;
+}
+
+- (NSArray *)modeLinesForChannel:(NSString *)channel adding:(BOOL)adding mode:(NSString *)mode arguments:(NSArray *)arguments
+{
+    /* Every argument also adds a mode character, "+ooo a b c", and there is a space between the modes and the arguments. */
+    NSString *head = [NSString stringWithFormat:@"MODE %@ %@", channel, adding ? @"+" : @"-"];
+    NSArray *groups = [self groupsOfItems:arguments lineLength:[self lengthOfString:head] + 1 separator:@" " itemOverhead:[self lengthOfString:mode]
+                             maximumItems:self.modesPerLine budget:[self lineBudgetRelayed:YES]];
+    
+    NSMutableArray *lines = [[NSMutableArray alloc] initWithCapacity:groups.count];
+    for (NSArray *group in groups) {
+        NSString *modes = [@"" stringByPaddingToLength:group.count * mode.length withString:mode startingAtIndex:0];
+        [lines addObject:[NSString stringWithFormat:@"%@%@ %@", head, modes, [group componentsJoinedByString:@" "]]];
+    }
+    return lines;
+}
+
+- (NSArray *)isonLinesForNicknames:(NSArray *)nicknames
+{
+    NSArray *groups = [self groupsOfItems:nicknames lineLength:[self lengthOfString:@"ISON :"] separator:@" " itemOverhead:0
+                             maximumItems:NSUIntegerMax budget:[self lineBudgetRelayed:NO]];
+    
+    NSMutableArray *lines = [[NSMutableArray alloc] initWithCapacity:groups.count];
+    for (NSArray *group in groups) {
+        [lines addObject:[@"ISON :" stringByAppendingString:[group componentsJoinedByString:@" "]]];
+    }
+    return lines;
+}
+
+@end
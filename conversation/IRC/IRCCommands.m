@@ -30,6 +30,7 @@
 #import "IRCCommands.h"
 #import "IRCConnection.h"
 #import "IRCClient.h"
+#import "IRCCommandBatcher.h"
 #import "NSString+Methods.h"
 #import "ConversationListViewController.h"
 
@@ -38,12 +39,16 @@
 + (void)sendMessage:(NSString *)message toRecipient:(NSString *)recipient onClient:(IRCClient *)client
 {
     
-    /* The message may be multiple lines, we will split them by their line break and send them as inividual messages. */
+    /* The message may be multiple lines, we will split them by their line break and send them as inividual messages.
+     Lines too long for the server are split again so nothing is cut off at the end. */
+    IRCCommandBatcher *batcher = [IRCCommandBatcher batcherForClient:client];
     NSArray *lines = [message componentsSeparatedByString:@"\n"];
     for (NSString *line in lines) {
         if ([line length] > 0) {
             
-            [client.connection send:[NSString stringWithFormat:@"PRIVMSG %@ :%@", recipient, line]];
+            for (NSString *wireLine in [batcher linesForCommand:@"PRIVMSG" target:recipient text:line ctcp:nil]) {
+                [client.connection send:wireLine];
+            }
             [IRCConversation getConversationOrCreate:recipient onClient:client withCompletionHandler:^(IRCConversation *conversation) {
                 if (client.isConnected == NO) {
                     IRCMessage *messageObject = [[IRCMessage alloc] initWithMessage:@"Cannot send message (Not connected)"
@@ -104,7 +109,9 @@
 
 + (void)sendACTIONMessage:(NSString *)message toRecipient:(NSString *)recipient onClient:(IRCClient *)client
 {
-    [client.connection send:[NSString stringWithFormat:@"PRIVMSG %@ :\001ACTION %@\001", recipient, message]];
+    for (NSString *wireLine in [[IRCCommandBatcher batcherForClient:client] linesForCommand:@"PRIVMSG" target:recipient text:message ctcp:@"ACTION"]) {
+        [client.connection send:wireLine];
+    }
     [IRCConversation getConversationOrCreate:recipient onClient:client withCompletionHandler:^(IRCConversation *conversation) {
         IRCMessage *messageObj = [[IRCMessage alloc] initWithMessage:message
                                                            OfType:ET_ACTION
@@ -121,7 +128,9 @@
 
 + (void)sendNotice:(NSString *)message toRecipient:(NSString *)recipient onClient:(IRCClient *)client
 {
-    [client.connection send:[NSString stringWithFormat:@"NOTICE %@ :%@", recipient, message]];
+    for (NSString *wireLine in [[IRCCommandBatcher batcherForClient:client] linesForCommand:@"NOTICE" target:recipient text:message ctcp:nil]) {
+        [client.connection send:wireLine];
+    }
     [IRCConversation getConversationOrCreate:recipient onClient:client withCompletionHandler:^(IRCConversation *conversation) {
         IRCMessage *messageObj = [[IRCMessage alloc] initWithMessage:message
                                                            OfType:ET_NOTICE
@@ -66,7 +66,22 @@
 - (void)close;
 
 /*!
- *    @brief  Enable flood control on the socket.
+ *    @brief  Drop the connection without saying goodbye, such as when the server stopped answering,
+ *            and report it as an error so the client reconnects.
+ *
+ *    @param error A human readable reason the connection was dropped.
+ */
+- (void)abortWithError:(NSString *)error;
+
+/*!
+ *    @brief  Run a block on the queue the connection reads and parses incoming lines on.
+ *
+ *    @param block The block to run.
+ */
+- (void)performBlock:(dispatch_block_t)block;
+
+/*!
+ *    @brief  Enable flood control on the socket, pacing lines at the rates in the configuration of the client.
  */
 - (void)enableFloodControl;
 
@@ -30,20 +30,22 @@
 
 #import "IRCConnection.h"
 #import "IRCClient.h"
+#import "IRCSendQueue.h"
 
-#define floodControlInterval 2
-#define floodControlMessageLimit 4
+#define readBufferMaximumLength 65536
+#define floodControlTimerLeeway (10 * NSEC_PER_MSEC)
 
 @interface IRCConnection ()
 
 @property (nonatomic, assign) BOOL sslEnabled;
 @property (nonatomic, assign) BOOL floodControlEnabled;
 @property (nonatomic, strong) IRCClient *client;
-@property (nonatomic, strong) NSTimer *floodControlTimer;
-@property (nonatomic, strong) NSMutableArray *messageQueue;
-@property (nonatomic, assign) int messagesSentSinceLastTick;
+@property (nonatomic, strong) dispatch_source_t floodControlTimer;
+@property (nonatomic, strong) IRCSendQueue *sendQueue;
+@property (nonatomic, assign) BOOL sendScheduled;
 @property (nonatomic, strong) NSString *connectionHost;
 @property (nonatomic, assign) UInt16 connectionPort;
+@property (nonatomic, strong) NSMutableData *readBuffer;
 @end
 
 @implementation IRCConnection
@@ -58,8 +60,9 @@
         NSString *queueName = [@"conversation-client-" stringByAppendingString:self.client.configuration.uniqueIdentifier];
         queue = dispatch_queue_create([queueName UTF8String], DISPATCH_QUEUE_SERIAL);
         
-        self.messagesSentSinceLastTick = 0;
-        self.messageQueue = [[NSMutableArray alloc] init];
+        self.readBuffer = [[NSMutableData alloc] init];
+        self.sendQueue = [[IRCSendQueue alloc] initWithBurst:self.client.configuration.floodControlBurst
+                                                        rate:self.client.configuration.floodControlRate];
         self.floodControlEnabled = NO;
         self.floodControlTimer = nil;
         return self;
@@ -73,10 +76,15 @@
     NSError *err = nil;
     
     /* Initialise socket and ensure it uses our queue to operate off the UI thread */
-    socket = [[GCDAsyncSocket alloc] initWithDelegate:self delegateQueue:dispatch_get_main_queue()];
+    socket = [[GCDAsyncSocket alloc] initWithDelegate:self delegateQueue:queue];
     self.connectionHost = host;
     self.connectionPort = port;
     
+    /* Discard any partial line left over from a previous connection */
+    dispatch_async(queue, ^{
+        [self.readBuffer setLength:0];
+    });
+    
     /* Establish a TCP connection */
     if (![socket connectToHost:host onPort:port withTimeout:15.0 error:&err]) {
         [self.client outputToConsole:[NSString stringWithFormat:NSLocalizedString(@"Could not connect: %@", @"Could not connect: {Error}"), err]];
@@ -106,7 +114,7 @@
     [self.client clientDidConnect];
     
     /* The server will probably send us some initial data, let's queue up a read immediately */
-    [socket readDataToData:[GCDAsyncSocket CRLFData] withTimeout:-1 tag:1];
+    [socket readDataWithTimeout:-1 tag:1];
 }
 
 /*!
@@ -136,7 +144,9 @@
              or it is simply unsigned. Many users run small IRC users or bouncers on sunsigned certificates
              so we will present this predicament to the user and let them decide what to do. */
             IRCCertificateTrust *trustDialog = [[IRCCertificateTrust alloc] init:trust onClient:self.client];
-            [trustDialog requestTrustFromUser:completionHandler];
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [trustDialog requestTrustFromUser:completionHandler];
+            });
             break;
         }
         
@@ -159,7 +169,7 @@
 - (void)socket:(GCDAsyncSocket *)sock didWriteDataWithTag:(long)tag
 {
     if (tag == 0) {
-        [sock readDataToData:[GCDAsyncSocket CRLFData] withTimeout:-1 tag:0];
+        [sock readDataWithTimeout:-1 tag:0];
     }
     [self.client clientDidSendData];
 }
@@ -173,30 +183,51 @@
  */
 - (void)socket:(GCDAsyncSocket *)sock didReadData:(NSData *)data withTag:(long)tag
 {
-    dispatch_async(queue, ^{
-        /* While the socket is supposed to only read to the next linebreak we may at some point
-         encounter a data overflow, therefor we will manually validate the input from the socket
-         and truncate the message at any potential linebreak before passing it to the parser */
-        const char *bytes = [data bytes] + '\0';
-        int positionOfLineBreak = 0;
-        const char* positionBeforeIteration = bytes;
-        while (*bytes != '\0' && *bytes != '\n' && *bytes != '\r') {
-            bytes++;
-            positionOfLineBreak++;
+    /* The socket hands us whatever was available, which may be many lines or only part of one.
+     Queue up the next read straight away and process the whole batch, we are already on the parsing queue. */
+    [sock readDataWithTimeout:-1 tag:1];
+    
+    [self.readBuffer appendData:data];
+    [self processReadBuffer];
+}
+
+/*!
+ *    @brief  Split the read buffer into lines and pass every complete line to the parser.
+ *            A partial line at the end of the buffer is kept until the rest of it has been read.
+ */
+- (void)processReadBuffer
+{
+    char *bytes = [self.readBuffer mutableBytes];
+    char *end = bytes + [self.readBuffer length];
+    char *lineStart = bytes;
+    char *lineBreak;
+    
+    while ((lineBreak = memchr(lineStart, '\n', end - lineStart)) != NULL) {
+        /* Terminate the line in place, dropping the CR of the CRLF if there is one */
+        char *lineEnd = lineBreak;
+        if (lineEnd > lineStart && *(lineEnd - 1) == '\r') {
+            lineEnd--;
         }
-        bytes = positionBeforeIteration;
-        char* message = malloc(positionOfLineBreak +1);
-        strncpy(message, bytes, positionOfLineBreak);
-        message[positionOfLineBreak] = '\0';
+        *lineEnd = '\0';
         
-        if (message) {
-            [self.client clientDidReceiveData:message];
-        } else {
-            [self.client outputToConsole:[NSString stringWithFormat:NSLocalizedString(@"Unable to decode message: %s", @"Unable to decode message: {raw message}"), message]];
+        if (lineEnd > lineStart) {
+            @autoreleasepool {
+                [self.client clientDidReceiveData:lineStart];
+            }
         }
-        [socket readDataToData:[GCDAsyncSocket CRLFData] withTimeout:-1 tag:1];
-        free(message);
-    });
+        lineStart = lineBreak + 1;
+    }
+    
+    NSUInteger consumedLength = lineStart - bytes;
+    if (consumedLength > 0) {
+        [self.readBuffer replaceBytesInRange:NSMakeRange(0, consumedLength) withBytes:NULL length:0];
+    }
+    
+    if ([self.readBuffer length] > readBufferMaximumLength) {
+        /* No IRC line is anywhere near this long, the server is sending us garbage. */
+        [self.client outputToConsole:[NSString stringWithFormat:NSLocalizedString(@"Discarded %lu bytes of data without a line break", @"Discarded {number} bytes of data without a line break"), (unsigned long)[self.readBuffer length]]];
+        [self.readBuffer setLength:0];
+    }
 }
 
 /*!
@@ -279,7 +310,9 @@
  */
 - (void)socketDidDisconnect:(GCDAsyncSocket *)sock
 {
-    [self.messageQueue removeAllObjects];
+    @synchronized(self) {
+        [self.sendQueue removeAllLines];
+    }
     [self.client clientDidDisconnect];
 }
 
@@ -296,92 +329,123 @@
 - (void)close
 {
     if (socket) {
+        /* Write out what is still waiting, such as the QUIT sent right before closing. */
+        [self continueSending];
         [socket disconnect];
         [socket setDelegate:nil delegateQueue:NULL];
-        [self.messageQueue removeAllObjects];
+        @synchronized(self) {
+            [self.sendQueue removeAllLines];
+        }
         [self.client clientDidDisconnect];
     }
 }
 
-- (void)sendData:(NSString *)line
+- (void)abortWithError:(NSString *)error
 {
-    if ([line hasSuffix:@"\r\n"] == NO) {
-        line = [line stringByAppendingString:@"\r\n"];
-    }
-    NSLog(@">> %@", line);
-    NSData *data = [line dataUsingEncodingFromConfiguration:self.client.configuration];
-    [self writeDataToSocket:data];
+    dispatch_async(queue, ^{
+        /* The connection may have been closed in the meantime. */
+        if (socket == nil || socket.delegate == nil) {
+            return;
+        }
+        
+        /* Detach first so the socket does not report the disconnect a second time. */
+        [socket setDelegate:nil delegateQueue:NULL];
+        [socket disconnect];
+        @synchronized(self) {
+            [self.sendQueue removeAllLines];
+        }
+        [self.client clientDidDisconnectWithError:error];
+    });
+}
+
+- (void)performBlock:(dispatch_block_t)block
+{
+    dispatch_async(queue, block);
 }
 
 - (void)enableFloodControl {
-    /* Enable flood control. This will ensure no more than 5 messages every 2 seconds get sent over the connection.
+    /* Enable flood control. Lines are paced by the token bucket of the send queue with the rates configured for this network.
      This is necessary because many servers employ anti attack measures that will forcibly disconnect us if we overwhelm
      the server with messages. */
-    self.floodControlEnabled = YES;
-    dispatch_async(dispatch_get_main_queue(), ^{
-        self.floodControlTimer = [NSTimer scheduledTimerWithTimeInterval:floodControlInterval
-                                                                  target:self
-                                                                selector:@selector(floodTimerTick)
-                                                                userInfo:nil
-                                                                 repeats:YES];
-    });
+    @synchronized(self) {
+        if (self.floodControlEnabled)
+            return;
+        
+        self.floodControlEnabled = YES;
+        [self.sendQueue setBurst:self.client.configuration.floodControlBurst rate:self.client.configuration.floodControlRate];
+        [self.sendQueue setThrottled:YES atTime:[[NSProcessInfo processInfo] systemUptime]];
+        
+        /* The timer only fires when a line is waiting for tokens, it is set again every time the queue runs dry. */
+        __weak IRCConnection *weakSelf = self;
+        self.floodControlTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+        dispatch_source_set_timer(self.floodControlTimer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, floodControlTimerLeeway);
+        dispatch_source_set_event_handler(self.floodControlTimer, ^{
+            [weakSelf continueSending];
+        });
+        dispatch_resume(self.floodControlTimer);
+    }
 }
 
 - (void)disableFloodControl {
     /* The flood control is no longer necessary. We will disable it.*/
-    self.floodControlEnabled = NO;
-    [self.floodControlTimer invalidate];
-    self.floodControlTimer = nil;
-}
-
-/*!
- *    @brief  This method is activated by a time every two seconds. It will clear the message limit and send any messages currently backlogged until the limit is reached again.
- */
-- (void)floodTimerTick {
-    self.messagesSentSinceLastTick = 0;
-    BOOL messageQueueIsSendingItems = YES;
-    while (messageQueueIsSendingItems) {
-        messageQueueIsSendingItems = [self continueSending];
+    @synchronized(self) {
+        self.floodControlEnabled = NO;
+        [self.sendQueue setThrottled:NO atTime:[[NSProcessInfo processInfo] systemUptime]];
+        
+        if (self.floodControlTimer) {
+            dispatch_source_cancel(self.floodControlTimer);
+            self.floodControlTimer = nil;
+        }
     }
+    [self continueSending];
 }
 
 - (void)send:(NSString *)line
 {
-    /* Add the outgoing message to our queue and attempt to send it immediately. 
-     If the flood control is on a backlog it might not be sent right away. */
-    [self.messageQueue addObject:line];
-    [self continueSending];
+    /* Add the outgoing message to the end of the queue and attempt to send it immediately.
+     If the flood control is on a backlog it might not be sent right away, unless it is urgent. */
+    if ([line hasSuffix:@"\r\n"] == NO) {
+        line = [line stringByAppendingString:@"\r\n"];
+    }
+    NSLog(@">> %@", line);
+    NSData *data = [line dataUsingEncodingFromConfiguration:self.client.configuration];
+    
+    @synchronized(self) {
+        [self.sendQueue addLine:data withPriority:[IRCSendQueue priorityOfLine:line]];
+        
+        /* Lines sent together, such as the autojoin and connect commands after RPL_WELCOME, go out in one write
+         once the connection queue gets to them instead of one write and TLS record each. */
+        if (self.sendScheduled)
+            return;
+        self.sendScheduled = YES;
+    }
+    dispatch_async(queue, ^{
+        [self continueSending];
+    });
 }
 
 /*!
- *    @brief  Attempt to send any eventual messages in the queue to the socket.
- *
- *    @return A boolean indicating whether we were successful in sending data or we have reached the message limit.
+ *    @brief  Send every line the flood control allows right now in a single write, and set the timer for when the next one may go.
  */
-- (BOOL)continueSending
+- (void)continueSending
 {
     @synchronized(self) {
-        /* There are no messages in the queue, we have nothing to do. */
-        if ([self.messageQueue count] == 0 || self.client.isConnected == NO) {
-            return NO;
+        self.sendScheduled = NO;
+        
+        /* Lines queued while we are not connected wait for the connection. */
+        if (self.client.isConnected == NO) {
+            return;
         }
         
-        if (self.floodControlEnabled) {
-            /* We have reached the message limit, messages are now backloged until the next flood control tick.
-             We wil llet the queue handler know it must stop attempting a send until the next tick. */
-            if (self.messagesSentSinceLastTick > floodControlMessageLimit) {
-                return NO;
-            }
-            
-            self.messagesSentSinceLastTick++;
+        NSTimeInterval delay = 0;
+        NSData *data = [self.sendQueue linesAtTime:[[NSProcessInfo processInfo] systemUptime] delay:&delay];
+        if (data) {
+            [self writeDataToSocket:data];
         }
         
-        /* We are under the message limit and are free to send the message to the server.
-         We will send it to the socket and clear it from the queue immediately. */
-        NSString *queueItemToSend = [self.messageQueue objectAtIndex:0];
-        [self sendData:queueItemToSend];
-        [self.messageQueue removeObjectAtIndex:0];
-        return YES;
+        if (delay > 0 && self.floodControlTimer) {
+            dispatch_source_set_timer(self.floodControlTimer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), DISPATCH_TIME_FOREVER, floodControlTimerLeeway);
+        }
     }
 }
 
@@ -46,12 +46,36 @@
 @property (assign) BOOL isHighlighted;
 @property (nonatomic) ConversationContentView *contentView;
 
+/*!
+ *    @brief  Indicates whether the database may still have older messages of this conversation than the transcript shows.
+ */
+@property (nonatomic, readonly) BOOL hasMoreHistory;
+
 - (instancetype)initWithConfiguration:(IRCChannelConfiguration *)config withClient:(IRCClient *)client;
 
 + (void) getConversationOrCreate:(NSString *)name onClient:(IRCClient *)client withCompletionHandler:(void (^)(IRCConversation *))completionHandler;
 + (id) fromString:(NSString *)name withClient:(IRCClient *)client;
 - (void)addPreviewMessage:(NSAttributedString *)message;
 - (void)addMessageToConversation:(id)object;
+
+/*!
+ *    @brief  Load the most recent page of history into the transcript, the first time the conversation is shown.
+ */
+- (void)loadHistory;
+
+/*!
+ *    @brief  Load the page of history before the oldest message in the transcript.
+ */
+- (void)loadEarlierHistory;
+
+/*!
+ *    @brief  Check if a message mentions the nickname we are using on the client of this conversation.
+ *
+ *    @param string The message to check.
+ *
+ *    @return Boolean indicating whether the message mentions us.
+ */
+- (BOOL)stringMentionsCurrentUser:(NSString *)string;
 - (void)clear;
 
 @end
@@ -31,12 +31,20 @@
 #import "IRCConversation.h"
 #import "IRCClient.h"
 #import "IRCMessage.h"
+#import "IRCMessageStore.h"
+#import "IRCMentionMatcher.h"
 #import "ConsoleViewController.h"
 #import <FCModel/FCModel.h>
 
 #define MAX_BUFFER_COUNT 3000
+#define HISTORY_PAGE_SIZE 100
 
-@implementation IRCConversation
+@implementation IRCConversation {
+    BOOL _hasLoadedHistory;
+    BOOL _isLoadingHistory;
+    NSTimeInterval _historyCursorTimestamp;
+    int64_t _historyCursorId;
+}
 
 - (instancetype)initWithConfiguration:(IRCChannelConfiguration *)config withClient:(IRCClient *)client
 {
@@ -46,7 +54,8 @@
         self.conversationPartnerIsOnline = NO;
         self.hasNewMessages = NO;
         self.configuration = config;
-        self.unreadCount = 0;        
+        self.unreadCount = 0;
+        _hasMoreHistory = YES;
         return self;
     }
     return nil;
@@ -83,23 +92,8 @@
 
 + (id) fromString:(NSString *)name withClient:(IRCClient *)client
 {
-    /* Return an existing channel or query in this client */
-    if ([name isValidChannelName:client]) {
-        /* If this is a channel iterate through the list of channels and return one that matches */
-        for (IRCChannel *channel in [client channels]) {
-            if ([channel.name isEqualToStringCaseInsensitive:name])
-                return channel;
-        }
-    } else if ([name isValidNickname:client]) {
-        /* If this is a query, iterate through the list of queries and return one that matches*/
-        for (IRCConversation *query in [client queries]) {
-            if ([query.name isEqualToStringCaseInsensitive:name]) {
-                return query;
-            }
-        }
-    }
-    /* We couldn't find any object that matches, we will return nil. */
-    return nil;
+    /* Return an existing channel or query in this client, or nil if there is no object that matches. */
+    return [client conversationWithName:name];
 }
 
 
@@ -132,8 +126,13 @@
         return;
     }
     
-    if (message.isConversationHistory == NO)
+    if (message.isConversationHistory == NO) {
         self.hasNewMessages = YES;
+        
+        /* Channel list replies are only shown in the list, they do not belong to the history. */
+        if (message.messageType != ET_LIST && message.messageType != ET_LISTEND)
+            [[IRCMessageStore sharedStore] appendMessage:message];
+    }
     
     /* Notify all parts of the application listening for messages that a new message has been added. */
     dispatch_async(dispatch_get_main_queue(), ^{
@@ -143,13 +142,66 @@
 
 }
 
-- (void)clear
+- (void)loadHistory
 {
-    dispatch_async(dispatch_get_main_queue(), ^{
-        NSArray *messages = [IRCMessage instancesWhere:@"conversation = ?", self.configuration.uniqueIdentifier];
+    if (_hasLoadedHistory)
+        return;
+    _hasLoadedHistory = YES;
+    
+    /* Anything already in the transcript arrived this session and is newer than what is stored from before. */
+    IRCMessage *oldestMessage = [_contentView.messages firstObject];
+    _historyCursorTimestamp = oldestMessage ? [oldestMessage.timestamp timeIntervalSince1970] : DBL_MAX;
+    _historyCursorId = 0;
+    
+    [self loadEarlierHistory];
+}
+
+- (void)loadEarlierHistory
+{
+    if (_hasLoadedHistory == NO || _isLoadingHistory || _hasMoreHistory == NO || [FCModel databaseIsOpen] == NO)
+        return;
+    
+    /* This is called from layoutSubviews while scrolling, so the page is read on the snapshot queue and inserted once it is there. */
+    _isLoadingHistory = YES;
+    [[IRCMessageStore sharedStore] messagesInConversation:self.configuration.uniqueIdentifier
+                                                   before:_historyCursorTimestamp
+                                                messageId:_historyCursorId
+                                                    limit:HISTORY_PAGE_SIZE
+                                               completion:^(NSArray *messages) {
+        /* A conversation that was cleared while the page was being read does not get it back. */
+        BOOL wasCleared = _hasMoreHistory == NO;
+        if (messages.count < HISTORY_PAGE_SIZE)
+            _hasMoreHistory = NO;
+        if (wasCleared || messages.count == 0 || _contentView == nil) {
+            _isLoadingHistory = NO;
+            return;
+        }
+        
+        IRCMessage *oldestMessage = [messages lastObject];
+        _historyCursorTimestamp = [oldestMessage.timestamp timeIntervalSince1970];
+        _historyCursorId = oldestMessage.id;
+        
         for (IRCMessage *message in messages) {
-            [message delete];
+            message.conversation = self;
+            message.client = self.client;
         }
+        
+        [_contentView insertHistoricMessages:messages.reverseObjectEnumerator.allObjects completion:^{
+            _isLoadingHistory = NO;
+        }];
+    }];
+}
+
+- (BOOL)stringMentionsCurrentUser:(NSString *)string
+{
+    return [IRCMentionMatcher string:string mentionsNickname:self.client.currentUserOnConnection.nick onClient:self.client];
+}
+
+- (void)clear
+{
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [[IRCMessageStore sharedStore] removeMessagesInConversation:self.configuration.uniqueIdentifier];
+        _hasMoreHistory = NO;
         [self.contentView clear];
     });
     
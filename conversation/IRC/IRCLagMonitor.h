@@ -0,0 +1,125 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+#define IRC_LAG_HISTORY_LENGTH  30
+
+/*!
+ *    @brief  A clock returning seconds that only move forward, such as the system uptime.
+ */
+typedef NSTimeInterval (^IRCLagClock)(void);
+
+/*!
+ *    @brief  Keeps a connection alive and measures its lag with our own PINGs.
+ *
+ *            Every PING carries the time it was sent, the PONG for it gives the round trip time. A PING that goes
+ *            unanswered for too long means the connection is dead even if the socket still looks open, which happens
+ *            on mobile networks where the other end disappears without closing the connection.
+ *
+ *            The monitor only keeps state and does not send anything itself. It is not thread safe.
+ */
+@interface IRCLagMonitor : NSObject
+
+/*!
+ *    @brief  The seconds between two PINGs.
+ */
+@property (nonatomic, readonly) NSTimeInterval pingInterval;
+
+/*!
+ *    @brief  The seconds a PING may go unanswered before the connection is considered dead.
+ */
+@property (nonatomic, readonly) NSTimeInterval pongTimeout;
+
+/*!
+ *    @brief  The round trip time of the last answered PING, or a negative number if none has been answered yet.
+ */
+@property (nonatomic, readonly) NSTimeInterval lag;
+
+/*!
+ *    @brief  The round trip times of the recently answered PINGs as NSNumber objects, oldest first.
+ */
+@property (nonatomic, readonly) NSArray *lagHistory;
+
+/*!
+ *    @brief  Create a monitor using the system uptime.
+ *
+ *    @param pingInterval The seconds between two PINGs.
+ *    @param pongTimeout  The seconds a PING may go unanswered.
+ *
+ *    @return A monitor that is not running.
+ */
+- (instancetype)initWithPingInterval:(NSTimeInterval)pingInterval pongTimeout:(NSTimeInterval)pongTimeout;
+
+/*!
+ *    @brief  Create a monitor with its own clock.
+ *
+ *    @param pingInterval The seconds between two PINGs.
+ *    @param pongTimeout  The seconds a PING may go unanswered.
+ *    @param clock        The clock to measure time with.
+ *
+ *    @return A monitor that is not running.
+ */
+- (instancetype)initWithPingInterval:(NSTimeInterval)pingInterval pongTimeout:(NSTimeInterval)pongTimeout clock:(IRCLagClock)clock;
+
+/*!
+ *    @brief  Start monitoring a new connection. The first PING is due right away and the lag history is cleared.
+ */
+- (void)start;
+
+/*!
+ *    @brief  Stop monitoring, such as when the connection was closed.
+ */
+- (void)stop;
+
+/*!
+ *    @brief  Get the token of the next PING if one is due, and remember when it was sent.
+ *
+ *    @return The token to send with the PING, or nil if no PING is due.
+ */
+- (NSString *)pingTokenIfDue;
+
+/*!
+ *    @brief  Handle a PONG from the server.
+ *
+ *    @param token The token the server sent back.
+ *
+ *    @return Boolean indicating whether this answered our outstanding PING.
+ */
+- (BOOL)receivedPongWithToken:(NSString *)token;
+
+/*!
+ *    @brief  Check if our outstanding PING has gone unanswered for longer than the timeout.
+ *
+ *    @return Boolean indicating whether the connection should be considered dead.
+ */
+- (BOOL)pongIsOverdue;
+
+@end
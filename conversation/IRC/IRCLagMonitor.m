@@ -0,0 +1,116 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "IRCLagMonitor.h"
+
+#define IRC_LAG_TOKEN_PREFIX    @"conversation-"
+
+@implementation IRCLagMonitor {
+    IRCLagClock _clock;
+    NSMutableArray *_lagHistory;
+    NSString *_outstandingToken;
+    NSTimeInterval _pingSent;
+    BOOL _running;
+}
+
+- (instancetype)initWithPingInterval:(NSTimeInterval)pingInterval pongTimeout:(NSTimeInterval)pongTimeout
+{
+    return [self initWithPingInterval:pingInterval pongTimeout:pongTimeout clock:^NSTimeInterval{
+        return [[NSProcessInfo processInfo] systemUptime];
+    }];
+}
+
+- (instancetype)initWithPingInterval:(NSTimeInterval)pingInterval pongTimeout:(NSTimeInterval)pongTimeout clock:(IRCLagClock)clock
+{
+    if ((self = [super init])) {
+        _pingInterval = pingInterval;
+        _pongTimeout = pongTimeout;
+        _clock = [clock copy];
+        _lagHistory = [[NSMutableArray alloc] initWithCapacity:IRC_LAG_HISTORY_LENGTH];
+        _lag = -1;
+        return self;
+    }
+    return nil;
+}
+
+- (NSArray *)lagHistory
+{
+    return [_lagHistory copy];
+}
+
+- (void)start
+{
+    _running = YES;
+    _outstandingToken = nil;
+    _pingSent = -DBL_MAX;
+    _lag = -1;
+    [_lagHistory removeAllObjects];
+}
+
+- (void)stop
+{
+    _running = NO;
+    _outstandingToken = nil;
+}
+
+- (NSString *)pingTokenIfDue
+{
+    NSTimeInterval now = _clock();
+    if (_running == NO || _outstandingToken || now - _pingSent < _pingInterval)
+        return nil;
+    
+    /* The token is the time we sent it in milliseconds, so every PING has its own. */
+    _pingSent = now;
+    _outstandingToken = [NSString stringWithFormat:@"%@%lld", IRC_LAG_TOKEN_PREFIX, (long long)(now * 1000)];
+    return _outstandingToken;
+}
+
+- (BOOL)receivedPongWithToken:(NSString *)token
+{
+    /* PONGs for the PINGs of a previous connection, or ones the user sent, are not ours to measure. */
+    if (_outstandingToken == nil || [token isEqualToString:_outstandingToken] == NO)
+        return NO;
+    
+    _outstandingToken = nil;
+    _lag = _clock() - _pingSent;
+    
+    if (_lagHistory.count == IRC_LAG_HISTORY_LENGTH) {
+        [_lagHistory removeObjectAtIndex:0];
+    }
+    [_lagHistory addObject:@(_lag)];
+    return YES;
+}
+
+- (BOOL)pongIsOverdue
+{
+    return _running && _outstandingToken && _clock() - _pingSent >= _pongTimeout;
+}
+
+@end
@@ -0,0 +1,101 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class IRCClient;
+
+/*!
+ *    @brief  Finds every mention of a set of nicknames in a message with a single pass over the message,
+ *            using an Aho-Corasick automaton over the casemapped nicknames of a channel.
+ */
+@interface IRCMentionMatcher : NSObject
+
+/*!
+ *    @brief  Create an empty matcher.
+ *
+ *    @param client The client whose casemapping is used to compare messages against the nicknames.
+ *
+ *    @return A matcher without any nicknames.
+ */
+- (instancetype)initWithClient:(IRCClient *)client;
+
+/*!
+ *    @brief  Add a nickname to the matcher. A nickname can be added more than once and has to be removed as many times.
+ *
+ *    @param key The nickname, already folded with keyForName:.
+ */
+- (void)addNicknameKey:(NSString *)key;
+
+/*!
+ *    @brief  Remove a nickname from the matcher.
+ *
+ *    @param key The nickname, already folded with keyForName:.
+ */
+- (void)removeNicknameKey:(NSString *)key;
+
+/*!
+ *    @brief  Replace all nicknames in the matcher at once.
+ *
+ *    @param keys The nicknames, already folded with keyForName:.
+ */
+- (void)setNicknameKeys:(NSArray *)keys;
+
+/*!
+ *    @brief  Find all mentions of the nicknames in a message. A mention has to be surrounded by characters that are not letters.
+ *
+ *    @param string The message to search.
+ *
+ *    @return An array of NSValue ranges of each mention in the message.
+ */
+- (NSArray *)rangesOfMentionsInString:(NSString *)string;
+
+/*!
+ *    @brief  Check if a message mentions a specific nickname.
+ *
+ *    @param string The message to search.
+ *    @param key    The nickname, already folded with keyForName:. It does not have to be one of the nicknames in the matcher.
+ *
+ *    @return Boolean indicating whether the message mentions the nickname.
+ */
+- (BOOL)string:(NSString *)string mentionsNicknameKey:(NSString *)key;
+
+/*!
+ *    @brief  Check if a message mentions a nickname, without building a matcher.
+ *
+ *    @param string   The message to search.
+ *    @param nickname The nickname to look for.
+ *    @param client   The client whose casemapping is used to compare the message against the nickname.
+ *
+ *    @return Boolean indicating whether the message mentions the nickname.
+ */
++ (BOOL)string:(NSString *)string mentionsNickname:(NSString *)nickname onClient:(IRCClient *)client;
+
+@end
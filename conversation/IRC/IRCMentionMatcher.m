@@ -0,0 +1,345 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "IRCMentionMatcher.h"
+#import "IRCClient.h"
+
+#define MENTION_MATCHER_ROOT_TABLE_SIZE     128
+#define MENTION_MATCHER_STACK_BUFFER_SIZE   512
+
+/* A node in the trie of nicknames. Node 0 is the root, so 0 doubles as "no node" for links to children. */
+typedef struct {
+    unichar character;
+    uint16_t depth;
+    uint32_t firstChild;
+    uint32_t nextSibling;
+    uint32_t failure;
+    uint32_t dictionaryLink;
+    uint32_t patternCount;
+} IRCMentionNode;
+
+@interface IRCMentionMatcher ()
+
+@property (nonatomic, weak) IRCClient *client;
+@property (nonatomic, strong) NSCountedSet *keys;
+@property (nonatomic, assign) NSUInteger keyCharacterCount;
+@property (nonatomic, assign) BOOL linksNeedUpdate;
+
+@end
+
+@implementation IRCMentionMatcher
+{
+    IRCMentionNode *_nodes;
+    uint32_t _nodeCount;
+    uint32_t _nodeCapacity;
+    uint32_t _rootChildren[MENTION_MATCHER_ROOT_TABLE_SIZE];
+}
+
+static NSCharacterSet *letterCharacterSet;
+
++ (void)initialize
+{
+    if (self == [IRCMentionMatcher class]) {
+        letterCharacterSet = [NSCharacterSet letterCharacterSet];
+    }
+}
+
+- (instancetype)initWithClient:(IRCClient *)client
+{
+    if ((self = [super init])) {
+        self.client = client;
+        self.keys = [[NSCountedSet alloc] init];
+        [self resetTrie];
+        return self;
+    }
+    return nil;
+}
+
+- (void)dealloc
+{
+    free(_nodes);
+}
+
+- (void)resetTrie
+{
+    free(_nodes);
+    _nodeCapacity = 64;
+    _nodes = calloc(_nodeCapacity, sizeof(IRCMentionNode));
+    _nodeCount = 1;
+    memset(_rootChildren, 0, sizeof(_rootChildren));
+    self.keyCharacterCount = 0;
+    self.linksNeedUpdate = NO;
+}
+
+static inline uint32_t IRCMentionChild(IRCMentionNode *nodes, const uint32_t *rootChildren, uint32_t node, unichar character)
+{
+    if (node == 0 && character < MENTION_MATCHER_ROOT_TABLE_SIZE) {
+        return rootChildren[character];
+    }
+    for (uint32_t child = nodes[node].firstChild; child != 0; child = nodes[child].nextSibling) {
+        if (nodes[child].character == character) {
+            return child;
+        }
+    }
+    return 0;
+}
+
+/*!
+ *    @brief  Find the node at the end of a key, optionally creating the path to it.
+ *
+ *    @return The node, or 0 if it does not exist and was not created.
+ */
+- (uint32_t)nodeForKey:(NSString *)key create:(BOOL)create
+{
+    NSUInteger length = [key length];
+    if (length == 0 || length > UINT16_MAX) {
+        return 0;
+    }
+    
+    uint32_t node = 0;
+    for (NSUInteger i = 0; i < length; i++) {
+        unichar character = [key characterAtIndex:i];
+        uint32_t child = IRCMentionChild(_nodes, _rootChildren, node, character);
+        if (child == 0) {
+            if (create == NO) {
+                return 0;
+            }
+            if (_nodeCount == _nodeCapacity) {
+                _nodeCapacity *= 2;
+                _nodes = realloc(_nodes, _nodeCapacity * sizeof(IRCMentionNode));
+            }
+            child = _nodeCount++;
+            _nodes[child] = (IRCMentionNode){ .character = character, .depth = (uint16_t)(i + 1), .nextSibling = _nodes[node].firstChild };
+            _nodes[node].firstChild = child;
+            if (node == 0 && character < MENTION_MATCHER_ROOT_TABLE_SIZE) {
+                _rootChildren[character] = child;
+            }
+            /* A new node changes the failure links of the nodes below the ones that now lead to it */
+            self.linksNeedUpdate = YES;
+        }
+        node = child;
+    }
+    return node;
+}
+
+- (void)addNicknameKey:(NSString *)key
+{
+    if ([key length] == 0) return;
+    
+    @synchronized(self) {
+        [self.keys addObject:key];
+        uint32_t node = [self nodeForKey:key create:YES];
+        if (node != 0) {
+            if (_nodes[node].patternCount == 0) {
+                self.linksNeedUpdate = YES;
+            }
+            _nodes[node].patternCount++;
+            self.keyCharacterCount += [key length];
+        }
+    }
+}
+
+- (void)removeNicknameKey:(NSString *)key
+{
+    if ([key length] == 0) return;
+    
+    @synchronized(self) {
+        if ([self.keys countForObject:key] == 0) {
+            return;
+        }
+        [self.keys removeObject:key];
+        
+        uint32_t node = [self nodeForKey:key create:NO];
+        if (node != 0 && _nodes[node].patternCount > 0) {
+            _nodes[node].patternCount--;
+            self.keyCharacterCount -= [key length];
+            if (_nodes[node].patternCount == 0) {
+                self.linksNeedUpdate = YES;
+            }
+        }
+        
+        /* Nodes of removed nicknames are left in the trie, start over once they make up most of it. */
+        if (_nodeCount > 64 && _nodeCount > self.keyCharacterCount * 2) {
+            [self rebuildTrie];
+        }
+    }
+}
+
+- (void)setNicknameKeys:(NSArray *)keys
+{
+    @synchronized(self) {
+        self.keys = [[NSCountedSet alloc] initWithArray:keys];
+        [self rebuildTrie];
+    }
+}
+
+- (void)rebuildTrie
+{
+    [self resetTrie];
+    for (NSString *key in self.keys) {
+        uint32_t node = [self nodeForKey:key create:YES];
+        if (node != 0) {
+            NSUInteger count = [self.keys countForObject:key];
+            _nodes[node].patternCount += count;
+            self.keyCharacterCount += [key length] * count;
+        }
+    }
+    self.linksNeedUpdate = YES;
+}
+
+/*!
+ *    @brief  Compute the failure and dictionary links of every node with a breadth first walk of the trie.
+ *            Changes to the nicknames only update the trie, the links are brought up to date before the next search.
+ */
+- (void)updateLinks
+{
+    uint32_t *queue = malloc(_nodeCount * sizeof(uint32_t));
+    uint32_t head = 0, tail = 0;
+    
+    _nodes[0].failure = 0;
+    _nodes[0].dictionaryLink = 0;
+    for (uint32_t child = _nodes[0].firstChild; child != 0; child = _nodes[child].nextSibling) {
+        _nodes[child].failure = 0;
+        _nodes[child].dictionaryLink = 0;
+        queue[tail++] = child;
+    }
+    
+    while (head < tail) {
+        uint32_t node = queue[head++];
+        for (uint32_t child = _nodes[node].firstChild; child != 0; child = _nodes[child].nextSibling) {
+            unichar character = _nodes[child].character;
+            uint32_t failure = _nodes[node].failure;
+            uint32_t next;
+            while ((next = IRCMentionChild(_nodes, _rootChildren, failure, character)) == 0 && failure != 0) {
+                failure = _nodes[failure].failure;
+            }
+            _nodes[child].failure = next;
+            _nodes[child].dictionaryLink = _nodes[next].patternCount > 0 ? next : _nodes[next].dictionaryLink;
+            queue[tail++] = child;
+        }
+    }
+    
+    free(queue);
+    self.linksNeedUpdate = NO;
+}
+
+static inline BOOL IRCIsWordBoundary(const unichar *characters, NSUInteger length, NSInteger index)
+{
+    return (index < 0 || index >= (NSInteger)length || [letterCharacterSet characterIsMember:characters[index]] == NO);
+}
+
+/*!
+ *    @brief  Run the automaton over a message and call a block for every mention.
+ *
+ *    @param string The message to search.
+ *    @param block  Called with the range of each mention and the node of the nickname it matched. Return NO to stop searching.
+ */
+- (void)enumerateMentionsInString:(NSString *)string usingBlock:(BOOL (^)(NSRange range, uint32_t node))block
+{
+    NSUInteger length = [string length];
+    if (length == 0) return;
+    
+    unichar stackBuffer[MENTION_MATCHER_STACK_BUFFER_SIZE];
+    unichar *characters = length <= MENTION_MATCHER_STACK_BUFFER_SIZE ? stackBuffer : malloc(length * sizeof(unichar));
+    [string getCharacters:characters range:NSMakeRange(0, length)];
+    
+    IRCCaseMapping caseMapping = self.client ? self.client.caseMapping : CASEMAPPING_RFC1459;
+    
+    @synchronized(self) {
+        if (self.linksNeedUpdate) {
+            [self updateLinks];
+        }
+        
+        uint32_t state = 0;
+        BOOL stop = NO;
+        for (NSUInteger i = 0; i < length && stop == NO; i++) {
+            unichar character = IRCFoldCharacter(characters[i], caseMapping);
+            uint32_t next;
+            while ((next = IRCMentionChild(_nodes, _rootChildren, state, character)) == 0 && state != 0) {
+                state = _nodes[state].failure;
+            }
+            state = next;
+            
+            uint32_t match = _nodes[state].patternCount > 0 ? state : _nodes[state].dictionaryLink;
+            while (match != 0 && stop == NO) {
+                NSUInteger matchLength = _nodes[match].depth;
+                NSUInteger location = i + 1 - matchLength;
+                if (IRCIsWordBoundary(characters, length, (NSInteger)location - 1) && IRCIsWordBoundary(characters, length, i + 1)) {
+                    stop = (block(NSMakeRange(location, matchLength), match) == NO);
+                }
+                match = _nodes[match].dictionaryLink;
+            }
+        }
+    }
+    
+    if (characters != stackBuffer) {
+        free(characters);
+    }
+}
+
+- (NSArray *)rangesOfMentionsInString:(NSString *)string
+{
+    NSMutableArray *ranges = [[NSMutableArray alloc] init];
+    [self enumerateMentionsInString:string usingBlock:^BOOL(NSRange range, uint32_t node) {
+        [ranges addObject:[NSValue valueWithRange:range]];
+        return YES;
+    }];
+    return ranges;
+}
+
+- (BOOL)string:(NSString *)string mentionsNicknameKey:(NSString *)key
+{
+    /* Held across the search, so the trie can not be rebuilt between finding the node and matching against it */
+    @synchronized(self) {
+        uint32_t node = [self nodeForKey:key create:NO];
+        if (node == 0 || _nodes[node].patternCount == 0) {
+            /* Not a nickname in this channel, such as our own before the userlist has been received */
+            return [IRCMentionMatcher string:string mentionsNickname:key onClient:self.client];
+        }
+        
+        __block BOOL mentioned = NO;
+        [self enumerateMentionsInString:string usingBlock:^BOOL(NSRange range, uint32_t matchedNode) {
+            mentioned = (matchedNode == node);
+            return mentioned == NO;
+        }];
+        return mentioned;
+    }
+}
+
++ (BOOL)string:(NSString *)string mentionsNickname:(NSString *)nickname onClient:(IRCClient *)client
+{
+    if ([nickname length] == 0) return NO;
+    
+    IRCMentionMatcher *matcher = [[IRCMentionMatcher alloc] initWithClient:client];
+    [matcher addNicknameKey:[nickname stringByFoldingCaseMapping:client]];
+    return [[matcher rangesOfMentionsInString:string] count] > 0;
+}
+
+@end
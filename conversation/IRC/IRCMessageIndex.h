@@ -32,178 +32,192 @@
 
 @interface IRCMessageIndex : NSObject
 
+/* The commands and numeric replies known to the parser, in the order of the MessageType enum.
+ Both the enum and the lookup tables in IRCMessageIndex.m are generated from these lists, so a new entry only needs to be added here. */
+#define IRC_COMMAND_TYPES(X)                \
+    X(PING,           "PING")               \
+    X(PONG,           "PONG")               \
+    X(ERROR,          "ERROR")              \
+    X(AUTHENTICATE,   "AUTHENTICATE")       \
+    X(CAP,            "CAP")                \
+    X(PRIVMSG,        "PRIVMSG")            \
+    X(NOTICE,         "NOTICE")             \
+    X(JOIN,           "JOIN")               \
+    X(PART,           "PART")               \
+    X(QUIT,           "QUIT")               \
+    X(TOPIC,          "TOPIC")              \
+    X(KICK,           "KICK")               \
+    X(MODE,           "MODE")               \
+    X(NICK,           "NICK")               \
+    X(SQUIT,          "SQUIT")              \
+    X(AWAY,           "AWAY")               \
+    X(INVITE,         "INVITE")             \
+    X(CONVERSATION,   "CONVERSATION")
+
+#define IRC_NUMERIC_TYPES(X)                \
+    X(RPL_WELCOME,            1)            \
+    X(RPL_YOURHOST,           2)            \
+    X(RPL_CREATED,            3)            \
+    X(RPL_MYINFO,             4)            \
+    X(RPL_ISUPPORT,           5)            \
+    X(RPL_TRACELINK,          200)          \
+    X(RPL_TRACECONNECTING,    201)          \
+    X(RPL_TRACEHANDSHAKE,     202)          \
+    X(RPL_TRACEUNKNOWN,       203)          \
+    X(RPL_TRACEOPERATOR,      204)          \
+    X(RPL_TRACEUSER,          205)          \
+    X(RPL_TRACESERVER,        206)          \
+    X(RPL_TRACESERVICE,       207)          \
+    X(RPL_TRACENEWTYPE,       208)          \
+    X(RPL_TRACECLASS,         209)          \
+    X(RPL_TRACERECONNECT,     210)          \
+    X(RPL_STATSLINKINFO,      211)          \
+    X(RPL_STATSCOMMANDS,      212)          \
+    X(RPL_ENDOFSTATS,         219)          \
+    X(RPL_UMODEIS,            221)          \
+    X(RPL_SERVLIST,           234)          \
+    X(RPL_SERVLISTEND,        235)          \
+    X(RPL_STATSUPTIME,        242)          \
+    X(RPL_STATSOLINE,         243)          \
+    X(RPL_LUSERCLIENT,        251)          \
+    X(RPL_LUSEROP,            252)          \
+    X(RPL_LUSERUNKNOWN,       253)          \
+    X(RPL_LUSERCHANNELS,      254)          \
+    X(RPL_LUSERME,            255)          \
+    X(RPL_ADMINME,            256)          \
+    X(RPL_ADMINLOC1,          257)          \
+    X(RPL_ADMINLOC2,          258)          \
+    X(RPL_ADMINEMAIL,         259)          \
+    X(RPL_TRACELOG,           261)          \
+    X(RPL_TRACEEND,           262)          \
+    X(RPL_TRYAGAIN,           263)          \
+    X(RPL_AWAY,               301)          \
+    X(RPL_USERHOST,           302)          \
+    X(RPL_ISON,               303)          \
+    X(RPL_UNAWAY,             305)          \
+    X(RPL_NOWAWAY,            306)          \
+    X(RPL_WHOISUSER,          311)          \
+    X(RPL_WHOISSERVER,        312)          \
+    X(RPL_WHOISOPERATOR,      313)          \
+    X(RPL_WHOWASUSER,         314)          \
+    X(RPL_ENDOFWHO,           315)          \
+    X(RPL_WHOISIDLE,          317)          \
+    X(RPL_ENDOFWHOIS,         318)          \
+    X(RPL_WHOISCHANNELS,      319)          \
+    X(RPL_LIST,               322)          \
+    X(RPL_LISTEND,            323)          \
+    X(RPL_CHANNELMODEIS,      324)          \
+    X(RPL_UNIQOPIS,           325)          \
+    X(RPL_CREATIONTIME,       329)          \
+    X(RPL_WHOISACCOUNT,       330)          \
+    X(RPL_NOTOPIC,            331)          \
+    X(RPL_TOPIC,              332)          \
+    X(RPL_TOPICWHOTIME,       333)          \
+    X(RPL_INVITING,           341)          \
+    X(RPL_INVITELIST,         346)          \
+    X(RPL_ENDOFINVITELIST,    347)          \
+    X(RPL_EXCEPTLIST,         348)          \
+    X(RPL_ENDOFEXCEPTLIST,    349)          \
+    X(RPL_VERSION,            351)          \
+    X(RPL_WHOREPLY,           352)          \
+    X(RPL_NAMREPLY,           353)          \
+    X(RPL_LINKS,              364)          \
+    X(RPL_ENDOFLINKS,         365)          \
+    X(RPL_ENDOFNAMES,         366)          \
+    X(RPL_BANLIST,            367)          \
+    X(RPL_ENDOFBANLIST,       368)          \
+    X(RPL_ENDOFWHOWAS,        369)          \
+    X(RPL_INFO,               371)          \
+    X(RPL_MOTD,               372)          \
+    X(RPL_ENDOFINFO,          374)          \
+    X(RPL_MOTDSTART,          375)          \
+    X(RPL_ENDOFMOTD,          376)          \
+    X(RPL_YOUREOPER,          381)          \
+    X(RPL_REHASHING,          382)          \
+    X(RPL_YOURESERVICE,       383)          \
+    X(RPL_TIME,               391)          \
+    X(RPL_USERSSTART,         392)          \
+    X(RPL_USERS,              393)          \
+    X(RPL_ENDOFUSERS,         394)          \
+    X(RPL_NOUSERS,            395)          \
+    X(ERR_NOSUCHNICK,         401)          \
+    X(ERR_NOSUCHSERVER,       402)          \
+    X(ERR_NOSUCHCHANNEL,      403)          \
+    X(ERR_CANNOTSENDTOCHAN,   404)          \
+    X(ERR_TOOMANYCHANNELS,    405)          \
+    X(ERR_WASNOSUCHNICK,      406)          \
+    X(ERR_TOOMANYTARGETS,     407)          \
+    X(ERR_NOSUCHSERVICE,      408)          \
+    X(ERR_NOORIGIN,           409)          \
+    X(ERR_NORECIPIENT,        411)          \
+    X(ERR_NOTEXTTOSEND,       412)          \
+    X(ERR_NOTOPLEVEL,         413)          \
+    X(ERR_WILDTOPLEVEL,       415)          \
+    X(ERR_UNKNOWNCOMMAND,     421)          \
+    X(ERR_NOMOTD,             422)          \
+    X(ERR_NOADMININFO,        423)          \
+    X(ERR_FILEERROR,          424)          \
+    X(ERR_NONICKNAMEGIVEN,    431)          \
+    X(ERR_ERRONEUSNICKNAME,   432)          \
+    X(ERR_NICKNAMEINUSE,      433)          \
+    X(ERR_NICKCOLLISION,      436)          \
+    X(ERR_UNAVAILRESOURCE,    437)          \
+    X(ERR_USERNOTINCHANNEL,   441)          \
+    X(ERR_NOTONCHANNEL,       442)          \
+    X(ERR_USERONCHANNEL,      443)          \
+    X(ERR_NOLOGIN,            444)          \
+    X(ERR_SUMMONDISABLED,     445)          \
+    X(ERR_USERSDISABLED,      446)          \
+    X(ERR_NOTREGISTERED,      451)          \
+    X(ERR_NEEDMOREPARAMS,     461)          \
+    X(ERR_ALREADYREGISTRED,   462)          \
+    X(ERR_NOPERMFORHOST,      463)          \
+    X(ERR_PASSWDMISMATCH,     464)          \
+    X(ERR_YOUREBANNEDCREEP,   465)          \
+    X(ERR_YOUWILLBEBANNED,    466)          \
+    X(ERR_KEYSET,             467)          \
+    X(ERR_CHANNELISFULL,      471)          \
+    X(ERR_UNKNOWNMODE,        472)          \
+    X(ERR_INVITEONLYCHAN,     473)          \
+    X(ERR_BANNEDFROMCHAN,     474)          \
+    X(ERR_BADCHANNELKEY,      475)          \
+    X(ERR_BADCHANMASK,        476)          \
+    X(ERR_NOCHANMODES,        477)          \
+    X(ERR_BANLISTFULL,        478)          \
+    X(ERR_NOPRIVILEGES,       481)          \
+    X(ERR_CHANOPRIVSNEEDED,   482)          \
+    X(ERR_CANTKILLSERVER,     483)          \
+    X(ERR_RESTRICTED,         484)          \
+    X(ERR_UNIQOPPRIVSNEEDED,  485)          \
+    X(ERR_NOOPERHOST,         491)          \
+    X(ERR_UMODEUNKNOWNFLAG,   501)          \
+    X(ERR_USERSDONTMATCH,     502)          \
+    X(RPL_WHOISSECURE,        671)          \
+    X(RPL_LOGGEDIN,           900)          \
+    X(RPL_LOGGEDOUT,          901)          \
+    X(ERR_NICKLOCKED,         902)          \
+    X(RPL_SASLSUCCESS,        903)          \
+    X(ERR_SASLFAIL,           904)          \
+    X(ERR_SASLTOOLONG,        905)          \
+    X(ERR_SASLABORTED,        906)          \
+    X(ERR_SASLALREADY,        907)          \
+    X(RPL_SASLMECHS,          908)
+
+#define IRC_CAP_TYPES(X)                    \
+    X(CAP_LS,         "LS")                 \
+    X(CAP_ACK,        "ACK")                \
+    X(CAP_NAK,        "NAK")                \
+    X(CAP_CLEAR,      "CLEAR")
+
+#define IRC_MESSAGE_TYPE_ENUM(type, value) type,
+
 typedef NS_ENUM(NSUInteger, CapMessageType) {
-    CAP_LS,
-    CAP_ACK,
-    CAP_NAK,
-    CAP_CLEAR
+    IRC_CAP_TYPES(IRC_MESSAGE_TYPE_ENUM)
 };
 
 typedef NS_ENUM(NSUInteger, MessageType) {
-    PING,
-    ERROR,
-    AUTHENTICATE,
-    CAP,
-    PRIVMSG,
-    NOTICE,
-    JOIN,
-    PART,
-    QUIT,
-    TOPIC,
-    KICK,
-    MODE,
-    NICK,
-    SQUIT,
-    AWAY,
-    INVITE,
-    CONVERSATION,
-    RPL_WELCOME,            /* 001 */
-    RPL_YOURHOST,           /* 002 */
-    RPL_CREATED,            /* 003 */
-    RPL_MYINFO,             /* 004 */
-    RPL_ISUPPORT,           /* 005 */
-    RPL_TRACELINK,          /* 200 */
-    RPL_TRACECONNECTING,    /* 201 */
-    RPL_TRACEHANDSHAKE,     /* 202 */
-    RPL_TRACEUNKNOWN,       /* 203 */
-    RPL_TRACEOPERATOR,      /* 204 */
-    RPL_TRACEUSER,          /* 205 */
-    RPL_TRACESERVER,        /* 206 */
-    RPL_TRACESERVICE,       /* 207 */
-    RPL_TRACENEWTYPE,       /* 208 */
-    RPL_TRACECLASS,         /* 209 */
-    RPL_TRACERECONNECT,     /* 210 */
-    RPL_STATSLINKINFO,      /* 211 */
-    RPL_STATSCOMMANDS,      /* 212 */
-    RPL_ENDOFSTATS,         /* 219 */
-    RPL_UMODEIS,            /* 221 */
-    RPL_SERVLIST,           /* 234 */
-    RPL_SERVLISTEND,        /* 235 */
-    RPL_STATSUPTIME,        /* 242 */
-    RPL_STATSOLINE,         /* 243 */
-    RPL_LUSERCLIENT,        /* 251 */
-    RPL_LUSEROP,            /* 252 */
-    RPL_LUSERUNKNOWN,       /* 253 */
-    RPL_LUSERCHANNELS,      /* 254 */
-    RPL_LUSERME,            /* 255 */
-    RPL_ADMINME,            /* 256 */
-    RPL_ADMINLOC1,          /* 257 */
-    RPL_ADMINLOC2,          /* 258 */
-    RPL_ADMINEMAIL,         /* 259 */
-    RPL_TRACELOG,           /* 261 */
-    RPL_TRACEEND,           /* 262 */
-    RPL_TRYAGAIN,           /* 263 */
-    RPL_AWAY,               /* 301 */
-    RPL_USERHOST,           /* 302 */
-    RPL_ISON,               /* 303 */
-    RPL_UNAWAY,             /* 305 */
-    RPL_NOWAWAY,            /* 306 */
-    RPL_WHOISUSER,          /* 311 */
-    RPL_WHOISSERVER,        /* 312 */
-    RPL_WHOISOPERATOR,      /* 313 */
-    RPL_WHOWASUSER,         /* 314 */
-    RPL_ENDOFWHO,           /* 315 */
-    RPL_WHOISIDLE,          /* 317 */
-    RPL_ENDOFWHOIS,         /* 318 */
-    RPL_WHOISCHANNELS,      /* 319 */
-    RPL_LIST,               /* 322 */
-    RPL_LISTEND,            /* 323 */
-    RPL_CHANNELMODEIS,      /* 324 */
-    RPL_UNIQOPIS,           /* 325 */
-    RPL_CREATIONTIME,       /* 329 */
-    RPL_WHOISACCOUNT,       /* 330 */
-    RPL_NOTOPIC,            /* 331 */
-    RPL_TOPIC,              /* 332 */
-    RPL_TOPICWHOTIME,       /* 333 */
-    RPL_INVITING,           /* 341 */
-    RPL_INVITELIST,         /* 346 */
-    RPL_ENDOFINVITELIST,    /* 347 */
-    RPL_EXCEPTLIST,         /* 348 */
-    RPL_ENDOFEXCEPTLIST,    /* 349 */
-    RPL_VERSION,            /* 351 */
-    RPL_WHOREPLY,           /* 352 */
-    RPL_NAMREPLY,           /* 353 */
-    RPL_LINKS,              /* 364 */
-    RPL_ENDOFLINKS,         /* 365 */
-    RPL_ENDOFNAMES,         /* 366 */
-    RPL_BANLIST,            /* 367 */
-    RPL_ENDOFBANLIST,       /* 368 */
-    RPL_ENDOFWHOWAS,        /* 369 */
-    RPL_INFO,               /* 371 */
-    RPL_MOTD,               /* 372 */
-    RPL_ENDOFINFO,          /* 374 */
-    RPL_MOTDSTART,          /* 375 */
-    RPL_ENDOFMOTD,          /* 376 */
-    RPL_YOUREOPER,          /* 381 */
-    RPL_REHASHING,          /* 382 */
-    RPL_YOURESERVICE,       /* 383 */
-    RPL_TIME,               /* 391 */
-    RPL_USERSSTART,         /* 392 */
-    RPL_USERS,              /* 393 */
-    RPL_ENDOFUSERS,         /* 394 */
-    RPL_NOUSERS,            /* 395 */
-    ERR_NOSUCHNICK,         /* 401 */
-    ERR_NOSUCHSERVER,       /* 402 */
-    ERR_NOSUCHCHANNEL,      /* 403 */
-    ERR_CANNOTSENDTOCHAN,   /* 404 */
-    ERR_TOOMANYCHANNELS,    /* 405 */
-    ERR_WASNOSUCHNICK,      /* 406 */
-    ERR_TOOMANYTARGETS,     /* 407 */
-    ERR_NOSUCHSERVICE,      /* 408 */
-    ERR_NOORIGIN,           /* 409 */
-    ERR_NORECIPIENT,        /* 411 */
-    ERR_NOTEXTTOSEND,       /* 412 */
-    ERR_NOTOPLEVEL,         /* 413 */
-    ERR_WILDTOPLEVEL,       /* 415 */
-    ERR_UNKNOWNCOMMAND,     /* 421 */
-    ERR_NOMOTD,             /* 422 */
-    ERR_NOADMININFO,        /* 423 */
-    ERR_FILEERROR,          /* 424 */
-    ERR_NONICKNAMEGIVEN,    /* 431 */
-    ERR_ERRONEUSNICKNAME,   /* 432 */
-    ERR_NICKNAMEINUSE,      /* 433 */
-    ERR_NICKCOLLISION,      /* 436 */
-    ERR_UNAVAILRESOURCE,    /* 437 */
-    ERR_USERNOTINCHANNEL,   /* 441 */
-    ERR_NOTONCHANNEL,       /* 442 */
-    ERR_USERONCHANNEL,      /* 443 */
-    ERR_NOLOGIN,            /* 444 */
-    ERR_SUMMONDISABLED,     /* 445 */
-    ERR_USERSDISABLED,      /* 446 */
-    ERR_NOTREGISTERED,      /* 451 */
-    ERR_NEEDMOREPARAMS,     /* 461 */
-    ERR_ALREADYREGISTRED,   /* 462 */
-    ERR_NOPERMFORHOST,      /* 463 */
-    ERR_PASSWDMISMATCH,     /* 464 */
-    ERR_YOUREBANNEDCREEP,   /* 465 */
-    ERR_YOUWILLBEBANNED,    /* 466 */
-    ERR_KEYSET,             /* 467 */
-    ERR_CHANNELISFULL,      /* 471 */
-    ERR_UNKNOWNMODE,        /* 472 */
-    ERR_INVITEONLYCHAN,     /* 473 */
-    ERR_BANNEDFROMCHAN,     /* 474 */
-    ERR_BADCHANNELKEY,      /* 475 */
-    ERR_BADCHANMASK,        /* 476 */
-    ERR_NOCHANMODES,        /* 477 */
-    ERR_BANLISTFULL,        /* 478 */
-    ERR_NOPRIVILEGES,       /* 481 */
-    ERR_CHANOPRIVSNEEDED,   /* 482 */
-    ERR_CANTKILLSERVER,     /* 483 */
-    ERR_RESTRICTED,         /* 484 */
-    ERR_UNIQOPPRIVSNEEDED,  /* 485 */
-    ERR_NOOPERHOST,         /* 491 */
-    ERR_UMODEUNKNOWNFLAG,   /* 501 */
-    ERR_USERSDONTMATCH,     /* 502 */
-    RPL_WHOISSECURE,        /* 671 */
-    RPL_LOGGEDIN,           /* 900 */
-    RPL_LOGGEDOUT,          /* 901 */
-    ERR_NICKLOCKED,         /* 902 */
-    RPL_SASLSUCCESS,        /* 903 */
-    ERR_SASLFAIL,           /* 904 */
-    ERR_SASLTOOLONG,        /* 905 */
-    ERR_SASLABORTED,        /* 906 */
-    ERR_SASLALREADY,        /* 907 */
-    RPL_SASLMECHS           /* 908 */
+    IRC_COMMAND_TYPES(IRC_MESSAGE_TYPE_ENUM)
+    IRC_NUMERIC_TYPES(IRC_MESSAGE_TYPE_ENUM)
 };
 
 /*!
@@ -215,6 +229,16 @@ typedef NS_ENUM(NSUInteger, MessageType) {
  */
 + (NSUInteger)indexValueFromString:(NSString *)key;
 
+/*!
+ *    @brief  Retrieve a MessageType enum from the raw bytes of a command.
+ *
+ *    @param bytes  The bytes of the command as received from the server.
+ *    @param length The length of the command in bytes.
+ *
+ *    @return A MessageType enumerated value, or NSNotFound if the command is not known.
+ */
++ (NSUInteger)indexValueFromBytes:(const char *)bytes length:(NSUInteger)length;
+
 /*!
  *    @brief  Retrive a CapMessageType enum from a string.
  *
@@ -30,202 +30,111 @@
 
 #import "IRCMessageIndex.h"
 
-@implementation IRCMessageIndex
+#define IRCCommandHashTableSize 64
 
-static NSArray *IRCMessageIndexReference = nil;
+typedef struct {
+    const char *command;
+    size_t length;
+    NSUInteger type;
+} IRCCommandIndexEntry;
 
-+ (NSUInteger)indexValueFromString:(NSString *)key
+#define IRC_COMMAND_INDEX_ENTRY(type, command) { command, sizeof(command) - 1, type },
+
+static const IRCCommandIndexEntry IRCCommandIndex[] = {
+    IRC_COMMAND_TYPES(IRC_COMMAND_INDEX_ENTRY)
+};
+
+static const IRCCommandIndexEntry IRCCapabilityCommandIndex[] = {
+    IRC_CAP_TYPES(IRC_COMMAND_INDEX_ENTRY)
+};
+
+/* Numeric replies are decoded straight into this table, which is filled in at compile time. Values are offset by one so
+ that an empty slot can be told apart from the first entry of the enum. */
+#define IRC_NUMERIC_INDEX_ENTRY(type, numeric) [numeric] = type + 1,
+
+static const uint16_t IRCNumericIndex[1000] = {
+    IRC_NUMERIC_TYPES(IRC_NUMERIC_INDEX_ENTRY)
+};
+
+/* Open addressing tables of offsets into the command indexes above, keyed by a case insensitive hash of the command. */
+static uint8_t IRCCommandHashTable[IRCCommandHashTableSize];
+static uint8_t IRCCapabilityCommandHashTable[IRCCommandHashTableSize];
+
+static inline NSUInteger IRCCommandHash(const char *bytes, size_t length)
 {
-    /* Converts a string into its appropriate MessageType enum value by using its correlated position in the messageIndex array for the IRC parser.
-     It is important that elements are in the same order in MessageType and messageIndex or the parser will start activating the wrong commands. */
-    return [[IRCMessageIndex messageIndex] indexOfObject:key];
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t) toupper((unsigned char) bytes[i]);
+        hash *= 16777619u;
+    }
+    return hash & (IRCCommandHashTableSize - 1);
 }
 
-+ (NSUInteger)capIndexValueFromString:(NSString *)key
+static void IRCBuildCommandHashTable(const IRCCommandIndexEntry *index, NSUInteger count, uint8_t *table)
+{
+    for (NSUInteger i = 0; i < count; i++) {
+        NSUInteger slot = IRCCommandHash(index[i].command, index[i].length);
+        while (table[slot] != 0) {
+            slot = (slot + 1) & (IRCCommandHashTableSize - 1);
+        }
+        table[slot] = i + 1;
+    }
+}
+
+static NSUInteger IRCLookupCommand(const IRCCommandIndexEntry *index, const uint8_t *table, const char *bytes, size_t length)
 {
-    /* Converts a string into its appropriate CapMessageType using its correlated position in the IRCV3capabilityCommandIndex array.
-     As with messageIndex these must be in the correct order to function. */
-    return [[IRCMessageIndex IRCV3capabilityCommandIndex] indexOfObject:key];
+    NSUInteger slot = IRCCommandHash(bytes, length);
+    while (table[slot] != 0) {
+        const IRCCommandIndexEntry *entry = &index[table[slot] - 1];
+        if (entry->length == length && strncasecmp(entry->command, bytes, length) == 0) {
+            return entry->type;
+        }
+        slot = (slot + 1) & (IRCCommandHashTableSize - 1);
+    }
+    return NSNotFound;
 }
 
-+ (NSArray *)IRCV3capabilityCommandIndex
+static void IRCBuildCommandHashTables(void)
 {
-    return @[
-        @"LS",
-        @"ACK",
-        @"NAK",
-        @"CLEAR"
-    ];
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        IRCBuildCommandHashTable(IRCCommandIndex, sizeof(IRCCommandIndex) / sizeof(IRCCommandIndex[0]), IRCCommandHashTable);
+        IRCBuildCommandHashTable(IRCCapabilityCommandIndex, sizeof(IRCCapabilityCommandIndex) / sizeof(IRCCapabilityCommandIndex[0]), IRCCapabilityCommandHashTable);
+    });
 }
 
-+ (NSArray *)messageIndex
+@implementation IRCMessageIndex
+
++ (NSUInteger)indexValueFromString:(NSString *)key
+{
+    if (key == nil) return NSNotFound;
+    
+    const char *bytes = [key UTF8String];
+    return [IRCMessageIndex indexValueFromBytes:bytes length:strlen(bytes)];
+}
+
++ (NSUInteger)indexValueFromBytes:(const char *)bytes length:(NSUInteger)length
+{
+    /* Converts a command into its appropriate MessageType enum value. Numeric replies are decoded directly,
+     everything else is looked up in a hash table generated from the same list as the enum. */
+    #define isNumericDigit(x) ((x) >= '0' && (x) <= '9')
+    if (length == 3 && isNumericDigit(bytes[0]) && isNumericDigit(bytes[1]) && isNumericDigit(bytes[2])) {
+        uint16_t value = IRCNumericIndex[(bytes[0] - '0') * 100 + (bytes[1] - '0') * 10 + (bytes[2] - '0')];
+        return value ? value - 1 : NSNotFound;
+    }
+    
+    IRCBuildCommandHashTables();
+    return IRCLookupCommand(IRCCommandIndex, IRCCommandHashTable, bytes, length);
+}
+
++ (NSUInteger)capIndexValueFromString:(NSString *)key
 {
-   return @[
-        @"PING",
-        @"ERROR",
-        @"AUTHENTICATE",
-        @"CAP",
-        @"PRIVMSG",
-        @"NOTICE",
-        @"JOIN",
-        @"PART",
-        @"QUIT",
-        @"TOPIC",
-        @"KICK",
-        @"MODE",
-        @"NICK",
-        @"SQUIT",
-        @"AWAY",
-        @"INVITE",
-        @"CONVERSATION",
-        @"001",
-        @"002",
-        @"003",
-        @"004",
-        @"005",
-        @"200",
-        @"201",
-        @"202",
-        @"203",
-        @"204",
-        @"205",
-        @"206",
-        @"207",
-        @"208",
-        @"209",
-        @"210",
-        @"211",
-        @"212",
-        @"219",
-        @"221",
-        @"234",
-        @"235",
-        @"242",
-        @"243",
-        @"251",
-        @"252",
-        @"253",
-        @"254",
-        @"255",
-        @"256",
-        @"257",
-        @"258",
-        @"259",
-        @"261",
-        @"262",
-        @"263",
-        @"301",
-        @"302",
-        @"303",
-        @"305",
-        @"306",
-        @"311",
-        @"312",
-        @"313",
-        @"314",
-        @"315",
-        @"317",
-        @"318",
-        @"319",
-        @"322",
-        @"323",
-        @"324",
-        @"325",
-        @"329",
-        @"330",
-        @"331",
-        @"332",
-        @"333",
-        @"341",
-        @"346",
-        @"347",
-        @"348",
-        @"349",
-        @"351",
-        @"352",
-        @"353",
-        @"364",
-        @"365",
-        @"366",
-        @"367",
-        @"368",
-        @"369",
-        @"371",
-        @"372",
-        @"374",
-        @"375",
-        @"376",
-        @"381",
-        @"382",
-        @"383",
-        @"391",
-        @"392",
-        @"393",
-        @"394",
-        @"395",
-        @"401",
-        @"402",
-        @"403",
-        @"404",
-        @"405",
-        @"406",
-        @"407",
-        @"408",
-        @"409",
-        @"411",
-        @"412",
-        @"413",
-        @"415",
-        @"421",
-        @"422",
-        @"423",
-        @"424",
-        @"431",
-        @"432",
-        @"433",
-        @"436",
-        @"437",
-        @"441",
-        @"442",
-        @"443",
-        @"444",
-        @"445",
-        @"446",
-        @"451",
-        @"461",
-        @"462",
-        @"463",
-        @"464",
-        @"465",
-        @"466",
-        @"567",
-        @"471",
-        @"472",
-        @"473",
-        @"474",
-        @"475",
-        @"476",
-        @"477",
-        @"478",
-        @"481",
-        @"482",
-        @"483",
-        @"484",
-        @"485",
-        @"491",
-        @"501",
-        @"502",
-        @"671",
-        @"900",
-        @"901",
-        @"902",
-        @"903",
-        @"904",
-        @"905",
-        @"906",
-        @"907",
-        @"908"
-    ];
+    if (key == nil) return NSNotFound;
+    
+    const char *bytes = [key UTF8String];
+    
+    IRCBuildCommandHashTables();
+    return IRCLookupCommand(IRCCapabilityCommandIndex, IRCCapabilityCommandHashTable, bytes, strlen(bytes));
 }
 
 @end
@@ -0,0 +1,98 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+#import "IRCConnectionConfiguration.h"
+
+#define IRC_PARSER_MAX_PARAMETERS 15
+
+/*!
+ *    @brief  A range of bytes inside of the raw line buffer received from the server.
+ */
+typedef struct {
+    const char *bytes;
+    size_t length;
+} IRCByteRange;
+
+/*!
+ *    @brief  The components of a single IRC line as byte ranges into the original buffer.
+ *            Nothing is copied, the ranges are only valid for as long as the buffer they were parsed from.
+ */
+typedef struct {
+    IRCByteRange tags;
+    IRCByteRange prefix;
+    IRCByteRange command;
+    IRCByteRange parameters[IRC_PARSER_MAX_PARAMETERS];
+    NSUInteger parameterCount;
+    IRCByteRange trailing;
+    BOOL hasTrailing;
+    const char *end;
+} IRCParsedLine;
+
+/*!
+ *    @brief  Split a raw IRC line into its tags, prefix, command, middle parameters and trailing parameter.
+ *
+ *    @param line   The raw bytes of the line, without the terminating CRLF.
+ *    @param length The length of the line in bytes.
+ *    @param result The structure to fill with the ranges of each component.
+ *
+ *    @return Boolean indicating whether the line contained a command.
+ */
+BOOL IRCParseLine(const char *line, size_t length, IRCParsedLine *result);
+
+/*!
+ *    @brief  Get the numeric value of a three digit reply code.
+ *
+ *    @param command The command range of a parsed line.
+ *
+ *    @return The numeric reply code, or 0 if the command is not a numeric.
+ */
+NSInteger IRCNumericReplyFromCommand(IRCByteRange command);
+
+/*!
+ *    @brief  Create a string from a byte range, using the encoding of the connection.
+ *
+ *    @param range         The range to create the string from.
+ *    @param configuration The configuration of the connection the data was received on.
+ *
+ *    @return A string with the contents of the range.
+ */
+NSString * IRCStringFromByteRange(IRCByteRange range, IRCConnectionConfiguration *configuration);
+
+/*!
+ *    @brief  Parse the IRCv3 message tags of a line into a dictionary.
+ *            Tags without a value are given a default value of "1".
+ *
+ *    @param tags          The tags range of a parsed line.
+ *    @param configuration The configuration of the connection the data was received on.
+ *
+ *    @return A dictionary of the tags sent with the message.
+ */
+NSMutableDictionary * IRCDictionaryFromTagsRange(IRCByteRange tags, IRCConnectionConfiguration *configuration);
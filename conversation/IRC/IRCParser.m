@@ -0,0 +1,134 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "IRCParser.h"
+#import "NSString+Methods.h"
+
+static inline const char * IRCSkipSpaces(const char *position, const char *end)
+{
+    while (position < end && *position == ' ') position++;
+    return position;
+}
+
+static inline const char * IRCFindSpace(const char *position, const char *end)
+{
+    const char *space = memchr(position, ' ', end - position);
+    return space ? space : end;
+}
+
+BOOL IRCParseLine(const char *line, size_t length, IRCParsedLine *result)
+{
+    memset(result, 0, sizeof(IRCParsedLine));
+    
+    const char *position = line;
+    const char *end = line + length;
+    result->end = end;
+    
+    if (position < end && *position == '@') {
+        /* This message starts with a message tag ( http://ircv3.atheme.org/specification/message-tags-3.2 ) */
+        const char *tagsEnd = IRCFindSpace(position, end);
+        result->tags = (IRCByteRange){ position + 1, tagsEnd - position - 1 };
+        position = IRCSkipSpaces(tagsEnd, end);
+    }
+    
+    if (position < end && *position == ':') {
+        const char *prefixEnd = IRCFindSpace(position, end);
+        result->prefix = (IRCByteRange){ position + 1, prefixEnd - position - 1 };
+        position = IRCSkipSpaces(prefixEnd, end);
+    }
+    
+    const char *commandEnd = IRCFindSpace(position, end);
+    result->command = (IRCByteRange){ position, commandEnd - position };
+    position = IRCSkipSpaces(commandEnd, end);
+    
+    while (position < end) {
+        if (*position == ':' || result->parameterCount == IRC_PARSER_MAX_PARAMETERS - 1) {
+            /* Everything after a colon, or after the last allowed middle parameter, is a single trailing parameter. */
+            if (*position == ':') position++;
+            result->trailing = (IRCByteRange){ position, end - position };
+            result->hasTrailing = YES;
+            break;
+        }
+        
+        const char *parameterEnd = IRCFindSpace(position, end);
+        result->parameters[result->parameterCount++] = (IRCByteRange){ position, parameterEnd - position };
+        position = IRCSkipSpaces(parameterEnd, end);
+    }
+    
+    return result->command.length > 0;
+}
+
+NSInteger IRCNumericReplyFromCommand(IRCByteRange command)
+{
+    if (command.length != 3) return 0;
+    
+    NSInteger numeric = 0;
+    for (size_t i = 0; i < 3; i++) {
+        char c = command.bytes[i];
+        if (c < '0' || c > '9') return 0;
+        numeric = numeric * 10 + (c - '0');
+    }
+    return numeric;
+}
+
+NSString * IRCStringFromByteRange(IRCByteRange range, IRCConnectionConfiguration *configuration)
+{
+    if (range.length == 0) return @"";
+    return [NSString stringWithBytes:range.bytes length:range.length usingEncodingPreference:configuration];
+}
+
+NSMutableDictionary * IRCDictionaryFromTagsRange(IRCByteRange tags, IRCConnectionConfiguration *configuration)
+{
+    NSMutableDictionary *tagsList = [[NSMutableDictionary alloc] init];
+    
+    const char *position = tags.bytes;
+    const char *end = tags.bytes + tags.length;
+    while (position < end) {
+        const char *tagEnd = memchr(position, ';', end - position);
+        if (tagEnd == NULL) tagEnd = end;
+        
+        if (tagEnd > position) {
+            const char *separator = memchr(position, '=', tagEnd - position);
+            if (separator) {
+                /* This tag has a value. We will save the key and value into the dictionary. */
+                NSString *key = IRCStringFromByteRange((IRCByteRange){ position, separator - position }, configuration);
+                NSString *value = IRCStringFromByteRange((IRCByteRange){ separator + 1, tagEnd - separator - 1 }, configuration);
+                if (key && value) [tagsList setObject:value forKey:key];
+            } else {
+                /* This tag does not have a value, only a key. We will save it in the dictionary
+                 with a default value of "1" */
+                NSString *key = IRCStringFromByteRange((IRCByteRange){ position, tagEnd - position }, configuration);
+                if (key) [tagsList setObject:@"1" forKey:key];
+            }
+        }
+        position = tagEnd + 1;
+    }
+    return tagsList;
+}
@@ -0,0 +1,160 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+#define IRC_RECONNECT_BASE_DELAY            1.0
+#define IRC_RECONNECT_STABLE_CONNECTION     60.0
+
+typedef enum IRCReconnectState : NSUInteger {
+    RECONNECT_STATE_IDLE,
+    RECONNECT_STATE_CONNECTING,
+    RECONNECT_STATE_CONNECTED,
+    RECONNECT_STATE_WAITING,
+    RECONNECT_STATE_STOPPED
+} IRCReconnectState;
+
+/*!
+ *    @brief  A clock returning seconds that only move forward, such as the system uptime.
+ */
+typedef NSTimeInterval (^IRCReconnectClock)(void);
+
+/*!
+ *    @brief  A random number from 0 up to, but not including, 1.
+ */
+typedef double (^IRCReconnectRandom)(void);
+
+/*!
+ *    @brief  How well connecting to one server of a network has gone so far.
+ */
+@interface IRCServerHealth : NSObject
+
+@property (nonatomic, copy, readonly) NSString *address;
+@property (nonatomic, readonly) NSUInteger successes;
+@property (nonatomic, readonly) NSUInteger failures;
+@property (nonatomic, readonly) NSUInteger consecutiveFailures;
+
+/*!
+ *    @brief  The time from starting to connect until the server welcomed us, averaged over the recent connections.
+ */
+@property (nonatomic, readonly) NSTimeInterval averageRegistrationTime;
+
+@end
+
+/*!
+ *    @brief  Decides when and where a client connects again after it lost its connection.
+ *
+ *            Failed attempts are retried with an exponential backoff with jitter, up to a number of attempts.
+ *            A connection that was up for a while and then dropped, such as when the device changes networks,
+ *            is retried right away instead. For networks with more than one server the healthiest one is tried first,
+ *            servers that just failed are tried last and the rest are ordered by how often and how fast they let us in.
+ *
+ *            The engine only keeps state, the client does the connecting and the waiting. All times come from the clock
+ *            it was created with, so it behaves the same every time under a test clock. It may be used from the main
+ *            thread and the connection queue at the same time.
+ */
+@interface IRCReconnectEngine : NSObject
+
+@property (nonatomic, readonly) IRCReconnectState state;
+
+/*!
+ *    @brief  The number of attempts that failed since the last successful connection.
+ */
+@property (nonatomic, readonly) NSUInteger failedAttempts;
+
+/*!
+ *    @brief  The number of failed attempts after which the engine stops trying.
+ */
+@property (nonatomic, assign) NSUInteger maximumAttempts;
+
+/*!
+ *    @brief  The longest time to wait between two attempts, before jitter.
+ */
+@property (nonatomic, assign) NSTimeInterval maximumDelay;
+
+/*!
+ *    @brief  Create an engine using the system uptime and a random jitter.
+ *
+ *    @param servers The addresses of the servers of the network, in the order they were configured.
+ *
+ *    @return An idle engine.
+ */
+- (instancetype)initWithServers:(NSArray *)servers;
+
+/*!
+ *    @brief  Create an engine with its own clock and source of jitter.
+ *
+ *    @param servers The addresses of the servers of the network, in the order they were configured.
+ *    @param clock   The clock to measure time with.
+ *    @param random  The source of jitter.
+ *
+ *    @return An idle engine.
+ */
+- (instancetype)initWithServers:(NSArray *)servers clock:(IRCReconnectClock)clock random:(IRCReconnectRandom)random;
+
+/*!
+ *    @brief  Replace the list of servers, such as after the configuration was edited. Servers still in the list keep their health.
+ *
+ *    @param servers The addresses of the servers of the network, in the order they were configured.
+ */
+- (void)setServers:(NSArray *)servers;
+
+/*!
+ *    @brief  Get the health of every server, the one the next attempt goes to first.
+ *
+ *    @return An array of IRCServerHealth objects.
+ */
+- (NSArray *)serversByHealth;
+
+/*!
+ *    @brief  Start an attempt, choosing the healthiest server.
+ *
+ *    @return The address of the server to connect to.
+ */
+- (NSString *)serverForNextAttempt;
+
+/*!
+ *    @brief  The server welcomed us, the attempt succeeded.
+ */
+- (void)connectionDidRegister;
+
+/*!
+ *    @brief  The connection failed or was lost.
+ *
+ *    @return The number of seconds to wait before the next attempt, or a negative number if the engine gave up.
+ */
+- (NSTimeInterval)connectionDidFail;
+
+/*!
+ *    @brief  Stop reconnecting until the next attempt is started by the user.
+ */
+- (void)stop;
+
+@end
@@ -0,0 +1,215 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "IRCReconnectEngine.h"
+
+#define IRC_RECONNECT_DEFAULT_ATTEMPTS      10
+#define IRC_RECONNECT_DEFAULT_MAXIMUM_DELAY 30.0
+#define IRC_RECONNECT_LATENCY_WEIGHT        0.3
+
+@interface IRCServerHealth ()
+
+@property (nonatomic, copy, readwrite) NSString *address;
+@property (nonatomic, readwrite) NSUInteger successes;
+@property (nonatomic, readwrite) NSUInteger failures;
+@property (nonatomic, readwrite) NSUInteger consecutiveFailures;
+@property (nonatomic, readwrite) NSTimeInterval averageRegistrationTime;
+@property (nonatomic, assign) NSUInteger order;
+
+@end
+
+@implementation IRCServerHealth
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"%@ (%lu successes, %lu failures, %.2fs)", self.address, (unsigned long)self.successes, (unsigned long)self.failures, self.averageRegistrationTime];
+}
+
+@end
+
+@implementation IRCReconnectEngine {
+    IRCReconnectClock _clock;
+    IRCReconnectRandom _random;
+    NSMutableArray *_servers;
+    IRCServerHealth *_currentServer;
+    NSTimeInterval _attemptStarted;
+    NSTimeInterval _connectionEstablished;
+}
+
+- (instancetype)initWithServers:(NSArray *)servers
+{
+    return [self initWithServers:servers clock:^NSTimeInterval{
+        return [[NSProcessInfo processInfo] systemUptime];
+    } random:^double{
+        return (double)arc4random_uniform(UINT32_MAX) / UINT32_MAX;
+    }];
+}
+
+- (instancetype)initWithServers:(NSArray *)servers clock:(IRCReconnectClock)clock random:(IRCReconnectRandom)random
+{
+    if ((self = [super init])) {
+        _clock = [clock copy];
+        _random = [random copy];
+        _servers = [[NSMutableArray alloc] init];
+        _state = RECONNECT_STATE_IDLE;
+        _maximumAttempts = IRC_RECONNECT_DEFAULT_ATTEMPTS;
+        _maximumDelay = IRC_RECONNECT_DEFAULT_MAXIMUM_DELAY;
+        [self setServers:servers];
+        return self;
+    }
+    return nil;
+}
+
+- (IRCReconnectState)state
+{
+    @synchronized(self) {
+        return _state;
+    }
+}
+
+- (void)setServers:(NSArray *)servers
+{
+    @synchronized(self) {
+        NSMutableArray *health = [[NSMutableArray alloc] initWithCapacity:servers.count];
+        for (NSString *address in servers) {
+            NSUInteger index = [_servers indexOfObjectPassingTest:^BOOL(IRCServerHealth *server, NSUInteger idx, BOOL *stop) {
+                return [server.address caseInsensitiveCompare:address] == NSOrderedSame;
+            }];
+        
+            IRCServerHealth *server = index != NSNotFound ? _servers[index] : [[IRCServerHealth alloc] init];
+            server.address = address;
+            server.order = health.count;
+            [health addObject:server];
+        }
+        _servers = health;
+    }
+}
+
+- (NSArray *)serversByHealth
+{
+    @synchronized(self) {
+        return [_servers sortedArrayUsingComparator:^NSComparisonResult(IRCServerHealth *a, IRCServerHealth *b) {
+            /* A server that just failed goes to the back, so the attempts go round all of them. */
+            if (a.consecutiveFailures != b.consecutiveFailures)
+                return a.consecutiveFailures < b.consecutiveFailures ? NSOrderedAscending : NSOrderedDescending;
+        
+            /* Then the share of attempts that succeeded, counting every server as one success and one failure to begin with. */
+            double aRate = (a.successes + 1.0) / (a.successes + a.failures + 2.0);
+            double bRate = (b.successes + 1.0) / (b.successes + b.failures + 2.0);
+            if (aRate != bRate)
+                return aRate > bRate ? NSOrderedAscending : NSOrderedDescending;
+        
+            if (a.successes > 0 && b.successes > 0 && a.averageRegistrationTime != b.averageRegistrationTime)
+                return a.averageRegistrationTime < b.averageRegistrationTime ? NSOrderedAscending : NSOrderedDescending;
+        
+            return a.order < b.order ? NSOrderedAscending : NSOrderedDescending;
+        }];
+    }
+}
+
+- (NSString *)serverForNextAttempt
+{
+    @synchronized(self) {
+        if (_state == RECONNECT_STATE_STOPPED) {
+            _failedAttempts = 0;
+        }
+        
+        _currentServer = [[self serversByHealth] firstObject];
+        _attemptStarted = _clock();
+        _state = RECONNECT_STATE_CONNECTING;
+        return _currentServer.address;
+    }
+}
+
+- (void)connectionDidRegister
+{
+    @synchronized(self) {
+        if (_state != RECONNECT_STATE_CONNECTING)
+            return;
+        
+        NSTimeInterval now = _clock();
+        NSTimeInterval registrationTime = now - _attemptStarted;
+        if (_currentServer.successes == 0) {
+            _currentServer.averageRegistrationTime = registrationTime;
+        } else {
+            _currentServer.averageRegistrationTime += (registrationTime - _currentServer.averageRegistrationTime) * IRC_RECONNECT_LATENCY_WEIGHT;
+        }
+        _currentServer.successes++;
+        _currentServer.consecutiveFailures = 0;
+        
+        _failedAttempts = 0;
+        _connectionEstablished = now;
+        _state = RECONNECT_STATE_CONNECTED;
+    }
+}
+
+- (NSTimeInterval)connectionDidFail
+{
+    @synchronized(self) {
+        if (_state == RECONNECT_STATE_STOPPED || _state == RECONNECT_STATE_IDLE)
+            return -1;
+        
+        if (_state == RECONNECT_STATE_CONNECTED) {
+            /* A connection that held up for a while was lost to the network rather than the server, try again right away. */
+            if (_clock() - _connectionEstablished >= IRC_RECONNECT_STABLE_CONNECTION) {
+                _state = RECONNECT_STATE_WAITING;
+                return 0;
+            }
+        } else if (_state == RECONNECT_STATE_CONNECTING) {
+            _currentServer.failures++;
+            _currentServer.consecutiveFailures++;
+        }
+        
+        if (_state != RECONNECT_STATE_WAITING) {
+            _failedAttempts++;
+        }
+        if (_failedAttempts > _maximumAttempts) {
+            _state = RECONNECT_STATE_STOPPED;
+            return -1;
+        }
+        
+        /* Double the wait with every failure up to the maximum, then take a random point in its upper half
+         so clients that lost their connection together do not all come back at the same moment. */
+        NSTimeInterval delay = MIN(_maximumDelay, IRC_RECONNECT_BASE_DELAY * pow(2.0, (double)(_failedAttempts - 1)));
+        delay = delay / 2.0 + _random() * delay / 2.0;
+        
+        _state = RECONNECT_STATE_WAITING;
+        return delay;
+    }
+}
+
+- (void)stop
+{
+    @synchronized(self) {
+        _state = RECONNECT_STATE_STOPPED;
+    }
+}
+
+@end
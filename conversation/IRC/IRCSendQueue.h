@@ -0,0 +1,143 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+#define IRC_SEND_QUEUE_DEFAULT_BURST    5.0
+#define IRC_SEND_QUEUE_DEFAULT_RATE     2.0
+#define IRC_SEND_QUEUE_BYTES_PER_TOKEN  512
+
+typedef enum IRCSendPriority : NSUInteger {
+    IRC_SEND_PRIORITY_URGENT,
+    IRC_SEND_PRIORITY_NORMAL,
+    IRC_SEND_PRIORITY_COUNT
+} IRCSendPriority;
+
+/*!
+ *    @brief  The outgoing lines of a connection, paced by a token bucket.
+ *
+ *            Every line costs one token plus one for every 512 bytes, tokens come back at a fixed rate up to the size
+ *            of the burst. Lines go out in the order they were queued. Only while a line is waiting for tokens may an
+ *            urgent line skip ahead of it, so a PONG is never stuck behind a pasted wall of PRIVMSGs. Urgent lines are
+ *            sent even when the bucket is empty and are paid for by the lines after them.
+ *
+ *            The queue has no clock of its own and is not thread safe, the connection passes in the time and guards it.
+ */
+@interface IRCSendQueue : NSObject
+
+/*!
+ *    @brief  The most tokens the bucket holds, the number of short lines that can be sent at once.
+ */
+@property (nonatomic, readonly) double burst;
+
+/*!
+ *    @brief  The number of tokens added to the bucket every second.
+ */
+@property (nonatomic, readonly) double rate;
+
+/*!
+ *    @brief  Whether lines are paced at all. Without it every line is sent right away, in the order it was queued.
+ */
+@property (nonatomic, readonly) BOOL throttled;
+
+/*!
+ *    @brief  The number of lines waiting to be sent.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/*!
+ *    @brief  Create a queue that does not pace lines until throttling is switched on.
+ *
+ *    @param burst The most tokens the bucket holds.
+ *    @param rate  The number of tokens added every second.
+ *
+ *    @return An empty send queue.
+ */
+- (instancetype)initWithBurst:(double)burst rate:(double)rate;
+
+/*!
+ *    @brief  Change the size of the bucket and how fast it fills, such as when the settings of the network have changed.
+ *
+ *    @param burst The most tokens the bucket holds.
+ *    @param rate  The number of tokens added every second.
+ */
+- (void)setBurst:(double)burst rate:(double)rate;
+
+/*!
+ *    @brief  Start or stop pacing lines. Starting fills the bucket.
+ *
+ *    @param throttled Whether to pace lines.
+ *    @param now       The current time, in seconds on a clock that only moves forward.
+ */
+- (void)setThrottled:(BOOL)throttled atTime:(NSTimeInterval)now;
+
+/*!
+ *    @brief  Get the priority of a line from its command.
+ *
+ *    @param line The line to send, optionally with message tags.
+ *
+ *    @return Urgent for PONG, PING and QUIT, normal for everything else.
+ */
++ (IRCSendPriority)priorityOfLine:(NSString *)line;
+
+/*!
+ *    @brief  Queue a line behind the lines queued before it.
+ *
+ *    @param data     The encoded line, including its CRLF.
+ *    @param priority Whether the line may skip ahead of lines that are waiting for tokens.
+ */
+- (void)addLine:(NSData *)data withPriority:(IRCSendPriority)priority;
+
+/*!
+ *    @brief  Take the next line that may be sent now.
+ *
+ *    @param now   The current time, in seconds on a clock that only moves forward.
+ *    @param delay Set to the number of seconds until the next line may be sent, or 0 if there is none waiting.
+ *
+ *    @return The encoded line to send, or nil if nothing may be sent yet.
+ */
+- (NSData *)nextLineAtTime:(NSTimeInterval)now delay:(NSTimeInterval *)delay;
+
+/*!
+ *    @brief  Take every line that may be sent now, joined into one buffer so they go out in a single socket write.
+ *
+ *    @param now   The current time, in seconds on a clock that only moves forward.
+ *    @param delay Set to the number of seconds until the next line may be sent, or 0 if there is none waiting.
+ *
+ *    @return The encoded lines to send, or nil if nothing may be sent yet.
+ */
+- (NSData *)linesAtTime:(NSTimeInterval)now delay:(NSTimeInterval *)delay;
+
+/*!
+ *    @brief  Drop every queued line, such as when the connection closes.
+ */
+- (void)removeAllLines;
+
+@end
@@ -0,0 +1,199 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "IRCSendQueue.h"
+
+@implementation IRCSendQueue {
+    NSMutableArray *_lanes[IRC_SEND_PRIORITY_COUNT];
+    NSMutableArray *_sequences[IRC_SEND_PRIORITY_COUNT];
+    NSUInteger _heads[IRC_SEND_PRIORITY_COUNT];
+    unsigned long long _nextSequence;
+    double _tokens;
+    NSTimeInterval _lastRefill;
+}
+
+- (instancetype)initWithBurst:(double)burst rate:(double)rate
+{
+    if ((self = [super init])) {
+        [self setBurst:burst rate:rate];
+        _tokens = _burst;
+        for (NSUInteger i = 0; i < IRC_SEND_PRIORITY_COUNT; i++) {
+            _lanes[i] = [[NSMutableArray alloc] init];
+            _sequences[i] = [[NSMutableArray alloc] init];
+        }
+        return self;
+    }
+    return nil;
+}
+
+- (void)setBurst:(double)burst rate:(double)rate
+{
+    _burst = MAX(burst, 1.0);
+    _rate = rate > 0 ? rate : IRC_SEND_QUEUE_DEFAULT_RATE;
+    _tokens = MIN(_tokens, _burst);
+}
+
+- (void)setThrottled:(BOOL)throttled atTime:(NSTimeInterval)now
+{
+    _throttled = throttled;
+    _tokens = _burst;
+    _lastRefill = now;
+}
+
++ (IRCSendPriority)priorityOfLine:(NSString *)line
+{
+    /* Skip the message tags to get to the command. */
+    NSUInteger length = line.length;
+    NSUInteger start = 0;
+    if (length > 0 && [line characterAtIndex:0] == '@') {
+        NSRange space = [line rangeOfString:@" "];
+        if (space.location == NSNotFound)
+            return IRC_SEND_PRIORITY_NORMAL;
+        start = space.location + 1;
+    }
+    
+    NSUInteger end = start;
+    while (end < length && [line characterAtIndex:end] != ' ' && [line characterAtIndex:end] != '\r') {
+        end++;
+    }
+    NSString *command = [line substringWithRange:NSMakeRange(start, end - start)];
+    
+    /* Only lines whose place in the conversation does not matter may skip ahead. A NICK stays in order,
+     the lines queued before it were meant to be sent under the old nickname. */
+    if ([command caseInsensitiveCompare:@"PONG"] == NSOrderedSame ||
+        [command caseInsensitiveCompare:@"PING"] == NSOrderedSame ||
+        [command caseInsensitiveCompare:@"QUIT"] == NSOrderedSame) {
+        return IRC_SEND_PRIORITY_URGENT;
+    }
+    return IRC_SEND_PRIORITY_NORMAL;
+}
+
+- (NSUInteger)count
+{
+    NSUInteger count = 0;
+    for (NSUInteger i = 0; i < IRC_SEND_PRIORITY_COUNT; i++) {
+        count += _lanes[i].count - _heads[i];
+    }
+    return count;
+}
+
+- (void)addLine:(NSData *)data withPriority:(IRCSendPriority)priority
+{
+    NSAssert(priority < IRC_SEND_PRIORITY_COUNT, @"Invalid send priority %lu", (unsigned long)priority);
+    [_lanes[priority] addObject:data];
+    [_sequences[priority] addObject:@(_nextSequence++)];
+}
+
+- (NSData *)nextLineAtTime:(NSTimeInterval)now delay:(NSTimeInterval *)delay
+{
+    *delay = 0;
+    
+    /* The line queued first goes next, whichever lane it is in. */
+    BOOL hasUrgentLine = _heads[IRC_SEND_PRIORITY_URGENT] < _lanes[IRC_SEND_PRIORITY_URGENT].count;
+    BOOL hasNormalLine = _heads[IRC_SEND_PRIORITY_NORMAL] < _lanes[IRC_SEND_PRIORITY_NORMAL].count;
+    if (hasUrgentLine == NO && hasNormalLine == NO)
+        return nil;
+    
+    IRCSendPriority lane = IRC_SEND_PRIORITY_URGENT;
+    if (hasUrgentLine == NO || (hasNormalLine &&
+        [_sequences[IRC_SEND_PRIORITY_NORMAL][_heads[IRC_SEND_PRIORITY_NORMAL]] compare:_sequences[IRC_SEND_PRIORITY_URGENT][_heads[IRC_SEND_PRIORITY_URGENT]]] == NSOrderedAscending)) {
+        lane = IRC_SEND_PRIORITY_NORMAL;
+    }
+    
+    NSData *data = _lanes[lane][_heads[lane]];
+    
+    if (_throttled) {
+        if (now > _lastRefill) {
+            _tokens = MIN(_burst, _tokens + (now - _lastRefill) * _rate);
+            _lastRefill = now;
+        }
+        
+        /* A line longer than the whole bucket only has to wait for a full one. */
+        double cost = 1.0 + (double)data.length / IRC_SEND_QUEUE_BYTES_PER_TOKEN;
+        double required = MIN(cost, _burst);
+        if (lane == IRC_SEND_PRIORITY_NORMAL && _tokens < required) {
+            if (hasUrgentLine == NO) {
+                *delay = (required - _tokens) / _rate;
+                return nil;
+            }
+            
+            /* The next line has to wait for tokens, an urgent line queued after it does not. */
+            lane = IRC_SEND_PRIORITY_URGENT;
+            data = _lanes[lane][_heads[lane]];
+            cost = 1.0 + (double)data.length / IRC_SEND_QUEUE_BYTES_PER_TOKEN;
+        }
+        
+        /* Urgent lines may overdraw the bucket, but never by more than a full burst. */
+        _tokens = MAX(_tokens - cost, -_burst);
+    }
+    
+    /* Lines are taken from the front by moving the head, the lane is only compacted once most of it has been sent. */
+    _heads[lane]++;
+    if (_heads[lane] == _lanes[lane].count) {
+        [_lanes[lane] removeAllObjects];
+        [_sequences[lane] removeAllObjects];
+        _heads[lane] = 0;
+    } else if (_heads[lane] > 64 && _heads[lane] * 2 > _lanes[lane].count) {
+        [_lanes[lane] removeObjectsInRange:NSMakeRange(0, _heads[lane])];
+        [_sequences[lane] removeObjectsInRange:NSMakeRange(0, _heads[lane])];
+        _heads[lane] = 0;
+    }
+    return data;
+}
+
+- (NSData *)linesAtTime:(NSTimeInterval)now delay:(NSTimeInterval *)delay
+{
+    NSData *line = [self nextLineAtTime:now delay:delay];
+    if (line == nil)
+        return nil;
+    
+    /* Most of the time there is only one line, which does not need to be copied. */
+    NSData *nextLine = [self nextLineAtTime:now delay:delay];
+    if (nextLine == nil)
+        return line;
+    
+    NSMutableData *lines = [[NSMutableData alloc] initWithCapacity:line.length + nextLine.length];
+    [lines appendData:line];
+    do {
+        [lines appendData:nextLine];
+    } while ((nextLine = [self nextLineAtTime:now delay:delay]));
+    return lines;
+}
+
+- (void)removeAllLines
+{
+    for (NSUInteger i = 0; i < IRC_SEND_PRIORITY_COUNT; i++) {
+        [_lanes[i] removeAllObjects];
+        [_sequences[i] removeAllObjects];
+        _heads[i] = 0;
+    }
+}
+
+@end
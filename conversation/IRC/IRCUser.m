@@ -118,14 +118,8 @@
 
 + (IRCUser *)fromNickname:(NSString *)sender onChannel:(IRCChannel *)channel
 {
-    /* Iterate through the userlist and return the first user with the same nickname as the sender. */
-    IRCUser *userFromUserlist = nil;
-    for (IRCUser *user in [channel users]) {
-        if ([[user nick] isEqualToStringCaseInsensitive:sender]) {
-            userFromUserlist = user;
-            break;
-        }
-    }
+    /* Look up the user with the same nickname as the sender in the userlist. */
+    IRCUser *userFromUserlist = [channel userWithNickname:sender];
     if (!userFromUserlist.username.length || !userFromUserlist.hostname.length)
         return nil;
     
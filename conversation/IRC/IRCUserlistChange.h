@@ -0,0 +1,64 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class IRCUser;
+
+typedef NS_ENUM(NSUInteger, UserlistChangeType) {
+    USERLIST_INSERT,
+    USERLIST_DELETE,
+    USERLIST_MOVE,
+    USERLIST_UPDATE
+};
+
+/*!
+ *    @brief  A single change to the ordered userlist of a channel, applied in the order they were made.
+ */
+@interface IRCUserlistChange : NSObject
+
+@property (nonatomic, assign) UserlistChangeType type;
+@property (nonatomic, assign) NSUInteger fromIndex;
+@property (nonatomic, assign) NSUInteger toIndex;
+@property (nonatomic, strong) IRCUser *user;
+
+/*!
+ *    @brief  Create a userlist change.
+ *
+ *    @param type      The kind of change that was made.
+ *    @param fromIndex The position of the user before the change, or NSNotFound for an insertion.
+ *    @param toIndex   The position of the user after the change, or NSNotFound for a deletion.
+ *    @param user      The user that was changed.
+ *
+ *    @return An IRCUserlistChange object.
+ */
++ (instancetype)changeWithType:(UserlistChangeType)type fromIndex:(NSUInteger)fromIndex toIndex:(NSUInteger)toIndex user:(IRCUser *)user;
+
+@end
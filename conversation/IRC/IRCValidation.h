@@ -0,0 +1,119 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+#import "IRCParser.h"
+
+#define IRC_DEFAULT_CHANNEL_PREFIXES    "#&+!"
+#define IRC_DEFAULT_NICKNAME_LENGTH     16
+
+typedef enum IRCCharacterFlags : uint8_t {
+    IRC_CHARACTER_CHANNEL_PREFIX        = 1 << 0,
+    IRC_CHARACTER_CHANNEL_FORBIDDEN     = 1 << 1,
+    IRC_CHARACTER_USERNAME_FORBIDDEN    = 1 << 2,
+    IRC_CHARACTER_HOSTNAME_FORBIDDEN    = 1 << 3
+} IRCCharacterFlags;
+
+/*!
+ *    @brief  The rules a server uses for channel names and nicknames, precomputed so names can be validated
+ *            with a single table lookup per byte and without allocating memory.
+ */
+typedef struct {
+    uint8_t characters[256];
+    NSUInteger maximumNicknameLength;
+} IRCValidationTable;
+
+/*!
+ *    @brief  Fill a validation table with the rules announced by a server.
+ *
+ *    @param table                 The table to fill.
+ *    @param channelPrefixes       A null terminated string of the channel prefix characters, such as "#&".
+ *    @param maximumNicknameLength The longest nickname allowed by the server.
+ */
+void IRCBuildValidationTable(IRCValidationTable *table, const char *channelPrefixes, NSUInteger maximumNicknameLength);
+
+/*!
+ *    @brief  Get the validation table for the rules of RFC1459, used when there is no server to ask.
+ *
+ *    @return A shared table that must not be changed.
+ */
+const IRCValidationTable * IRCDefaultValidationTable(void);
+
+/*!
+ *    @brief  Check if a name is a valid channel name.
+ *
+ *    @param table The rules of the server.
+ *    @param name  The name to check.
+ *
+ *    @return Boolean indicating whether the name starts with a channel prefix and contains no forbidden characters.
+ */
+BOOL IRCIsValidChannelName(const IRCValidationTable *table, IRCByteRange name);
+
+/*!
+ *    @brief  Check if a nickname has a length allowed by the server.
+ *
+ *    @param table    The rules of the server.
+ *    @param nickname The nickname to check.
+ *
+ *    @return Boolean indicating whether the nickname is valid.
+ */
+BOOL IRCIsValidNickname(const IRCValidationTable *table, IRCByteRange nickname);
+
+/*!
+ *    @brief  Check if a username contains no line breaks or hostmask separators.
+ *
+ *    @param table    The rules of the server.
+ *    @param username The username to check.
+ *
+ *    @return Boolean indicating whether the username is valid.
+ */
+BOOL IRCIsValidUsername(const IRCValidationTable *table, IRCByteRange username);
+
+/*!
+ *    @brief  Check if a hostname has a valid length and contains no control characters.
+ *
+ *    @param table    The rules of the server.
+ *    @param hostname The hostname to check.
+ *
+ *    @return Boolean indicating whether the hostname is valid.
+ */
+BOOL IRCIsValidHostname(const IRCValidationTable *table, IRCByteRange hostname);
+
+/*!
+ *    @brief  Split a "nickname!username@hostname" hostmask in a single pass.
+ *
+ *    @param hostmask The hostmask to split, such as the prefix of a parsed line.
+ *    @param nickname Set to the range of the nickname.
+ *    @param username Set to the range of the username.
+ *    @param hostname Set to the range of the hostname.
+ *
+ *    @return Boolean indicating whether the hostmask had exactly one '!' followed by exactly one '@'.
+ */
+BOOL IRCSplitHostmask(IRCByteRange hostmask, IRCByteRange *nickname, IRCByteRange *username, IRCByteRange *hostname);
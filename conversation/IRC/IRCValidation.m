@@ -0,0 +1,148 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "IRCValidation.h"
+
+void IRCBuildValidationTable(IRCValidationTable *table, const char *channelPrefixes, NSUInteger maximumNicknameLength)
+{
+    memset(table->characters, 0, sizeof(table->characters));
+    
+    for (const unsigned char *prefix = (const unsigned char *)channelPrefixes; *prefix != '\0'; prefix++) {
+        table->characters[*prefix] |= IRC_CHARACTER_CHANNEL_PREFIX;
+    }
+    
+    table->characters[' ']  |= IRC_CHARACTER_CHANNEL_FORBIDDEN;
+    table->characters['\a'] |= IRC_CHARACTER_CHANNEL_FORBIDDEN;
+    table->characters[',']  |= IRC_CHARACTER_CHANNEL_FORBIDDEN;
+    
+    table->characters['\r'] |= IRC_CHARACTER_USERNAME_FORBIDDEN;
+    table->characters['\n'] |= IRC_CHARACTER_USERNAME_FORBIDDEN;
+    table->characters['@']  |= IRC_CHARACTER_USERNAME_FORBIDDEN;
+    table->characters['!']  |= IRC_CHARACTER_USERNAME_FORBIDDEN;
+    
+    /* Control characters are not allowed in a hostname, with the exception of the ones used for formatting. */
+    for (unsigned int character = 0; character < 0x20; character++) {
+        table->characters[character] |= IRC_CHARACTER_HOSTNAME_FORBIDDEN;
+    }
+    table->characters[0x7F] |= IRC_CHARACTER_HOSTNAME_FORBIDDEN;
+    table->characters['\002'] &= ~IRC_CHARACTER_HOSTNAME_FORBIDDEN;
+    table->characters['\003'] &= ~IRC_CHARACTER_HOSTNAME_FORBIDDEN;
+    table->characters['\031'] &= ~IRC_CHARACTER_HOSTNAME_FORBIDDEN;
+    
+    table->maximumNicknameLength = maximumNicknameLength > 0 ? maximumNicknameLength : IRC_DEFAULT_NICKNAME_LENGTH;
+}
+
+const IRCValidationTable * IRCDefaultValidationTable(void)
+{
+    static IRCValidationTable defaultTable;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        IRCBuildValidationTable(&defaultTable, IRC_DEFAULT_CHANNEL_PREFIXES, IRC_DEFAULT_NICKNAME_LENGTH);
+    });
+    return &defaultTable;
+}
+
+/*!
+ *    @brief  Check that none of the bytes in a range have any of the given flags set.
+ */
+static inline BOOL IRCRangeHasNoCharactersWithFlags(const IRCValidationTable *table, const char *position, const char *end, uint8_t flags)
+{
+    while (position < end) {
+        if (table->characters[(unsigned char)*position] & flags) {
+            return NO;
+        }
+        position++;
+    }
+    return YES;
+}
+
+BOOL IRCIsValidChannelName(const IRCValidationTable *table, IRCByteRange name)
+{
+    const char *position = name.bytes;
+    const char *end = name.bytes + name.length;
+    
+    /* Some IRC bouncers prefix special channels with a '~' we will skip this */
+    if (position < end && *position == '~') {
+        position++;
+    }
+    
+    if (position >= end || (table->characters[(unsigned char)*position] & IRC_CHARACTER_CHANNEL_PREFIX) == 0) {
+        return NO;
+    }
+    
+    return IRCRangeHasNoCharactersWithFlags(table, position, end, IRC_CHARACTER_CHANNEL_FORBIDDEN);
+}
+
+BOOL IRCIsValidNickname(const IRCValidationTable *table, IRCByteRange nickname)
+{
+    return nickname.length >= 2 && nickname.length <= table->maximumNicknameLength;
+}
+
+BOOL IRCIsValidUsername(const IRCValidationTable *table, IRCByteRange username)
+{
+    if (username.length < 1) {
+        return NO;
+    }
+    return IRCRangeHasNoCharactersWithFlags(table, username.bytes, username.bytes + username.length, IRC_CHARACTER_USERNAME_FORBIDDEN);
+}
+
+BOOL IRCIsValidHostname(const IRCValidationTable *table, IRCByteRange hostname)
+{
+    if (hostname.length < 1 || hostname.length > 255) {
+        return NO;
+    }
+    return IRCRangeHasNoCharactersWithFlags(table, hostname.bytes, hostname.bytes + hostname.length, IRC_CHARACTER_HOSTNAME_FORBIDDEN);
+}
+
+BOOL IRCSplitHostmask(IRCByteRange hostmask, IRCByteRange *nickname, IRCByteRange *username, IRCByteRange *hostname)
+{
+    const char *end = hostmask.bytes + hostmask.length;
+    const char *exclamationMark = NULL;
+    const char *atSign = NULL;
+    
+    for (const char *position = hostmask.bytes; position < end; position++) {
+        if (*position == '!') {
+            if (exclamationMark || atSign) return NO;
+            exclamationMark = position;
+        } else if (*position == '@') {
+            if (atSign || exclamationMark == NULL) return NO;
+            atSign = position;
+        }
+    }
+    
+    if (exclamationMark == NULL || atSign == NULL) {
+        return NO;
+    }
+    
+    *nickname = (IRCByteRange){ hostmask.bytes, exclamationMark - hostmask.bytes };
+    *username = (IRCByteRange){ exclamationMark + 1, atSign - exclamationMark - 1 };
+    *hostname = (IRCByteRange){ atSign + 1, end - atSign - 1 };
+    return YES;
+}
@@ -43,56 +43,68 @@
 
 + (NSArray *)inputCommandReference;
 
+/* The commands available from the input field, in the order of the InputCommand enum.
+ Both the enum and inputCommandReference are generated from this list, so a new command only needs to be added here. */
+#define INPUT_COMMANDS(X)                   \
+    X(CMD_ADMIN,      "ADMIN")              \
+    X(CMD_BAN,        "BAN")                \
+    X(CMD_CLEAR,      "CLEAR")              \
+    X(CMD_CLEARALL,   "CLEARALL")           \
+    X(CMD_CLOSE,      "CLOSE")              \
+    X(CMD_CTCP,       "CTCP")               \
+    X(CMD_CTCPREPLY,  "CTCPREPLY")          \
+    X(CMD_CYCLE,      "CYCLE")              \
+    X(CMD_DEADMIN,    "DEADMIN")            \
+    X(CMD_DEHALFOP,   "DEHALFOP")           \
+    X(CMD_DEOP,       "DEOP")               \
+    X(CMD_DEVOICE,    "DEVOICE")            \
+    X(CMD_DEOWNER,    "DEOWNER")            \
+    X(CMD_DETACH,     "DETACH")             \
+    X(CMD_HALFOP,     "HALFOP")             \
+    X(CMD_HOP,        "HOP")                \
+    X(CMD_IGNORE,     "IGNORE")             \
+    X(CMD_INVITE,     "INVITE")             \
+    X(CMD_J,          "J")                  \
+    X(CMD_JOIN,       "JOIN")               \
+    X(CMD_KB,         "KB")                 \
+    X(CMD_K,          "K")                  \
+    X(CMD_KICK,       "KICK")               \
+    X(CMD_KICKBAN,    "KICKBAN")            \
+    X(CMD_LEAVE,      "LEAVE")              \
+    X(CMD_LIST,       "LIST")               \
+    X(CMD_ME,         "ME")                 \
+    X(CMD_MODE,       "MODE")               \
+    X(CMD_MSG,        "MSG")                \
+    X(CMD_MYVERSION,  "MYVERSION")          \
+    X(CMD_NICK,       "NICK")               \
+    X(CMD_OP,         "OP")                 \
+    X(CMD_NOTICE,     "NOTICE")             \
+    X(CMD_OWNER,      "OWNER")              \
+    X(CMD_PART,       "PART")               \
+    X(CMD_QUERY,      "QUERY")              \
+    X(CMD_QUIT,       "QUIT")               \
+    X(CMD_QUOTE,      "QUOTE")              \
+    X(CMD_RAW,        "RAW")                \
+    X(CMD_REJOIN,     "REJOIN")             \
+    X(CMD_SSLCONTEXT, "SSLCONTEXT")         \
+    X(CMD_SYSINFO,    "SYSINFO")            \
+    X(CMD_TIMER,      "TIMER")              \
+    X(CMD_TOPIC,      "TOPIC")              \
+    X(CMD_UNIGNORE,   "UNIGNORE")           \
+    X(CMD_UMODE,      "UMODE")              \
+    X(CMD_UNBAN,      "UNBAN")              \
+    X(CMD_VOICE,      "VOICE")              \
+    X(CMD_WHOIS,      "WHOIS")              \
+    X(CMD_ZNC,        "ZNC")
+
+/* Other names accepted for a command, they are not listed in inputCommandReference. */
+#define INPUT_COMMAND_ALIASES(X)            \
+    X(CMD_DEHALFOP,   "DEHOP")
+
+#define INPUT_COMMAND_ENUM(type, command) type,
+
 typedef NS_ENUM(NSUInteger, InputCommand) {
-    CMD_ADMIN,
-    CMD_BAN,
-    CMD_CLEAR,
-    CMD_CLEARALL,
-    CMD_CLOSE,
-    CMD_CTCP,
-    CMD_CTCPREPLY,
-    CMD_CYCLE,
-    CMD_DEADMIN,
-    CMD_DEHALFOP,
-    CMD_DEOP,
-    CMD_DEVOICE,
-    CMD_DEOWNER,
-    CMD_DETACH,
-    CMD_HALFOP,
-    CMD_HOP,
-    CMD_IGNORE,
-    CMD_INVITE,
-    CMD_J,
-    CMD_JOIN,
-    CMD_KB,
-    CMD_K,
-    CMD_KICK,
-    CMD_KICKBAN,
-    CMD_LEAVE,
-    CMD_LIST,
-    CMD_ME,
-    CMD_MODE,
-    CMD_MSG,
-    CMD_MYVERSION,
-    CMD_NICK,
-    CMD_OP,
-    CMD_NOTICE,
-    CMD_OWNER,
-    CMD_PART,
-    CMD_QUERY,
-    CMD_QUIT,
-    CMD_QUOTE,
-    CMD_RAW,
-    CMD_REJOIN,
-	CMD_SSLCONTEXT,
-    CMD_SYSINFO,
-    CMD_TIMER,
-    CMD_TOPIC,
-    CMD_UNIGNORE,
-    CMD_UMODE,
-    CMD_UNBAN,
-    CMD_VOICE,
-    CMD_WHOIS
+    INPUT_COMMANDS(INPUT_COMMAND_ENUM)
 };
 
 @end
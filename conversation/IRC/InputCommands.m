@@ -573,63 +573,34 @@
 
 + (NSUInteger)indexValueFromString:(NSString *)key
 {
-    return [[InputCommands inputCommandReference] indexOfObject:key];
+    static NSDictionary *inputCommandIndex = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSArray *commands = [InputCommands inputCommandReference];
+        NSMutableDictionary *index = [[NSMutableDictionary alloc] initWithCapacity:[commands count]];
+        [commands enumerateObjectsUsingBlock:^(NSString *command, NSUInteger i, BOOL *stop) {
+            index[command] = @(i);
+        }];
+        #define INPUT_COMMAND_ALIAS_ENTRY(type, command) index[@command] = @(type);
+        INPUT_COMMAND_ALIASES(INPUT_COMMAND_ALIAS_ENTRY)
+        inputCommandIndex = index;
+    });
+    
+    NSNumber *command = inputCommandIndex[key];
+    return command ? [command unsignedIntegerValue] : NSNotFound;
 }
 
 + (NSArray *)inputCommandReference
 {
-    return @[
-        @"ADMIN",
-        @"BAN",
-        @"CLEAR",
-        @"CLEARALL",
-        @"CLOSE",
-        @"CTCP",
-        @"CTCPREPLY",
-        @"CYCLE",
-        @"DEADMIN",
-        @"DEHALFOP",
-        @"DEHOP",
-        @"DEVOICE",
-        @"DEOWNER",
-        @"DETACH",
-        @"HALFOP",
-        @"HOP",
-        @"IGNORE",
-        @"INVITE",
-        @"J",
-        @"JOIN",
-        @"K",
-        @"KB",
-        @"KICK",
-        @"KICKBAN",
-        @"LEAVE",
-        @"LIST",
-        @"ME",
-        @"MODE",
-        @"MSG",
-        @"MYVERSION",
-        @"NICK",
-        @"OP",
-        @"NOTICE",
-        @"OWNER",
-        @"PART",
-        @"QUERY",
-        @"QUIT",
-        @"QUOTE",
-        @"RAW",
-        @"REJOIN",
-		@"SSLCONTEXT",
-        @"SYSINFO",
-        @"TIMER",
-        @"TOPIC",
-        @"UNIGNORE",
-        @"UMODE",
-        @"UNBAN",
-        @"VOICE",
-        @"WHOIS",
-        @"ZNC"
-    ];
+    #define INPUT_COMMAND_STRING(type, command) @command,
+    static NSArray *inputCommandReference = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        inputCommandReference = @[
+            INPUT_COMMANDS(INPUT_COMMAND_STRING)
+        ];
+    });
+    return inputCommandReference;
 }
 
 @end
@@ -79,8 +79,12 @@
 
 + (void)clientReceivedWHOReply:(IRCMessage *)message;
 
++ (void)clientReceivedWHOEndReply:(IRCMessage *)message;
+
 + (void)clientReceivedNAMEReply:(IRCMessage *)message;
 
++ (void)clientReceivedNAMESEndReply:(IRCMessage *)message;
+
 + (void)clientReceivedLISTReply:(IRCMessage *)message;
 
 + (void)clientReceivedLISTEndReply:(IRCMessage *)message;
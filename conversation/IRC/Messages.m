@@ -197,7 +197,7 @@
     message.client.configuration.lastMessageTime = (long) [[NSDate date] timeIntervalSince1970];
     
     /* Incoming private message so the actual conversation name is sender's nick */
-    if ([message.conversation.name isEqualToStringCaseInsensitive:message.client.currentUserOnConnection.nick]) {
+    if ([message.conversation.name isEqualToName:message.client.currentUserOnConnection.nick onClient:message.client]) {
         IRCChannelConfiguration *configuration = [[IRCChannelConfiguration alloc] init];
         configuration.name = message.sender.nick;
         message.conversation = [[IRCConversation alloc] initWithConfiguration:configuration withClient:message.client];
@@ -294,7 +294,7 @@
     AssertIsNotServerMessage(message);
     
     /* Incoming private message so the actual conversation name is sender's nick */
-    if ([message.conversation.name isEqualToStringCaseInsensitive:message.client.currentUserOnConnection.nick]) {
+    if ([message.conversation.name isEqualToName:message.client.currentUserOnConnection.nick onClient:message.client]) {
         IRCChannelConfiguration *configuration = [[IRCChannelConfiguration alloc] init];
         configuration.name = message.sender.nick;
         message.conversation = [[IRCConversation alloc] initWithConfiguration:configuration withClient:message.client];
@@ -351,7 +351,7 @@
         message.messageType = ET_JOIN;
         message.conversation = channel;
         
-        if ([[[message sender] nick] isEqualToStringCaseInsensitive:message.client.currentUserOnConnection.nick]) {
+        if ([[[message sender] nick] isEqualToName:message.client.currentUserOnConnection.nick onClient:message.client]) {
             [message.client.connection send:[NSString stringWithFormat:@"WHO %@", conversation.name]];
             [message.client.connection send:[NSString stringWithFormat:@"MODE %@", conversation.name]];
             channel.isJoinedByUser = YES;
@@ -361,8 +361,7 @@
                 [controller reloadClient:message.client];
             });
         }
-        [[channel users] addObject:[message sender]];
-        [channel sortUserlist];
+        [channel addUser:[message sender]];
 
         [[message conversation] addMessageToConversation:message];
     
@@ -376,13 +375,13 @@
     message.conversation = channel;
     [[message conversation] addMessageToConversation:message];
     
-    if ([[[message sender] nick]  isEqualToStringCaseInsensitive:message.client.currentUserOnConnection.nick]) {
+    if ([[[message sender] nick]  isEqualToName:message.client.currentUserOnConnection.nick onClient:message.client]) {
         ConversationListViewController *controller = ((AppDelegate *)[UIApplication sharedApplication].delegate).conversationsController;
         
         /* The user that left is ourselves, we need check if the item is still in our list or if it was deleted */
         if (channel && [channel isKindOfClass:[IRCChannel class]]) {
             channel.isJoinedByUser = NO;
-            [channel.users removeAllObjects];
+            [channel removeAllUsers];
             dispatch_async(dispatch_get_main_queue(), ^{
                 [controller reloadClient:message.client];
             });
@@ -394,7 +393,7 @@
 
 + (void)userReceivedNickChange:(IRCMessage *)message
 {
-    if ([[[message sender] nick] isEqualToStringCaseInsensitive:message.client.currentUserOnConnection.nick] && message.isConversationHistory == NO) {
+    if ([[[message sender] nick] isEqualToName:message.client.currentUserOnConnection.nick onClient:message.client] && message.isConversationHistory == NO) {
         message.client.currentUserOnConnection.nick     = message.message;
         message.client.currentUserOnConnection.username = message.sender.username;
         message.client.currentUserOnConnection.hostname = message.sender.hostname;
@@ -404,26 +403,22 @@
     message.message = message.message;
     
     for (IRCChannel *channel in [message.client channels]) {
-        IRCUser *userOnChannel = [IRCUser fromNickname:message.sender.nick onChannel:channel];
+        IRCUser *userOnChannel = [channel userWithNickname:message.sender.nick];
         if (userOnChannel) {
             IRCMessage *nickMessage = [message copy];
             nickMessage.conversation = channel;
             
-            userOnChannel.nick = message.message;
-            [channel removeUserByName:[userOnChannel nick]];
-            [channel.users addObject:userOnChannel];
-            [channel sortUserlist];
+            [channel renameUser:userOnChannel toNickname:message.message];
             
             [nickMessage.conversation addMessageToConversation:nickMessage];
         }
     }
     
-    for (IRCConversation *conversation in [message.client queries]) {
-        if ([[conversation name] isEqualToStringCaseInsensitive:message.sender.nick]) {
-            conversation.name = message.message;
-            
-            [message.conversation addMessageToConversation:message];
-        }
+    IRCConversation *query = [message.client conversationWithName:message.sender.nick];
+    if (query && [query isKindOfClass:[IRCChannel class]] == NO) {
+        [message.client renameQuery:query toName:message.message];
+        
+        [message.conversation addMessageToConversation:message];
     }
     
 }
@@ -439,16 +434,16 @@
         kickMessage = [kickMessage substringFromIndex:1];
     }
     
-    IRCUser *kickedUser = [IRCUser fromNickname:kickedUserNickname onChannel:(IRCChannel *)message.conversation];
     IRCChannel *channel = (IRCChannel *)message.conversation;
+    IRCUser *kickedUser = [channel userWithNickname:kickedUserNickname];
     
-    if ([[kickedUser nick] isEqualToStringCaseInsensitive:message.client.currentUserOnConnection.nick]) {
+    if ([[kickedUser nick] isEqualToName:message.client.currentUserOnConnection.nick onClient:message.client]) {
         ConversationListViewController *controller = ((AppDelegate *)[UIApplication sharedApplication].delegate).conversationsController;
         
         /* The user that left is ourselves, we need check if the item is still in our list or if it was deleted */
         if (channel != nil) {
             channel.isJoinedByUser = NO;
-            [channel.users removeAllObjects];
+            [channel removeAllUsers];
             dispatch_async(dispatch_get_main_queue(), ^{
                 [controller reloadClient:message.client];
             });
@@ -458,7 +453,7 @@
             [IRCCommands joinChannel:message.conversation.name onClient:message.client];
         }
     } else {
-        [[channel users] removeObject:kickedUser];
+        [channel removeUserByName:kickedUserNickname];
     }
     
     IRCMessage *kick = [[IRCMessage alloc] initWithMessage:kickMessage
@@ -478,9 +473,9 @@
     message.messageType = ET_QUIT;
     
     for (IRCChannel *channel in [message.client channels]) {
-        IRCUser *userOnChannel = [IRCUser fromNickname:message.sender.nick onChannel:channel];
+        IRCUser *userOnChannel = [channel userWithNickname:message.sender.nick];
         if (userOnChannel) {
-            [channel removeUserByName:[userOnChannel nick]];
+            [channel removeUser:userOnChannel];
             
             /* Create an IRCMessage object and add it to the chat buffer. */
             IRCMessage *quitMessage = [message copy];
@@ -490,14 +485,13 @@
         }
     }
     
-    for (IRCConversation *conversation in [message.client queries]) {
-        if ([[conversation name] isEqualToStringCaseInsensitive:message.sender.nick]) {
-            conversation.conversationPartnerIsOnline = NO;
-            IRCMessage *quitMessage = [message copy];
-            quitMessage.conversation = conversation;
-            
-            [conversation addMessageToConversation:quitMessage];
-        }
+    IRCConversation *query = [message.client conversationWithName:message.sender.nick];
+    if (query && [query isKindOfClass:[IRCChannel class]] == NO) {
+        query.conversationPartnerIsOnline = NO;
+        IRCMessage *quitMessage = [message copy];
+        quitMessage.conversation = query;
+        
+        [query addMessageToConversation:quitMessage];
     }
 }
 
@@ -526,10 +520,12 @@
                     if ([modeComponents count] >= componentIndex - 1) {
                         NSString *nickname = [modeComponents objectAtIndex:componentIndex];
                         
-                        IRCUser *user = [IRCUser fromNickname:nickname onChannel:channel];
+                        IRCUser *user = [channel userWithNickname:nickname];
                         if (user != nil) {
-                            [user setPrivilegeMode:modes granted:isGrantedMode];
-                            [channel sortUserlist];                            
+                            const char *mode = modes;
+                            [channel modifyUser:user withChanges:^{
+                                [user setPrivilegeMode:mode granted:isGrantedMode];
+                            }];
                         }
                     }
                     componentIndex++;
@@ -594,6 +590,12 @@
 + (void)clientReceivedISONResponse:(IRCMessage *)message
 {
     NSArray *users = [message.message componentsSeparatedByString:@" "];
+    
+    /* The queries may have been asked for in more than one ISON, wait until all of them have been answered. */
+    users = [message.client onlineNicknamesAfterISONReply:users];
+    if (users == nil)
+        return;
+    
     dispatch_async(dispatch_get_main_queue(), ^{
         [[NSNotificationCenter defaultCenter] postNotificationName:@"receivedISONResponse" object:users];
     });
@@ -621,32 +623,43 @@
     }
     
     if ([message.client.queries count] > 0) {
-        [NSTimer scheduledTimerWithTimeInterval:30.0
-                                         target:message.client
-                                       selector:@selector(validateQueryStatusOnAllItems)
-                                       userInfo:nil
-                                        repeats:NO];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [NSTimer scheduledTimerWithTimeInterval:30.0
+                                             target:message.client
+                                           selector:@selector(validateQueryStatusOnAllItems)
+                                           userInfo:nil
+                                            repeats:NO];
+        });
     }
     
 }
 
-+ (void)clientReceivedWHOReply:(IRCMessage *)message
+/*!
+ *    @brief  Copy the channel privileges of one user onto another.
+ *
+ *    @param user      The user to set the privileges on.
+ *    @param otherUser The user to copy the privileges from.
+ */
++ (void)setChannelPrivilegesOfUser:(IRCUser *)user fromUser:(IRCUser *)otherUser
+{
+    user.ircop = otherUser.ircop;
+    user.owner = otherUser.owner;
+    user.admin = otherUser.admin;
+    user.op = otherUser.op;
+    user.halfop = otherUser.halfop;
+    user.voice = otherUser.voice;
+}
+
+/*!
+ *    @brief  Set the away status and channel privileges of a user from the flags field of a WHO reply.
+ *
+ *    @param modes  The flags field, such as "H*@".
+ *    @param user   The user to set the flags on.
+ *    @param client The client the reply was received on.
+ */
++ (void)setWHOReplyFlags:(NSString *)modes onUser:(IRCUser *)user onClient:(IRCClient *)client
 {
-    NSMutableArray *messageComponents = [[message.message componentsSeparatedByString:@" "] mutableCopy];
-    NSString *username  = [messageComponents objectAtIndex:0];
-    NSString *hostname  = [messageComponents objectAtIndex:1];
-    NSString *nickname  = [messageComponents objectAtIndex:3];
-    NSString *modes     = [messageComponents objectAtIndex:4];
-    
-	NSString *realname  = [messageComponents componentsJoinedByString:@" " fromIndex:6];
-    
-    IRCChannel *ircChannel = [IRCChannel fromString:message.conversation.name withClient:message.client];
-    IRCUser *user = [IRCUser fromNickname:nickname onChannel:ircChannel];
-    if (user == nil) {
-        user = [[IRCUser alloc] initWithNickname:nickname andUsername:username andHostname:hostname andRealname:realname onClient:message.client];
-    }
-    
-    if (IRCv3CapabilityEnabled(message.client, @"away-notify")) {
+    if (IRCv3CapabilityEnabled(client, @"away-notify")) {
         user.isAway = ([modes hasPrefix:@"G"]);
     }
     
@@ -662,23 +675,60 @@
         
         #define matchesUserMode(x, y) ([mode isEqualToString:[[x userModeCharacters] objectForKey:(y)]])
         
-        if (matchesUserMode(message.client, @"y")) {
+        if (matchesUserMode(client, @"y")) {
             user.ircop = YES;
-        } else if (matchesUserMode(message.client, @"q")) {
+        } else if (matchesUserMode(client, @"q")) {
             user.owner = YES;
-        } else if (matchesUserMode(message.client, @"a")) {
+        } else if (matchesUserMode(client, @"a")) {
             user.admin = YES;
-        } else if (matchesUserMode(message.client, @"o")) {
+        } else if (matchesUserMode(client, @"o")) {
             user.op = YES;
-        } else if (matchesUserMode(message.client, @"h")) {
+        } else if (matchesUserMode(client, @"h")) {
             user.halfop = YES;
-        } else if (matchesUserMode(message.client, @"v")) {
+        } else if (matchesUserMode(client, @"v")) {
             user.voice = YES;
         }
     }
-    [ircChannel removeUserByName:nickname];
-    [[ircChannel users] addObject:user];
-    [ircChannel sortUserlist];
+}
+
++ (void)clientReceivedWHOReply:(IRCMessage *)message
+{
+    NSMutableArray *messageComponents = [[message.message componentsSeparatedByString:@" "] mutableCopy];
+    NSString *username  = [messageComponents objectAtIndex:0];
+    NSString *hostname  = [messageComponents objectAtIndex:1];
+    NSString *nickname  = [messageComponents objectAtIndex:3];
+    NSString *modes     = [messageComponents objectAtIndex:4];
+    
+	NSString *realname  = [messageComponents componentsJoinedByString:@" " fromIndex:6];
+    
+    /* The reply is staged and applied to the userlist as a whole once RPL_ENDOFWHO arrives. */
+    IRCChannel *ircChannel = [message.client channelWithName:message.conversation.name];
+    IRCUser *user = [[IRCUser alloc] initWithNickname:nickname andUsername:username andHostname:hostname andRealname:realname onClient:message.client];
+    [Messages setWHOReplyFlags:modes onUser:user onClient:message.client];
+    [ircChannel stageUser:user fromReply:USERLIST_REPLY_WHO];
+}
+
++ (void)clientReceivedWHOEndReply:(IRCMessage *)message
+{
+    IRCChannel *ircChannel = [message.client channelWithName:message.conversation.name];
+    BOOL awayNotifyEnabled = IRCv3CapabilityEnabled(message.client, @"away-notify");
+    
+    /* The user may only be known from a NAMES reply so far, fill in the rest of the details */
+    [ircChannel commitStagedUsersFromReply:USERLIST_REPLY_WHO replacingUserlist:NO merge:^(IRCUser *user, IRCUser *stagedUser) {
+        user.username = stagedUser.username;
+        user.hostname = stagedUser.hostname;
+        user.realname = stagedUser.realname;
+        if (awayNotifyEnabled) {
+            user.isAway = stagedUser.isAway;
+        }
+        [Messages setChannelPrivilegesOfUser:user fromUser:stagedUser];
+    }];
+    
+    /* A WHO for a nickname or a mask lists users under whichever channel the server picks, and only ends for the
+     nickname or mask. Those lines are not a complete list of any channel, so they are not applied. */
+    for (IRCChannel *channel in message.client.channels) {
+        [channel discardStagedUsersFromReply:USERLIST_REPLY_WHO];
+    }
 }
 
 + (void)clientReceivedNAMEReply:(IRCMessage *)message
@@ -687,7 +737,8 @@
     NSString *channel = [messageComponents objectAtIndex:0];
     NSString *nicks = [[[messageComponents componentsJoinedByString:@" " fromIndex:2] substringFromIndex:1] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
     
-    IRCChannel *ircChannel = [IRCChannel fromString:channel withClient:message.client];
+    IRCChannel *ircChannel = [message.client channelWithName:channel];
+    if (ircChannel == nil) return;
 
     IRCUser *user;
     for (NSString *nick in [nicks componentsSeparatedByString:@" "]) {
@@ -720,13 +771,21 @@
         
         }
         
-        if ([ircChannel hasUserWithNick:user.nick] == NO) {
-            [ircChannel.users addObject:user];
+        /* The reply is staged and replaces the userlist as a whole once RPL_ENDOFNAMES arrives. */
+        if ([ircChannel stagedUserWithNickname:user.nick fromReply:USERLIST_REPLY_NAMES] == nil) {
+            [ircChannel stageUser:user fromReply:USERLIST_REPLY_NAMES];
         }
     }
+}
+
++ (void)clientReceivedNAMESEndReply:(IRCMessage *)message
+{
+    IRCChannel *ircChannel = [message.client channelWithName:message.conversation.name];
     
-    [ircChannel sortUserlist];
-    
+    /* Users that are already known keep their details, only their privileges are taken from the reply. */
+    [ircChannel commitStagedUsersFromReply:USERLIST_REPLY_NAMES replacingUserlist:YES merge:^(IRCUser *user, IRCUser *stagedUser) {
+        [Messages setChannelPrivilegesOfUser:user fromUser:stagedUser];
+    }];
 }
 
 + (void)clientReceivedLISTReply:(IRCMessage *)message
@@ -781,12 +840,11 @@
     message.messageType = ET_AWAY;
     
     for (IRCChannel *channel in [message.client channels]) {
-        IRCUser *userOnChannel = [IRCUser fromNickname:message.sender.nick onChannel:channel];
+        IRCUser *userOnChannel = [channel userWithNickname:message.sender.nick];
         if (userOnChannel) {
-            userOnChannel.isAway = userIsAway;
-            [channel removeUserByName:[userOnChannel nick]];
-            [channel.users addObject:userOnChannel];
-            [channel sortUserlist];
+            [channel modifyUser:userOnChannel withChanges:^{
+                userOnChannel.isAway = userIsAway;
+            }];
             
             dispatch_async(dispatch_get_main_queue(), ^{
                 [[NSNotificationCenter defaultCenter] postNotificationName:@"messageReceived" object:message];
@@ -820,7 +878,7 @@
 
 + (void)checkForNickServAuth:(IRCMessage *)message
 {
-    if ([message.sender.nick isEqualToStringCaseInsensitive:@"nickserv"]) {
+    if ([message.sender.nick isEqualToName:@"nickserv" onClient:message.client]) {
         if ([message.message rangeOfString:@"authenticate"].location != NSNotFound ||
             [message.message rangeOfString:@"choose a different nickname"].location != NSNotFound ||
             [message.message rangeOfString:@"please choose a different nick"].location != NSNotFound ||
@@ -29,7 +29,7 @@
  */
 
 #import "IRCMessage.h"
-#import "AppPreferences.h"
+#import "IRCMessageResolver.h"
 
 @implementation IRCMessage
 
@@ -100,55 +100,24 @@
         return user.fullhostmask;
     }
 
-    return instanceValue;
+    return [super serializedDatabaseRepresentationOfValue:instanceValue forPropertyNamed:propertyName];
 }
 
 - (id)unserializedRepresentationOfDatabaseValue:(id)databaseValue forPropertyNamed:(NSString *)propertyName
 {
     
-    if ([propertyName isEqualToString:@"client"]) {
-        NSDictionary *prefs = [[AppPreferences sharedPrefs] preferences];
-        NSArray *connections = prefs[@"configurations"];
-        for (NSDictionary *dict in connections) {
-            if ([dict[@"uniqueIdentifier"] isEqualToString:databaseValue]) {
-                IRCConnectionConfiguration *config = [[IRCConnectionConfiguration alloc] initWithDictionary:dict];
-                return [[IRCClient alloc] initWithConfiguration:config];
-            }
-        }
-        return nil;
-    }
-    
-    if ([propertyName isEqualToString:@"conversation"]) {
-        NSDictionary *prefs = [[AppPreferences sharedPrefs] preferences];
-        NSArray *connections = prefs[@"configurations"];
-        for (NSDictionary *dict in connections) {
-            for (NSDictionary *channel in dict[@"channels"]) {
-                if ([channel[@"uniqueIdentifier"] isEqualToString:databaseValue]) {
-                    IRCChannelConfiguration *config = [[IRCChannelConfiguration alloc] initWithDictionary:channel];
-                    return [[IRCChannel alloc] initWithConfiguration:config withClient:self.client];
-                }
-                
-            }
-            for (NSDictionary *query in dict[@"queries"]) {
-                if ([query[@"uniqueIdentifier"] isEqualToString:databaseValue]) {
-                    IRCChannelConfiguration *config = [[IRCChannelConfiguration alloc] initWithDictionary:query];
-                    return [[IRCConversation alloc] initWithConfiguration:config withClient:self.client];
-                }
-            }
-
-        }
-        return nil;
-    }
-    
-    if ([propertyName isEqualToString:@"sender"] || [propertyName isEqualToString:@"kickedUser"]) {
-        NSString *fullhost = (NSString *)databaseValue;
-        if (fullhost.length) {
-            NSArray *components = [fullhost componentsSeparatedByString:@"@"];
-            NSString *nick = [components[0] componentsSeparatedByString:@"!"][0];
-            NSString *user = [components[0] componentsSeparatedByString:@"!"][0];
-            NSString *host = components[1];
-            return [[IRCUser alloc] initWithNickname:nick andUsername:user andHostname:host andRealname:@"" onClient:self.client];
-        }
+    /* Rows resolve to the clients and conversations that are already open instead of building new ones from the preferences.
+     IRCMessageStore loads them with the conversation identifier and the hostmasks in place of the numbers they are stored under. */
+    if ([propertyName isEqualToString:@"client"] || [propertyName isEqualToString:@"conversation"] ||
+        [propertyName isEqualToString:@"sender"] || [propertyName isEqualToString:@"kickedUser"]) {
+        if ([databaseValue isKindOfClass:NSString.class] == NO)
+            return nil;
+        
+        if ([propertyName isEqualToString:@"client"])
+            return [[IRCMessageResolver sharedResolver] clientWithIdentifier:databaseValue];
+        if ([propertyName isEqualToString:@"conversation"])
+            return [[IRCMessageResolver sharedResolver] conversationWithIdentifier:databaseValue onClient:self.client];
+        return [[IRCMessageResolver sharedResolver] userWithHostmask:databaseValue onClient:self.client];
     }
 
     if ([propertyName isEqualToString:@"timestamp"]) {
@@ -157,6 +126,10 @@
         }
     }
     
+    if ([propertyName isEqualToString:@"tags"]) {
+        return databaseValue ? [super unserializedRepresentationOfDatabaseValue:databaseValue forPropertyNamed:propertyName] : nil;
+    }
+    
     return databaseValue;
 }
 
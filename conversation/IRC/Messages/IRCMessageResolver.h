@@ -0,0 +1,79 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class IRCClient;
+@class IRCConversation;
+@class IRCUser;
+
+/*!
+ *    @brief  Turns the identifiers and hostmasks stored with a message back into objects when it is loaded from the database.
+ *            Clients and conversations resolve to the live objects, senders are interned so every row from the same hostmask shares one user.
+ */
+@interface IRCMessageResolver : NSObject
+
++ (instancetype)sharedResolver;
+
+/*!
+ *    @brief  Make a client known to the resolver, it is forgotten again when it is deallocated.
+ */
+- (void)registerClient:(IRCClient *)client;
+
+/*!
+ *    @brief  Get the live client with a configuration identifier.
+ *
+ *    @param identifier The unique identifier of the connection configuration.
+ *
+ *    @return The client, or nil if there is no client with this identifier.
+ */
+- (IRCClient *)clientWithIdentifier:(NSString *)identifier;
+
+/*!
+ *    @brief  Get the live channel or query with a configuration identifier.
+ *
+ *    @param identifier The unique identifier of the conversation configuration.
+ *    @param client     The client of the conversation, or nil to look on every client.
+ *
+ *    @return The conversation, or nil if there is no conversation with this identifier.
+ */
+- (IRCConversation *)conversationWithIdentifier:(NSString *)identifier onClient:(IRCClient *)client;
+
+/*!
+ *    @brief  Get the user for a stored hostmask.
+ *
+ *    @param hostmask A hostmask in the form nickname!username@hostname.
+ *    @param client   The client the message was received on.
+ *
+ *    @return The interned user of this hostmask, or nil if the hostmask is empty.
+ */
+- (IRCUser *)userWithHostmask:(NSString *)hostmask onClient:(IRCClient *)client;
+
+@end
@@ -0,0 +1,136 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "IRCMessageResolver.h"
+#import "IRCClient.h"
+#import "IRCConversation.h"
+#import "IRCUser.h"
+
+#define MESSAGE_RESOLVER_USER_LIMIT 2000
+
+@implementation IRCMessageResolver {
+    NSHashTable *_clients;
+    NSCache *_users;
+}
+
++ (instancetype)sharedResolver
+{
+    static IRCMessageResolver *sharedResolver;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedResolver = [[IRCMessageResolver alloc] init];
+    });
+    return sharedResolver;
+}
+
+- (instancetype)init
+{
+    if ((self = [super init])) {
+        _clients = [NSHashTable weakObjectsHashTable];
+        _users = [[NSCache alloc] init];
+        _users.countLimit = MESSAGE_RESOLVER_USER_LIMIT;
+    }
+    return self;
+}
+
+- (void)registerClient:(IRCClient *)client
+{
+    @synchronized(_clients) {
+        [_clients addObject:client];
+    }
+}
+
+- (IRCClient *)clientWithIdentifier:(NSString *)identifier
+{
+    if (identifier.length == 0)
+        return nil;
+    
+    /* There are only ever a handful of clients, the configuration of one may be replaced while it lives. */
+    @synchronized(_clients) {
+        for (IRCClient *client in _clients) {
+            if ([client.configuration.uniqueIdentifier isEqualToString:identifier])
+                return client;
+        }
+    }
+    return nil;
+}
+
+- (IRCConversation *)conversationWithIdentifier:(NSString *)identifier onClient:(IRCClient *)client
+{
+    if (identifier.length == 0)
+        return nil;
+    
+    if (client)
+        return [client conversationWithIdentifier:identifier];
+    
+    NSArray *clients;
+    @synchronized(_clients) {
+        clients = _clients.allObjects;
+    }
+    for (IRCClient *client in clients) {
+        IRCConversation *conversation = [client conversationWithIdentifier:identifier];
+        if (conversation)
+            return conversation;
+    }
+    return nil;
+}
+
+- (IRCUser *)userWithHostmask:(NSString *)hostmask onClient:(IRCClient *)client
+{
+    if (hostmask.length == 0)
+        return nil;
+    
+    /* Users from history are never changed, and IRCUser does not keep its client, so one object can stand for a hostmask everywhere. */
+    IRCUser *user = [_users objectForKey:hostmask];
+    if (user)
+        return user;
+    
+    NSString *nickname = hostmask;
+    NSString *username = @"";
+    NSString *hostname = @"";
+    
+    NSRange hostSeparator = [hostmask rangeOfString:@"@" options:NSBackwardsSearch];
+    if (hostSeparator.location != NSNotFound) {
+        hostname = [hostmask substringFromIndex:hostSeparator.location + 1];
+        nickname = [hostmask substringToIndex:hostSeparator.location];
+    }
+    
+    NSRange userSeparator = [nickname rangeOfString:@"!"];
+    if (userSeparator.location != NSNotFound) {
+        username = [nickname substringFromIndex:userSeparator.location + 1];
+        nickname = [nickname substringToIndex:userSeparator.location];
+    }
+    
+    user = [[IRCUser alloc] initWithNickname:nickname andUsername:username andHostname:hostname andRealname:@"" onClient:client];
+    [_users setObject:user forKey:hostmask];
+    return user;
+}
+
+@end
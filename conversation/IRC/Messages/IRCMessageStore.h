@@ -0,0 +1,135 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class IRCMessage;
+@class FMDatabase;
+
+/*!
+ *    @brief  Writes the chat history to the message database on a background queue.
+ *            Messages are collected as they arrive and written in batches, one transaction per batch,
+ *            so there is nothing left to save when the application is suspended.
+ */
+@interface IRCMessageStore : NSObject
+
+/*!
+ *    @brief  The number of messages kept in the database for each conversation.
+ */
+@property (atomic, assign) NSUInteger historyLimit;
+
++ (instancetype)sharedStore;
+
+/*!
+ *    @brief  Switch a newly opened database to write-ahead logging, so reads can run while a batch is being written.
+ *
+ *    @param db The database to configure, before any schema changes are made to it.
+ */
++ (void)configureDatabase:(FMDatabase *)db;
+
+/*!
+ *    @brief  Open a second, read-only connection to the database for loading and searching history.
+ *            Until it is open, reads share the connection used for writing.
+ *
+ *    @param path The path of the database file, after it has been opened by FCModel.
+ */
+- (void)openSnapshotReaderAtPath:(NSString *)path;
+
+/*!
+ *    @brief  Queue a message to be written to the database with the next batch.
+ *            Once the batch is committed the message is given the id of its row on the main thread.
+ *
+ *    @param message The message to store. Its values are copied right away, so later changes to it are not stored.
+ */
+- (void)appendMessage:(IRCMessage *)message;
+
+/*!
+ *    @brief  Load a page of the stored history of a conversation, newest first. Pages walk back by timestamp and id,
+ *            pass the values of the last message of one page to get the next one.
+ *
+ *    @param identifier The unique identifier of the conversation.
+ *    @param timestamp  Only load messages older than this time, as seconds since 1970.
+ *    @param messageId  Also load messages at exactly this time with a lower id.
+ *    @param limit      The number of messages to load.
+ *
+ *    @return The messages, marked as conversation history.
+ */
+- (NSArray *)messagesInConversation:(NSString *)identifier before:(NSTimeInterval)timestamp messageId:(int64_t)messageId limit:(NSUInteger)limit;
+
+/*!
+ *    @brief  Load a page of the stored history of a conversation on the snapshot reader without blocking the calling thread.
+ *
+ *    @param identifier The unique identifier of the conversation.
+ *    @param timestamp  Only load messages older than this time, as seconds since 1970.
+ *    @param messageId  Also load messages at exactly this time with a lower id.
+ *    @param limit      The number of messages to load.
+ *    @param completion Called on the main thread with the messages, newest first and marked as conversation history.
+ */
+- (void)messagesInConversation:(NSString *)identifier before:(NSTimeInterval)timestamp messageId:(int64_t)messageId limit:(NSUInteger)limit completion:(void (^)(NSArray *messages))completion;
+
+/*!
+ *    @brief  Delete the stored history of a conversation. This is written in order with the queued messages,
+ *            so messages appended before it are deleted as well and messages appended after it are kept.
+ *
+ *    @param identifier The unique identifier of the conversation.
+ */
+- (void)removeMessagesInConversation:(NSString *)identifier;
+
+/*!
+ *    @brief  Delete the stored history of every conversation that no longer exists.
+ *
+ *    @param identifiers The unique identifiers of the conversations to keep.
+ */
+- (void)removeMessagesNotInConversations:(NSArray *)identifiers;
+
+/*!
+ *    @brief  Search the text of the stored history, best matches first.
+ *            Messages still waiting to be written are written before searching.
+ *
+ *    @param text                   The words to look for, a message matches when it contains all of them.
+ *    @param conversationIdentifier The unique identifier of the conversation to search, or nil to search more than one.
+ *    @param clientIdentifier       The unique identifier of the network to search, or nil to search every network.
+ *    @param offset                 The number of results to skip, for fetching the next page.
+ *    @param limit                  The number of results to return.
+ *    @param completion             Called on the main thread with the ids of the matching messages as NSNumber objects.
+ */
+- (void)searchForText:(NSString *)text inConversation:(NSString *)conversationIdentifier onClient:(NSString *)clientIdentifier offset:(NSUInteger)offset limit:(NSUInteger)limit completion:(void (^)(NSArray *messageIds))completion;
+
+/*!
+ *    @brief  Write any queued messages now instead of waiting for the next batch.
+ */
+- (void)flush;
+
+/*!
+ *    @brief  Write any queued messages and wait until they are in the database, such as when the application terminates.
+ */
+- (void)flushAndWait;
+
+@end
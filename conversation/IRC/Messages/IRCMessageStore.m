@@ -0,0 +1,637 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <FCModel/FCModel.h>
+#import <FMDB/FMDatabase.h>
+#import "IRCMessageStore.h"
+#import "IRCMessage.h"
+#import "IRCClient.h"
+#import "IRCUser.h"
+
+#define MESSAGE_STORE_FLUSH_INTERVAL 1.0
+#define MESSAGE_STORE_FLUSH_THRESHOLD 500
+#define MESSAGE_STORE_BATCH_SIZE 50
+#define MESSAGE_STORE_WRITE_ATTEMPTS 5
+#define MESSAGE_STORE_COLUMN_COUNT 8
+#define MESSAGE_STORE_DEFAULT_HISTORY_LIMIT 20
+#define MESSAGE_STORE_SENDER_KEY_LIMIT 5000
+#define MESSAGE_STORE_WAL_CHECKPOINT_PAGES 1000
+#define MESSAGE_STORE_WAL_SIZE_LIMIT (4 * 1024 * 1024)
+
+/* The values of a queued message, in the order they are captured by rowForMessage:. */
+typedef NS_ENUM(NSUInteger, IRCMessageStoreField) {
+    MSF_CONVERSATION,
+    MSF_CLIENT,
+    MSF_TIMESTAMP,
+    MSF_MESSAGE_TYPE,
+    MSF_SENDER,
+    MSF_KICKED_USER,
+    MSF_MESSAGE,
+    MSF_TAGS,
+    MSF_IS_SERVER_MESSAGE,
+    MSF_SOURCE      /* The message itself, which is given its row id once the batch is committed. Rows built elsewhere may leave it out. */
+};
+
+/*!
+ *    @brief  Rank a search result from the 'pcx' matchinfo of IRCMessageSearch. Every phrase adds the share of all its hits
+ *            that are in this message, so rare words weigh more than common ones and repeated words more than single ones.
+ */
+static void IRCMessageSearchRank(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+    const unsigned int *matchinfo = sqlite3_value_blob(argv[0]);
+    int size = sqlite3_value_bytes(argv[0]) / sizeof(unsigned int);
+    if (matchinfo == NULL || size < 2) {
+        sqlite3_result_double(context, 0.0);
+        return;
+    }
+    
+    unsigned int phrases = matchinfo[0];
+    unsigned int columns = matchinfo[1];
+    if (size < 2 + 3 * phrases * columns) {
+        sqlite3_result_double(context, 0.0);
+        return;
+    }
+    
+    double score = 0.0;
+    for (unsigned int phrase = 0; phrase < phrases; phrase++) {
+        for (unsigned int column = 0; column < columns; column++) {
+            const unsigned int *hits = &matchinfo[2 + 3 * (phrase * columns + column)];
+            if (hits[0] > 0 && hits[1] > 0)
+                score += (double)hits[0] / (double)hits[1];
+        }
+    }
+    sqlite3_result_double(context, score);
+}
+
+/*!
+ *    @brief  A change queued with the messages, run on the database queue inside the transaction of the batch it is written with.
+ */
+typedef BOOL (^IRCMessageStoreWrite)(FMDatabase *db);
+
+@implementation IRCMessageStore {
+    dispatch_queue_t _queue;
+    dispatch_queue_t _snapshotQueue;
+    FMDatabase *_snapshotDatabase;
+    sqlite3 *_rankedDatabase;
+    NSMutableArray *_pendingRows;
+    NSMutableArray *_insertedMessages;
+    BOOL _flushScheduled;
+    NSUInteger _failedWrites;
+    NSString *_insertStatement;
+    NSString *_batchInsertStatement;
+    NSMutableDictionary *_conversationKeys;
+    NSCache *_senderKeys;
+}
+
++ (instancetype)sharedStore
+{
+    static IRCMessageStore *sharedStore;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedStore = [[IRCMessageStore alloc] init];
+    });
+    return sharedStore;
+}
+
+- (instancetype)init
+{
+    if ((self = [super init])) {
+        _queue = dispatch_queue_create("conversation.messagestore", DISPATCH_QUEUE_SERIAL);
+        _snapshotQueue = dispatch_queue_create("conversation.messagestore.snapshot", DISPATCH_QUEUE_SERIAL);
+        _pendingRows = [[NSMutableArray alloc] init];
+        _insertedMessages = [[NSMutableArray alloc] init];
+        _historyLimit = MESSAGE_STORE_DEFAULT_HISTORY_LIMIT;
+        _conversationKeys = [[NSMutableDictionary alloc] init];
+        _senderKeys = [[NSCache alloc] init];
+        _senderKeys.countLimit = MESSAGE_STORE_SENDER_KEY_LIMIT;
+        
+        /* The id is left out so SQLite hands out increasing row ids, which lets us trim a conversation by id alone. */
+        NSString *columns = @"conversation, timestamp, messageType, sender, kickedUser, message, tags, isServerMessage";
+        NSMutableArray *placeholders = [[NSMutableArray alloc] init];
+        for (int i = 0; i < MESSAGE_STORE_COLUMN_COUNT; i++) {
+            [placeholders addObject:@"?"];
+        }
+        NSString *values = [NSString stringWithFormat:@"(%@)", [placeholders componentsJoinedByString:@", "]];
+        
+        NSMutableArray *batchValues = [[NSMutableArray alloc] init];
+        for (int i = 0; i < MESSAGE_STORE_BATCH_SIZE; i++) {
+            [batchValues addObject:values];
+        }
+        
+        _insertStatement = [NSString stringWithFormat:@"INSERT INTO IRCMessage (%@) VALUES %@", columns, values];
+        _batchInsertStatement = [NSString stringWithFormat:@"INSERT INTO IRCMessage (%@) VALUES %@", columns, [batchValues componentsJoinedByString:@", "]];
+    }
+    return self;
+}
+
++ (void)configureDatabase:(FMDatabase *)db
+{
+    /* journal_mode answers with the mode it ended up in, so it has to be run as a query. */
+    FMResultSet *result = [db executeQuery:@"PRAGMA journal_mode = WAL"];
+    if ([result next] && [[result stringForColumnIndex:0] isEqualToString:@"wal"] == NO)
+        NSLog(@"Message database is not using write-ahead logging: %@", [result stringForColumnIndex:0]);
+    [result close];
+    
+    /* With WAL a commit only needs the log written, syncing is left to checkpoints. A crash may lose the last batch but never corrupts the database. */
+    [db executeStatements:[NSString stringWithFormat:@"PRAGMA synchronous = NORMAL; PRAGMA wal_autocheckpoint = %d; PRAGMA journal_size_limit = %d;",
+                           MESSAGE_STORE_WAL_CHECKPOINT_PAGES, MESSAGE_STORE_WAL_SIZE_LIMIT]];
+}
+
+- (void)openSnapshotReaderAtPath:(NSString *)path
+{
+    dispatch_sync(_snapshotQueue, ^{
+        [_snapshotDatabase close];
+        
+        _snapshotDatabase = [FMDatabase databaseWithPath:path];
+        if ([_snapshotDatabase openWithFlags:SQLITE_OPEN_READONLY] == NO) {
+            NSLog(@"Failed to open a snapshot reader on the message database, code %d: %@", _snapshotDatabase.lastErrorCode, _snapshotDatabase.lastErrorMessage);
+            _snapshotDatabase = nil;
+        }
+        _snapshotDatabase.shouldCacheStatements = YES;
+    });
+}
+
+/*!
+ *    @brief  Run a read on the snapshot reader. It has its own connection, so in WAL mode it sees the last committed
+ *            state of the database and never waits for a batch that is being written.
+ */
+- (void)readSnapshot:(void (^)(FMDatabase *db))block
+{
+    dispatch_sync(_snapshotQueue, ^{
+        [self readSnapshotOnQueue:block];
+    });
+}
+
+/*!
+ *    @brief  Run a read on the snapshot reader without waiting for it.
+ */
+- (void)readSnapshotAsync:(void (^)(FMDatabase *db))block
+{
+    dispatch_async(_snapshotQueue, ^{
+        [self readSnapshotOnQueue:block];
+    });
+}
+
+- (void)readSnapshotOnQueue:(void (^)(FMDatabase *db))block
+{
+    if (_snapshotDatabase) {
+        block(_snapshotDatabase);
+    } else {
+        [FCModel inDatabaseSync:block];
+    }
+}
+
++ (NSArray *)rowForMessage:(IRCMessage *)message
+{
+    IRCClient *client = message.client ? message.client : message.conversation.client;
+    NSDate *timestamp = message.timestamp ? message.timestamp : [NSDate date];
+    
+    /* Tags are a binary property list, the same way FCModel stores dictionaries. */
+    NSData *tags = nil;
+    if (message.tags.count > 0)
+        tags = [NSPropertyListSerialization dataWithPropertyList:message.tags format:NSPropertyListBinaryFormat_v1_0 options:0 error:NULL];
+    
+    return @[message.conversation.configuration.uniqueIdentifier,
+             client.configuration.uniqueIdentifier ? client.configuration.uniqueIdentifier : @"",
+             @([timestamp timeIntervalSince1970]),
+             @(message.messageType),
+             message.sender.fullhostmask ? message.sender.fullhostmask : [NSNull null],
+             message.kickedUser.fullhostmask ? message.kickedUser.fullhostmask : [NSNull null],
+             message.message ? message.message : @"",
+             tags ? tags : [NSNull null],
+             @(message.isServerMessage),
+             message];
+}
+
+/*!
+ *    @brief  Get the number a conversation is stored under, adding it to IRCMessageConversation the first time. Runs on the database queue.
+ */
+- (NSNumber *)keyForConversation:(NSString *)identifier client:(NSString *)clientIdentifier inDatabase:(FMDatabase *)db
+{
+    NSNumber *key = _conversationKeys[identifier];
+    if (key)
+        return key;
+    
+    if ([db executeUpdate:@"INSERT OR IGNORE INTO IRCMessageConversation (identifier, client) VALUES (?, ?)", identifier, clientIdentifier] == NO)
+        return nil;
+    
+    FMResultSet *result = [db executeQuery:@"SELECT id FROM IRCMessageConversation WHERE identifier = ?", identifier];
+    if ([result next])
+        key = @([result longLongIntForColumnIndex:0]);
+    [result close];
+    
+    if (key)
+        _conversationKeys[identifier] = key;
+    return key;
+}
+
+/*!
+ *    @brief  Get the number a hostmask is stored under, adding it to IRCMessageSender the first time. Runs on the database queue.
+ */
+- (id)keyForHostmask:(id)hostmask inDatabase:(FMDatabase *)db
+{
+    if (hostmask == [NSNull null] || [hostmask length] == 0)
+        return [NSNull null];
+    
+    NSNumber *key = [_senderKeys objectForKey:hostmask];
+    if (key)
+        return key;
+    
+    if ([db executeUpdate:@"INSERT OR IGNORE INTO IRCMessageSender (hostmask) VALUES (?)", hostmask] == NO)
+        return nil;
+    
+    FMResultSet *result = [db executeQuery:@"SELECT id FROM IRCMessageSender WHERE hostmask = ?", hostmask];
+    if ([result next])
+        key = @([result longLongIntForColumnIndex:0]);
+    [result close];
+    
+    if (key)
+        [_senderKeys setObject:key forKey:hostmask];
+    return key;
+}
+
+- (NSArray *)messagesInConversation:(NSString *)identifier before:(NSTimeInterval)timestamp messageId:(int64_t)messageId limit:(NSUInteger)limit
+{
+    if (identifier == nil || [FCModel databaseIsOpen] == NO)
+        return @[];
+    
+    __block NSArray *messages = nil;
+    [self readSnapshot:^(FMDatabase *db) {
+        messages = [self messagesInConversation:identifier before:timestamp messageId:messageId limit:limit inDatabase:db];
+    }];
+    return messages;
+}
+
+- (void)messagesInConversation:(NSString *)identifier before:(NSTimeInterval)timestamp messageId:(int64_t)messageId limit:(NSUInteger)limit completion:(void (^)(NSArray *messages))completion
+{
+    if (identifier == nil || [FCModel databaseIsOpen] == NO) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(@[]);
+        });
+        return;
+    }
+    
+    [self readSnapshotAsync:^(FMDatabase *db) {
+        NSArray *messages = [self messagesInConversation:identifier before:timestamp messageId:messageId limit:limit inDatabase:db];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(messages);
+        });
+    }];
+}
+
+- (NSArray *)messagesInConversation:(NSString *)identifier before:(NSTimeInterval)timestamp messageId:(int64_t)messageId limit:(NSUInteger)limit inDatabase:(FMDatabase *)db
+{
+    /* The stored numbers are joined back to the identifiers and hostmasks IRCMessage resolves to objects. */
+    FMResultSet *result = [db executeQuery:
+                           @"SELECT IRCMessage.id, IRCMessageConversation.identifier AS conversation, IRCMessage.timestamp, IRCMessage.messageType,"
+                           @"       sender.hostmask AS sender, kickedUser.hostmask AS kickedUser, IRCMessage.message, IRCMessage.tags, IRCMessage.isServerMessage"
+                           @"  FROM IRCMessageConversation"
+                           @"  JOIN IRCMessage ON IRCMessage.conversation = IRCMessageConversation.id"
+                           @"  LEFT JOIN IRCMessageSender AS sender ON sender.id = IRCMessage.sender"
+                           @"  LEFT JOIN IRCMessageSender AS kickedUser ON kickedUser.id = IRCMessage.kickedUser"
+                           @" WHERE IRCMessageConversation.identifier = ? AND (IRCMessage.timestamp < ? OR (IRCMessage.timestamp = ? AND IRCMessage.id < ?))"
+                           @" ORDER BY IRCMessage.timestamp DESC, IRCMessage.id DESC LIMIT ?",
+                           identifier, @(timestamp), @(timestamp), @(messageId), @(limit)];
+    NSArray *messages = [IRCMessage instancesFromResultSet:result];
+    [result close];
+    
+    for (IRCMessage *message in messages) {
+        message.isConversationHistory = YES;
+    }
+    return messages ? messages : @[];
+}
+
+- (void)appendMessage:(IRCMessage *)message
+{
+    if (message.conversation.configuration.uniqueIdentifier == nil)
+        return;
+    
+    NSArray *row = [IRCMessageStore rowForMessage:message];
+    dispatch_async(_queue, ^{
+        [self enqueue:row];
+    });
+}
+
+/*!
+ *    @brief  Add a message row or a write to the next batch. Runs on the store queue.
+ */
+- (void)enqueue:(id)operation
+{
+    [_pendingRows addObject:operation];
+    
+    /* After a failed write the retry is left to its own timer, so a busy channel does not use up the attempts at once. */
+    if (_pendingRows.count >= MESSAGE_STORE_FLUSH_THRESHOLD && _failedWrites == 0) {
+        [self writePendingRows];
+    } else {
+        [self scheduleFlushAfter:MESSAGE_STORE_FLUSH_INTERVAL];
+    }
+}
+
+/*!
+ *    @brief  Write the pending rows after a delay, unless a write is already scheduled. Runs on the store queue.
+ */
+- (void)scheduleFlushAfter:(NSTimeInterval)delay
+{
+    if (_flushScheduled)
+        return;
+    
+    _flushScheduled = YES;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), _queue, ^{
+        _flushScheduled = NO;
+        [self writePendingRows];
+    });
+}
+
+- (void)removeMessagesNotInConversations:(NSArray *)identifiers
+{
+    NSMutableArray *placeholders = [[NSMutableArray alloc] initWithCapacity:identifiers.count];
+    for (NSUInteger i = 0; i < identifiers.count; i++) {
+        [placeholders addObject:@"?"];
+    }
+    NSString *removedConversations = [NSString stringWithFormat:@"identifier NOT IN (%@)", [placeholders componentsJoinedByString:@", "]];
+    
+    IRCMessageStoreWrite write = ^BOOL(FMDatabase *db) {
+        /* Hostmasks nobody refers to any more go along with the conversations. */
+        [_conversationKeys removeAllObjects];
+        [_senderKeys removeAllObjects];
+        return [db executeUpdate:[NSString stringWithFormat:@"DELETE FROM IRCMessage WHERE conversation IN (SELECT id FROM IRCMessageConversation WHERE %@)", removedConversations] withArgumentsInArray:identifiers] &&
+               [db executeUpdate:[NSString stringWithFormat:@"DELETE FROM IRCMessageConversation WHERE %@", removedConversations] withArgumentsInArray:identifiers] &&
+               [db executeUpdate:@"DELETE FROM IRCMessageSender WHERE id NOT IN (SELECT sender FROM IRCMessage WHERE sender IS NOT NULL UNION SELECT kickedUser FROM IRCMessage WHERE kickedUser IS NOT NULL)"];
+    };
+    
+    dispatch_async(_queue, ^{
+        [self enqueue:write];
+    });
+}
+
+- (void)removeMessagesInConversation:(NSString *)identifier
+{
+    if (identifier == nil)
+        return;
+    
+    IRCMessageStoreWrite write = ^BOOL(FMDatabase *db) {
+        return [db executeUpdate:@"DELETE FROM IRCMessage WHERE conversation = (SELECT id FROM IRCMessageConversation WHERE identifier = ?)", identifier];
+    };
+    
+    /* Writes run in the order they were queued, so messages that arrived before this are deleted and later ones are kept. */
+    dispatch_async(_queue, ^{
+        [self enqueue:write];
+    });
+}
+
++ (NSString *)searchQueryForText:(NSString *)text
+{
+    /* Every word becomes a quoted phrase, so what the user types is never read as search syntax. */
+    NSMutableArray *phrases = [[NSMutableArray alloc] init];
+    for (NSString *word in [text componentsSeparatedByCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]]) {
+        if (word.length == 0)
+            continue;
+        [phrases addObject:[NSString stringWithFormat:@"\"%@\"", [word stringByReplacingOccurrencesOfString:@"\"" withString:@"\"\""]]];
+    }
+    return [phrases componentsJoinedByString:@" "];
+}
+
+- (void)searchForText:(NSString *)text inConversation:(NSString *)conversationIdentifier onClient:(NSString *)clientIdentifier offset:(NSUInteger)offset limit:(NSUInteger)limit completion:(void (^)(NSArray *messageIds))completion
+{
+    NSString *searchQuery = [IRCMessageStore searchQueryForText:text];
+    
+    dispatch_async(_queue, ^{
+        NSMutableArray *messageIds = [[NSMutableArray alloc] init];
+        
+        if (searchQuery.length > 0 && [FCModel databaseIsOpen]) {
+            [self writePendingRows];
+            
+            NSMutableString *query = [@"SELECT IRCMessage.id FROM IRCMessageSearch JOIN IRCMessage ON IRCMessage.id = IRCMessageSearch.docid WHERE IRCMessageSearch MATCH ?" mutableCopy];
+            NSMutableArray *arguments = [@[searchQuery] mutableCopy];
+            if (conversationIdentifier) {
+                [query appendString:@" AND IRCMessage.conversation = (SELECT id FROM IRCMessageConversation WHERE identifier = ?)"];
+                [arguments addObject:conversationIdentifier];
+            }
+            if (clientIdentifier) {
+                [query appendString:@" AND IRCMessage.conversation IN (SELECT id FROM IRCMessageConversation WHERE client = ?)"];
+                [arguments addObject:clientIdentifier];
+            }
+            [query appendString:@" ORDER BY IRCMessageSearchRank(matchinfo(IRCMessageSearch, 'pcx')) DESC, IRCMessage.timestamp DESC LIMIT ? OFFSET ?"];
+            [arguments addObject:@(limit)];
+            [arguments addObject:@(offset)];
+            
+            [self readSnapshot:^(FMDatabase *db) {
+                if (_rankedDatabase != db.sqliteHandle) {
+                    sqlite3_create_function(db.sqliteHandle, "IRCMessageSearchRank", 1, SQLITE_UTF8, NULL, IRCMessageSearchRank, NULL, NULL);
+                    _rankedDatabase = db.sqliteHandle;
+                }
+                
+                FMResultSet *result = [db executeQuery:query withArgumentsInArray:arguments];
+                while ([result next]) {
+                    [messageIds addObject:@([result longLongIntForColumnIndex:0])];
+                }
+                [result close];
+            }];
+        }
+        
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(messageIds);
+        });
+    });
+}
+
+- (void)flush
+{
+    dispatch_async(_queue, ^{
+        [self writePendingRows];
+    });
+}
+
+- (void)flushAndWait
+{
+    dispatch_sync(_queue, ^{
+        [self writePendingRows];
+    });
+}
+
+- (void)writePendingRows
+{
+    if (_pendingRows.count == 0 || [FCModel databaseIsOpen] == NO)
+        return;
+    
+    NSArray *operations = _pendingRows;
+    _pendingRows = [[NSMutableArray alloc] init];
+    NSUInteger historyLimit = MAX(self.historyLimit, 1);
+    __block BOOL committed = NO;
+    [_insertedMessages removeAllObjects];
+    
+    /* The messages in the transcripts are never saved through FCModel any more, so there are no loaded instances to reload afterwards. */
+    [FCModel inDatabaseSync:^(FMDatabase *db) {
+        /* The handle is shared with FCModel, so statements are only cached while a batch is written, where the same inserts run over and over. */
+        BOOL cachedStatements = db.shouldCacheStatements;
+        db.shouldCacheStatements = YES;
+        [db beginTransaction];
+        
+        NSMutableSet *conversations = [[NSMutableSet alloc] init];
+        BOOL success = [self writeOperations:operations intoConversations:conversations inDatabase:db];
+        
+        /* Keep the newest messages of every conversation we wrote to, everything below the oldest of those goes. */
+        for (NSNumber *conversation in conversations) {
+            if (success == NO)
+                break;
+            
+            FMResultSet *result = [db executeQuery:@"SELECT id FROM IRCMessage WHERE conversation = ? ORDER BY id DESC LIMIT 1 OFFSET ?", conversation, @(historyLimit - 1)];
+            if ([result next]) {
+                long long oldestKept = [result longLongIntForColumnIndex:0];
+                [result close];
+                success = [db executeUpdate:@"DELETE FROM IRCMessage WHERE conversation = ? AND id < ?", conversation, @(oldestKept)];
+            } else {
+                [result close];
+            }
+        }
+        
+        if (success) {
+            committed = [db commit];
+        } else {
+            NSLog(@"Failed to store %lu changes, code %d: %@", (unsigned long)operations.count, db.lastErrorCode, db.lastErrorMessage);
+            [db rollback];
+        }
+        
+        if (committed == NO) {
+            /* Numbers handed out in this transaction are gone again. */
+            [_conversationKeys removeAllObjects];
+            [_senderKeys removeAllObjects];
+        }
+        db.shouldCacheStatements = cachedStatements;
+    }];
+    
+    if (committed) {
+        _failedWrites = 0;
+        
+        /* The transcripts use the row ids to tell messages they already show apart from the same rows read back as history. */
+        NSArray *insertedMessages = _insertedMessages;
+        _insertedMessages = [[NSMutableArray alloc] init];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            for (NSArray *insertedMessage in insertedMessages) {
+                IRCMessage *message = insertedMessage[0];
+                message.id = [insertedMessage[1] longLongValue];
+            }
+        });
+        return;
+    }
+    [_insertedMessages removeAllObjects];
+    
+    /* The whole batch was rolled back, put it back in front of anything queued since and try again a little later.
+     Dropping it would lose messages, and a lost delete would bring cleared history back. */
+    _failedWrites++;
+    if (_failedWrites >= MESSAGE_STORE_WRITE_ATTEMPTS) {
+        NSLog(@"Giving up on %lu changes after %lu attempts", (unsigned long)operations.count, (unsigned long)_failedWrites);
+        _failedWrites = 0;
+        return;
+    }
+    [_pendingRows insertObjects:operations atIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, operations.count)]];
+    [self scheduleFlushAfter:MESSAGE_STORE_FLUSH_INTERVAL * _failedWrites];
+}
+
+/*!
+ *    @brief  Intern and insert the message rows and run the queued writes of a batch, in the order they were queued.
+ *            Runs on the database queue inside the transaction of the batch.
+ *
+ *    @param operations    The message rows and writes of the batch.
+ *    @param conversations Collects the numbers of the conversations that messages were written to.
+ *    @param db            The database to write to.
+ *
+ *    @return Boolean indicating whether every row and write succeeded.
+ */
+- (BOOL)writeOperations:(NSArray *)operations intoConversations:(NSMutableSet *)conversations inDatabase:(FMDatabase *)db
+{
+    /* Runs of message rows are inserted together, queued writes run in between them in the order they came in. */
+    BOOL success = YES;
+    NSMutableArray *values = [[NSMutableArray alloc] init];
+    NSMutableArray *sources = [[NSMutableArray alloc] init];
+    for (id operation in operations) {
+        if (success == NO)
+            break;
+        
+        if ([operation isKindOfClass:NSArray.class]) {
+            NSArray *row = operation;
+            
+            /* Swap the identifiers and hostmasks for the numbers they are stored under. */
+            NSNumber *conversation = [self keyForConversation:row[MSF_CONVERSATION] client:row[MSF_CLIENT] inDatabase:db];
+            id sender = [self keyForHostmask:row[MSF_SENDER] inDatabase:db];
+            id kickedUser = [self keyForHostmask:row[MSF_KICKED_USER] inDatabase:db];
+            if (conversation == nil || sender == nil || kickedUser == nil) {
+                success = NO;
+                break;
+            }
+            
+            [conversations addObject:conversation];
+            [values addObject:@[conversation, row[MSF_TIMESTAMP], row[MSF_MESSAGE_TYPE], sender, kickedUser, row[MSF_MESSAGE], row[MSF_TAGS], row[MSF_IS_SERVER_MESSAGE]]];
+            [sources addObject:row.count > MSF_SOURCE ? row[MSF_SOURCE] : [NSNull null]];
+        } else {
+            IRCMessageStoreWrite write = operation;
+            success = [self insertValues:values sources:sources inDatabase:db] && write(db);
+            [values removeAllObjects];
+            [sources removeAllObjects];
+        }
+    }
+    return success && [self insertValues:values sources:sources inDatabase:db];
+}
+
+- (BOOL)insertValues:(NSArray *)values sources:(NSArray *)sources inDatabase:(FMDatabase *)db
+{
+    BOOL success = YES;
+    NSUInteger index = 0;
+    for (; success && values.count - index >= MESSAGE_STORE_BATCH_SIZE; index += MESSAGE_STORE_BATCH_SIZE) {
+        NSMutableArray *arguments = [[NSMutableArray alloc] initWithCapacity:MESSAGE_STORE_BATCH_SIZE * MESSAGE_STORE_COLUMN_COUNT];
+        for (NSUInteger i = index; i < index + MESSAGE_STORE_BATCH_SIZE; i++) {
+            [arguments addObjectsFromArray:values[i]];
+        }
+        success = [db executeUpdate:_batchInsertStatement withArgumentsInArray:arguments];
+        if (success)
+            [self recordRowIdsOfSources:sources inRange:NSMakeRange(index, MESSAGE_STORE_BATCH_SIZE) inDatabase:db];
+    }
+    for (; success && index < values.count; index++) {
+        success = [db executeUpdate:_insertStatement withArgumentsInArray:values[index]];
+        if (success)
+            [self recordRowIdsOfSources:sources inRange:NSMakeRange(index, 1) inDatabase:db];
+    }
+    return success;
+}
+
+/*!
+ *    @brief  Remember which row ids the rows of an insert got. The rows of one INSERT are numbered one after another,
+ *            so they count back from the last one.
+ */
+- (void)recordRowIdsOfSources:(NSArray *)sources inRange:(NSRange)range inDatabase:(FMDatabase *)db
+{
+    long long rowId = db.lastInsertRowId - (long long)range.length + 1;
+    for (NSUInteger i = range.location; i < NSMaxRange(range); i++, rowId++) {
+        if (sources[i] != [NSNull null])
+            [_insertedMessages addObject:@[sources[i], @(rowId)]];
+    }
+}
+
+@end
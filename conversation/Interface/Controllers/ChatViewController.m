@@ -180,6 +180,7 @@ BOOL popoverDidDismiss = NO;
     _conversation.contentView.frame = frame;
     [self.container addSubview:_conversation.contentView];
     [self.container sendSubviewToBack:_conversation.contentView];
+    [_conversation loadHistory];
     
     [self scrollToBottom:NO];
 
@@ -187,16 +188,13 @@ BOOL popoverDidDismiss = NO;
     int i=0;
     ChatMessageView *messageView;
     DLImageView *imageView;
-    for (UIView *view in _conversation.contentView.subviews) {
-        if ([NSStringFromClass(view.class) isEqualToString:@"ChatMessageView"]) {
-            messageView = (ChatMessageView*)view;
-            i=0;
-            for (UIView *view2 in messageView.subviews) {
-                if ([NSStringFromClass(view2.class) isEqualToString:@"DLImageView"]) {
-                    imageView = (DLImageView*)view2;
-                    [imageView displayImageFromUrl:[messageView.images[i] absoluteString]];
-                    i++;
-                }
+    for (messageView in _conversation.contentView.visibleMessageViews) {
+        i=0;
+        for (UIView *view2 in messageView.subviews) {
+            if ([NSStringFromClass(view2.class) isEqualToString:@"DLImageView"]) {
+                imageView = (DLImageView*)view2;
+                [imageView displayImageFromUrl:[messageView.images[i] absoluteString]];
+                i++;
             }
         }
     }
@@ -233,16 +231,13 @@ BOOL popoverDidDismiss = NO;
     int i=0;
     ChatMessageView *messageView;
     DLImageView *imageView;
-    for (UIView *view in _conversation.contentView.subviews) {
-        if ([NSStringFromClass(view.class) isEqualToString:@"ChatMessageView"]) {
-            messageView = (ChatMessageView*)view;
-            i=0;
-            for (UIView *view2 in messageView.subviews) {
-                if ([NSStringFromClass(view2.class) isEqualToString:@"DLImageView"]) {
-                    imageView = (DLImageView*)view2;
-                    imageView.image = nil;
-                    i++;
-                }
+    for (messageView in _conversation.contentView.visibleMessageViews) {
+        i=0;
+        for (UIView *view2 in messageView.subviews) {
+            if ([NSStringFromClass(view2.class) isEqualToString:@"DLImageView"]) {
+                imageView = (DLImageView*)view2;
+                imageView.image = nil;
+                i++;
             }
         }
     }
@@ -598,19 +593,7 @@ BOOL popoverDidDismiss = NO;
         
     }
     
-    if (_userlistIsVisible && (message.messageType == ET_JOIN ||
-                               message.messageType == ET_PART ||
-                               message.messageType == ET_NICK ||
-                               message.messageType == ET_QUIT ||
-                               message.messageType == ET_KICK ||
-                               message.messageType == ET_KICK)) {
-
-        [self.userListView.tableview reloadData];
-    }
-    
-    if (message.messageType == ET_AWAY)
-        [self.userListView.tableview reloadData];
-    
+    /* The userlist view follows the "userlistChanged" notifications of its channel on its own. */
 }
 
 - (void)swipeLeft:(UISwipeGestureRecognizer *)recognizer
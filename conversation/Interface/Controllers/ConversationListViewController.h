@@ -57,7 +57,6 @@
 - (void)setAway;
 - (void)setBack;
 - (void)disconnect;
-- (void)saveHistoricMessages;
 
 @end
 
@@ -40,6 +40,7 @@
 #import "IRCConnection.h"
 #import "IRCUser.h"
 #import "IRCMessage.h"
+#import "IRCMessageStore.h"
 #import "AppPreferences.h"
 #import "ConversationItemView.h"
 #import "DisclosureView.h"
@@ -76,6 +77,9 @@ long _lastUpdateTime = 0;
     self.connections = [[NSMutableArray alloc] init];
     self.chatViewController = [[ChatViewController alloc] init];
     
+    if (IPAD)
+        [IRCMessageStore sharedStore].historyLimit = 40;
+    
     return self;
 }
 
@@ -140,7 +144,7 @@ long _lastUpdateTime = 0;
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(clientWillConnect:) name:@"clientWillConnect" object:nil];
     
     dispatch_async(dispatch_get_main_queue(), ^{
-        [self loadHistoricMessages];
+        [self removeHistoryOfRemovedConversations];
     });
     
     _backgroundTask = UIBackgroundTaskInvalid;
@@ -843,6 +847,7 @@ long _lastUpdateTime = 0;
         conversation.contentView = [[ConversationContentView alloc] initWithFrame:frame];
         conversation.contentView.autoresizingMask = UIViewAutoresizingFlexibleWidth|UIViewAutoresizingFlexibleHeight;
         conversation.contentView.delegate = self;
+        conversation.contentView.conversation = conversation;
     }
 
 }
@@ -876,10 +881,9 @@ long _lastUpdateTime = 0;
 
 - (IRCConversation *)createConversationWithName:(NSString *)name onClient:(IRCClient *)client
 {
-    for (IRCConversation *query in client.queries) {
-        if ([query.name isEqualToStringCaseInsensitive:name]) {
-            return query;
-        }
+    IRCConversation *existingQuery = [client conversationWithName:name];
+    if (existingQuery && [existingQuery isKindOfClass:[IRCChannel class]] == NO) {
+        return existingQuery;
     }
     IRCChannelConfiguration *configuration = [[IRCChannelConfiguration alloc] init];
     configuration.name = name;
@@ -999,13 +1003,7 @@ long _lastUpdateTime = 0;
             message.conversation.unreadCount++;
             
             // Check for highlight
-            NSString *msg = message.message;
-            NSString *nick = [[message.conversation.client currentUserOnConnection] nick];
-            NSCharacterSet *wordBoundries = [[NSCharacterSet letterCharacterSet] invertedSet];
-            NSRange range = [msg rangeOfString:nick];
-            if (range.location != NSNotFound &&
-                (range.location == 0 || [[msg substringWithRange:NSMakeRange(range.location-1, 1)] rangeOfCharacterFromSet:wordBoundries].location != NSNotFound) &&
-                (range.location+range.length+1 > msg.length || [[msg substringWithRange:NSMakeRange(range.location+range.length, 1)] rangeOfCharacterFromSet:wordBoundries].location != NSNotFound)) {
+            if ([message.conversation stringMentionsCurrentUser:message.message]) {
                 if (message.conversation.isHighlighted == NO) {
                     message.conversation.isHighlighted = YES;
                     AudioServicesPlaySystemSound (kSystemSoundID_Vibrate);
@@ -1203,9 +1201,7 @@ long _lastUpdateTime = 0;
     [[UIApplication sharedApplication] endBackgroundTask:_backgroundTask];
     _backgroundTask = UIBackgroundTaskInvalid;
     
-    dispatch_async(dispatch_get_main_queue(), ^{
-        [self saveHistoricMessages];
-    });
+    [[IRCMessageStore sharedStore] flush];
 }
 
 - (void)setAway
@@ -1295,61 +1291,16 @@ long _lastUpdateTime = 0;
     [[UIApplication sharedApplication] presentLocalNotificationNow:localNotif];
 }
 
-- (void)loadHistoricMessages
+- (void)removeHistoryOfRemovedConversations
 {
-
-    NSMutableArray *messages = [[IRCMessage instancesOrderedBy:@"timestamp"] mutableCopy];
-    BOOL found = NO;
-    for (IRCMessage *message in messages) {
-        found = NO;
-        for (IRCClient *client in _connections) {
-            for (IRCChannel *conversation in [client.channels arrayByAddingObjectsFromArray:client.queries]) {
-                if ([conversation.configuration.uniqueIdentifier isEqualToString:message.conversation.configuration.uniqueIdentifier]) {
-                    message.conversation = conversation;
-                    found = YES;
-                    break;
-                }
-            }
-        }
-        
-        if (!found) {
-            [message delete];
-            continue;
-        }
-        [message.conversation.contentView addMessage:message];
-    }
-}
-
-- (void)saveHistoricMessages
-{
-    int limit = 20;
-    if (IPAD)
-        limit = 40;
-    
-    int i=0;
+    /* History itself is loaded a page at a time by each conversation when it is shown. */
+    NSMutableArray *identifiers = [[NSMutableArray alloc] init];
     for (IRCClient *client in _connections) {
-        for (IRCChannel *conversation in [client.channels arrayByAddingObjectsFromArray:client.queries]) {
-            if (conversation.hasNewMessages == NO)
-                continue;
-            
-            i=0;
-            for (UIView *view in conversation.contentView.subviews.reverseObjectEnumerator) {
-                if ([NSStringFromClass(view.class) isEqualToString:@"ChatMessageView"]) {
-                    ChatMessageView *messageView = (ChatMessageView *)view;
-                    IRCMessage *message = messageView.message;
-                    i++;
-                    if (i > limit) {
-                        [message delete];
-                        continue;
-                    }
-                    message.isConversationHistory = YES;
-                    [message save];
-                }
-            }
+        for (IRCConversation *conversation in [client.channels arrayByAddingObjectsFromArray:client.queries]) {
+            [identifiers addObject:conversation.configuration.uniqueIdentifier];
         }
-        
     }
-
+    [[IRCMessageStore sharedStore] removeMessagesNotInConversations:identifiers];
 }
 
 - (void)willRotateToInterfaceOrientation:(UIInterfaceOrientation)toInterfaceOrientation duration:(NSTimeInterval)duration
@@ -0,0 +1,100 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <UIKit/UIKit.h>
+
+/*!
+ *    @brief  Space kept free above the first row of a transcript.
+ */
+#define CHAT_TRANSCRIPT_TOP_MARGIN 5.0
+
+/*!
+ *    @brief  The heights of the rows of a chat transcript, kept in a binary indexed tree so the offset of any row,
+ *            the row at any offset, appending, changing a height and trimming the oldest rows are all O(log n).
+ */
+@interface ChatHeightIndex : NSObject
+
+@property (nonatomic, readonly) NSUInteger count;
+
+/*!
+ *    @brief  The height of every row together plus the top margin, which is where the next row will start.
+ */
+@property (nonatomic, readonly) CGFloat totalHeight;
+
+/*!
+ *    @brief  Get the height a message takes up in the transcript including the spacing after it.
+ *            Private messages are followed by 15pt and all other messages by 5pt.
+ *
+ *    @param height      The height of the text and inline images of the message.
+ *    @param messageType The type of the message.
+ *
+ *    @return The height of the row.
+ */
++ (CGFloat)rowHeightForHeight:(CGFloat)height messageType:(NSUInteger)messageType;
+
+- (void)appendRowWithHeight:(CGFloat)height;
+
+/*!
+ *    @brief  Add rows above the first row, such as when older history is loaded. The offsets of the existing rows move down by their height.
+ *
+ *    @param heights The heights of the new rows, oldest first.
+ *    @param count   The number of new rows.
+ */
+- (void)insertRowsAtFrontWithHeights:(const CGFloat *)heights count:(NSUInteger)count;
+- (void)setHeight:(CGFloat)height ofRow:(NSUInteger)row;
+- (CGFloat)heightOfRow:(NSUInteger)row;
+
+/*!
+ *    @brief  Get the offset at which a row starts.
+ *
+ *    @param row The index of the row, or the number of rows for the offset after the last one.
+ *
+ *    @return The offset of the row from the top of the transcript.
+ */
+- (CGFloat)offsetOfRow:(NSUInteger)row;
+
+/*!
+ *    @brief  Get the last row starting at or above an offset.
+ *
+ *    @param offset The offset from the top of the transcript.
+ *
+ *    @return The index of the row, clamped to the rows in the index.
+ */
+- (NSUInteger)rowAtOffset:(CGFloat)offset;
+
+/*!
+ *    @brief  Remove the oldest rows, the offsets of the remaining rows move up by the height that was removed.
+ *
+ *    @param count The number of rows to remove.
+ */
+- (void)removeRowsFromFront:(NSUInteger)count;
+- (void)removeAllRows;
+
+@end
@@ -0,0 +1,224 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "ChatHeightIndex.h"
+#import "IRCMessage.h"
+
+#define CHAT_HEIGHT_INDEX_MINIMUM_CAPACITY 64
+
+@implementation ChatHeightIndex {
+    CGFloat *_heights;
+    CGFloat *_tree;
+    NSUInteger _capacity;
+    NSUInteger _first;
+    NSUInteger _end;
+}
+
++ (CGFloat)rowHeightForHeight:(CGFloat)height messageType:(NSUInteger)messageType
+{
+    if (messageType == ET_PRIVMSG)
+        return height + 15.0;
+    return height + 5.0;
+}
+
+- (void)dealloc
+{
+    free(_heights);
+    free(_tree);
+}
+
+- (NSUInteger)count
+{
+    return _end - _first;
+}
+
+/* Rows removed from the front stay in the tree with a height of zero until the tree is compacted,
+ so the physical position of row 0 is _first and every prefix sum up to it is zero. */
+
+static inline NSUInteger lowestBit(NSUInteger i)
+{
+    return i & (~i + 1);
+}
+
+- (CGFloat)prefixSum:(NSUInteger)position
+{
+    CGFloat sum = 0.0;
+    for (NSUInteger i = position; i > 0; i -= lowestBit(i)) {
+        sum += _tree[i];
+    }
+    return sum;
+}
+
+- (void)addDelta:(CGFloat)delta atPosition:(NSUInteger)position
+{
+    for (NSUInteger i = position + 1; i <= _end; i += lowestBit(i)) {
+        _tree[i] += delta;
+    }
+    _totalHeight += delta;
+}
+
+- (void)rebuildTree
+{
+    _totalHeight = CHAT_TRANSCRIPT_TOP_MARGIN;
+    for (NSUInteger i = 1; i <= _end; i++) {
+        _tree[i] = _heights[i - 1];
+        _totalHeight += _heights[i - 1];
+    }
+    for (NSUInteger i = 1; i <= _end; i++) {
+        NSUInteger parent = i + lowestBit(i);
+        if (parent <= _end)
+            _tree[parent] += _tree[i];
+    }
+}
+
+- (void)reserveCapacity:(NSUInteger)capacity
+{
+    if (capacity <= _capacity)
+        return;
+    
+    while (_capacity < capacity) {
+        _capacity = MAX(_capacity * 2, CHAT_HEIGHT_INDEX_MINIMUM_CAPACITY);
+    }
+    _heights = realloc(_heights, _capacity * sizeof(CGFloat));
+    _tree = realloc(_tree, (_capacity + 1) * sizeof(CGFloat));
+}
+
+- (void)appendRowWithHeight:(CGFloat)height
+{
+    if (_end == 0)
+        _totalHeight = CHAT_TRANSCRIPT_TOP_MARGIN;
+    
+    [self reserveCapacity:_end + 1];
+    
+    /* A new node covers the rows below it that no existing node reaches, which is a difference of two prefix sums. */
+    NSUInteger position = _end + 1;
+    _heights[_end] = height;
+    _tree[position] = height + [self prefixSum:position - 1] - [self prefixSum:position - lowestBit(position)];
+    _end++;
+    _totalHeight += height;
+}
+
+- (void)insertRowsAtFrontWithHeights:(const CGFloat *)heights count:(NSUInteger)count
+{
+    if (count == 0)
+        return;
+    
+    /* New rows take the place of removed ones. When there are not enough of those the rows move up, leaving room for this insert and one more like it. */
+    if (_first < count) {
+        NSUInteger rows = _end - _first;
+        NSUInteger first = count * 2;
+        [self reserveCapacity:first + rows];
+        memmove(_heights + first, _heights + _first, rows * sizeof(CGFloat));
+        memset(_heights, 0, first * sizeof(CGFloat));
+        _first = first;
+        _end = first + rows;
+        [self rebuildTree];
+    }
+    
+    for (NSUInteger i = count; i > 0; i--) {
+        _first--;
+        _heights[_first] = heights[i - 1];
+        [self addDelta:heights[i - 1] atPosition:_first];
+    }
+}
+
+- (void)setHeight:(CGFloat)height ofRow:(NSUInteger)row
+{
+    NSAssert(row < self.count, @"Row %lu out of range", (unsigned long)row);
+    
+    NSUInteger position = _first + row;
+    [self addDelta:height - _heights[position] atPosition:position];
+    _heights[position] = height;
+}
+
+- (CGFloat)heightOfRow:(NSUInteger)row
+{
+    NSAssert(row < self.count, @"Row %lu out of range", (unsigned long)row);
+    
+    return _heights[_first + row];
+}
+
+- (CGFloat)offsetOfRow:(NSUInteger)row
+{
+    NSAssert(row <= self.count, @"Row %lu out of range", (unsigned long)row);
+    
+    return CHAT_TRANSCRIPT_TOP_MARGIN + [self prefixSum:_first + row];
+}
+
+- (NSUInteger)rowAtOffset:(CGFloat)offset
+{
+    if (_end == _first)
+        return 0;
+    
+    /* Walk down the tree taking every node that still fits above the offset, which stops on the row containing it. */
+    CGFloat remaining = offset - CHAT_TRANSCRIPT_TOP_MARGIN;
+    NSUInteger position = 0;
+    NSUInteger step = 1;
+    while (step * 2 <= _end) {
+        step *= 2;
+    }
+    for (; step > 0; step /= 2) {
+        if (position + step <= _end && _tree[position + step] <= remaining) {
+            position += step;
+            remaining -= _tree[position];
+        }
+    }
+    
+    if (position < _first)
+        return 0;
+    return MIN(position - _first, self.count - 1);
+}
+
+- (void)removeRowsFromFront:(NSUInteger)count
+{
+    count = MIN(count, self.count);
+    for (NSUInteger i = 0; i < count; i++) {
+        [self addDelta:-_heights[_first] atPosition:_first];
+        _heights[_first] = 0.0;
+        _first++;
+    }
+    
+    /* Compact once the removed rows make up half of the tree, which keeps trimming amortised O(log n). */
+    if (_first > CHAT_HEIGHT_INDEX_MINIMUM_CAPACITY && _first * 2 > _end) {
+        memmove(_heights, _heights + _first, (_end - _first) * sizeof(CGFloat));
+        _end -= _first;
+        _first = 0;
+        [self rebuildTree];
+    }
+}
+
+- (void)removeAllRows
+{
+    _first = 0;
+    _end = 0;
+    _totalHeight = 0.0;
+}
+
+@end
@@ -30,6 +30,7 @@
 
 #import <UIKit/UIKit.h>
 #import "IRCMessage.h"
+#import "ChatRenderedMessage.h"
 
 @class IRCChannel;
 
@@ -44,9 +45,11 @@
 }
 
 - (id)initWithFrame:(CGRect)frame message:(IRCMessage *)message;
+- (id)initWithFrame:(CGRect)frame renderedMessage:(ChatRenderedMessage *)renderedMessage;
 - (CGFloat)frameHeight;
 
 @property (nonatomic) NSMutableArray *images;
 @property (nonatomic) IRCMessage *message;
+@property (nonatomic) ChatRenderedMessage *renderedMessage;
 
 @end
@@ -0,0 +1,94 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <UIKit/UIKit.h>
+#import "IRCMessage.h"
+
+/*!
+ *    @brief  The formatted text of a message laid out for a fixed width, ready to be shown by a ChatMessageView.
+ *            Rendered messages are built on a background queue and never change afterwards, so they can be shared and cached.
+ */
+@interface ChatRenderedMessage : NSObject
+
+@property (nonatomic, readonly) IRCMessage *message;
+@property (nonatomic, readonly) CGFloat width;
+@property (nonatomic, readonly) NSAttributedString *attributedString;
+@property (nonatomic, readonly) NSAttributedString *timeString;
+@property (nonatomic, readonly) CGSize timeSize;
+@property (nonatomic, readonly) CGSize size;
+@property (nonatomic, readonly) CGFloat height;
+@property (nonatomic, readonly) NSArray *lineRanges;
+@property (nonatomic, readonly) NSArray *linkRanges;
+@property (nonatomic, readonly) NSArray *linkRects;
+@property (nonatomic, readonly) NSArray *linkTargets;
+@property (nonatomic, readonly) NSArray *images;
+@property (nonatomic, readonly) UIColor *backgroundColor;
+
+/*!
+ *    @brief  Get the rendered message for a message, laying it out on the calling thread if it is not in the cache.
+ *
+ *    @param message The message to render.
+ *    @param width   The width available to the text of the message.
+ *
+ *    @return The rendered message.
+ */
++ (instancetype)renderedMessageForMessage:(IRCMessage *)message width:(CGFloat)width;
+
+/*!
+ *    @brief  Render a message on the layout queue. Must be called on the main thread, which owns the sender and client state read for the layout.
+ *            Completion blocks are called on the main thread in the order the messages were passed in.
+ *
+ *    @param message    The message to render.
+ *    @param width      The width available to the text of the message.
+ *    @param completion Block called with the rendered message.
+ */
++ (void)renderMessage:(IRCMessage *)message width:(CGFloat)width completion:(void (^)(ChatRenderedMessage *renderedMessage))completion;
+
+/*!
+ *    @brief  Render a batch of messages on the layout queue, such as when the transcript has to be laid out again for a new width.
+ *            Must be called on the main thread, like renderMessage:width:completion:.
+ *
+ *    @param messages   The messages to render.
+ *    @param width      The width available to the text of the messages.
+ *    @param completion Block called on the main thread with the rendered messages, in the same order as the messages.
+ */
++ (void)renderMessages:(NSArray *)messages width:(CGFloat)width completion:(void (^)(NSArray *renderedMessages))completion;
+
+/*!
+ *    @brief  Get the prefix character shown in front of the nickname of a user with a channel privilege.
+ *
+ *    @param status The channel privilege of the user.
+ *    @param client The client whose server announced the prefix characters.
+ *
+ *    @return The prefix character, or an empty string.
+ */
++ (NSString *)characterForStatus:(NSInteger)status onClient:(IRCClient *)client;
+
+@end
@@ -0,0 +1,849 @@
+/*
+ Copyright (c) 2014-2015, Tobias Pollmann.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ 
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ 3. Neither the name of the copyright holders nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <CoreText/CoreText.h>
+#import <NSDate-Extensions/NSDate-Utilities.h>
+#import "ChatRenderedMessage.h"
+#import "NSString+Methods.h"
+#import "AppPreferences.h"
+#import "InterfaceLayoutDefinitions.h"
+#import "ConversationContentView.h"
+
+#define FNV_PRIME_32 16777619
+#define FNV_OFFSET_32 2166136261U
+
+/* Enough to hold every message of a full transcript, so laying it out again for a new width does not miss the cache */
+#define RENDERED_MESSAGE_CACHE_LIMIT Message_Limit
+
+#define hasHighlight(message) (message.conversation.client.currentUserOnConnection && \
+                               [message.conversation.client.currentUserOnConnection.nick isEqualToName:message.sender.nick onClient:message.conversation.client] == NO && \
+                               [message.conversation stringMentionsCurrentUser:message.message])
+
+@interface ChatRenderedMessage () {
+    NSMutableArray *_imageLinks;
+    NSString *_status;
+    BOOL _highlighted;
+}
+
++ (instancetype)renderedMessageForMessage:(IRCMessage *)message width:(CGFloat)width status:(NSString *)status highlighted:(BOOL)highlighted;
+- (instancetype)initWithMessage:(IRCMessage *)message width:(CGFloat)width status:(NSString *)status highlighted:(BOOL)highlighted;
+
+@end
+
+@implementation ChatRenderedMessage
+
+static dispatch_queue_t layoutQueue()
+{
+    static dispatch_queue_t queue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        queue = dispatch_queue_create("conversation.messagelayout", DISPATCH_QUEUE_SERIAL);
+    });
+    return queue;
+}
+
+static NSCache *renderedMessageCache()
+{
+    static NSCache *cache;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        cache = [[NSCache alloc] init];
+        cache.countLimit = RENDERED_MESSAGE_CACHE_LIMIT;
+    });
+    return cache;
+}
+
++ (instancetype)renderedMessageForMessage:(IRCMessage *)message width:(CGFloat)width
+{
+    return [ChatRenderedMessage renderedMessageForMessage:message
+                                                    width:width
+                                                   status:[ChatRenderedMessage characterForStatus:message.sender.channelPrivilege onClient:message.conversation.client]
+                                              highlighted:hasHighlight(message)];
+}
+
++ (instancetype)renderedMessageForMessage:(IRCMessage *)message width:(CGFloat)width status:(NSString *)status highlighted:(BOOL)highlighted
+{
+    /* IRCMessage hashes by its database row, which unsaved messages share, so the cache is keyed by the object itself.
+     A cached rendered message keeps its message alive, so the address cannot be taken by another message meanwhile. */
+    NSValue *key = [NSValue valueWithNonretainedObject:message];
+    ChatRenderedMessage *renderedMessage = [renderedMessageCache() objectForKey:key];
+    if (renderedMessage && renderedMessage.width == width)
+        return renderedMessage;
+    
+    renderedMessage = [[ChatRenderedMessage alloc] initWithMessage:message width:width status:status highlighted:highlighted];
+    [renderedMessageCache() setObject:renderedMessage forKey:key];
+    return renderedMessage;
+}
+
++ (void)renderMessage:(IRCMessage *)message width:(CGFloat)width completion:(void (^)(ChatRenderedMessage *renderedMessage))completion
+{
+    /* The sender and the client keep changing on the main thread, so what the layout needs from them is read here first */
+    NSString *status = [ChatRenderedMessage characterForStatus:message.sender.channelPrivilege onClient:message.conversation.client];
+    BOOL highlighted = hasHighlight(message);
+    dispatch_async(layoutQueue(), ^{
+        ChatRenderedMessage *renderedMessage = [ChatRenderedMessage renderedMessageForMessage:message width:width status:status highlighted:highlighted];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(renderedMessage);
+        });
+    });
+}
+
++ (void)renderMessages:(NSArray *)messages width:(CGFloat)width completion:(void (^)(NSArray *renderedMessages))completion
+{
+    NSMutableArray *statuses = [[NSMutableArray alloc] initWithCapacity:messages.count];
+    NSMutableIndexSet *highlights = [[NSMutableIndexSet alloc] init];
+    [messages enumerateObjectsUsingBlock:^(IRCMessage *message, NSUInteger index, BOOL *stop) {
+        NSString *status = [ChatRenderedMessage characterForStatus:message.sender.channelPrivilege onClient:message.conversation.client];
+        [statuses addObject:status ? status : @""];
+        if (hasHighlight(message)) {
+            [highlights addIndex:index];
+        }
+    }];
+    dispatch_async(layoutQueue(), ^{
+        NSMutableArray *renderedMessages = [[NSMutableArray alloc] initWithCapacity:messages.count];
+        [messages enumerateObjectsUsingBlock:^(IRCMessage *message, NSUInteger index, BOOL *stop) {
+            [renderedMessages addObject:[ChatRenderedMessage renderedMessageForMessage:message
+                                                                                 width:width
+                                                                                status:statuses[index]
+                                                                           highlighted:[highlights containsIndex:index]]];
+        }];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(renderedMessages);
+        });
+    });
+}
+
+- (instancetype)initWithMessage:(IRCMessage *)message width:(CGFloat)width status:(NSString *)status highlighted:(BOOL)highlighted
+{
+    if ((self = [super init])) {
+        _message = message;
+        _width = width;
+        _status = status ? status : @"";
+        _highlighted = highlighted;
+        _imageLinks = [[NSMutableArray alloc] init];
+        
+        _attributedString = [self formattedString];
+        _linkRanges = [self linkRangesInString:_attributedString];
+        [self layoutLines];
+        
+        if (message.messageType == ET_PRIVMSG) {
+            _timeString = [self timestamp];
+            _timeSize = [_timeString size];
+        }
+        
+        _images = [_imageLinks copy];
+        _imageLinks = nil;
+        
+        /* Inline images are shown below the text, 130pt each. */
+        _height = _size.height + 130.0 * _images.count;
+    }
+    return self;
+}
+
+- (NSURL *)getImageLink:(NSURL *)url
+{
+    if ([url.host isEqualToString:@"dropbox.com"] || [url.host isEqualToString:@"www.dropbox.com"]) {
+        return [NSURL URLWithString:
+                [[NSString stringWithFormat:@"%@://%@%@?dl=1", url.scheme, url.host, url.path] stringByAddingPercentEscapesUsingEncoding:NSASCIIStringEncoding]];
+    }
+    return url;
+}
+
+- (BOOL)isImageLink:(NSURL *)url
+{
+    if ([url.pathExtension isEqualToString:@"png"] ||
+        [url.pathExtension isEqualToString:@"jpg"] ||
+        [url.pathExtension isEqualToString:@"jpeg"] ||
+        [url.pathExtension isEqualToString:@"tiff"] ||
+        [url.pathExtension isEqualToString:@"gif"]) {
+        return YES;
+    }
+    return NO;
+}
+
+uint32_t FNV32(const char *s)
+{
+    uint32_t hash = FNV_OFFSET_32, i;
+    for(i = 0; i < strlen(s); i++)
+    {
+        hash = hash ^ (s[i]); // xor next byte into the bottom of the hash
+        hash = hash * FNV_PRIME_32; // Multiply by prime number found to work well
+    }
+    return hash;
+}
+
++ (NSArray *)userColors
+{
+    static NSArray *colors;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        colors = @[[UIColor colorWithRed:0 green:0.592 blue:0.863 alpha:1], /*#0097dc*/
+                   [UIColor colorWithRed:0.929 green:0.004 blue:0.498 alpha:1], /*#ed017f*/
+                   [UIColor colorWithRed:0.984 green:0.678 blue:0.094 alpha:1], /*#fbad18*/
+                   [UIColor colorWithRed:0 green:0.678 blue:0.486 alpha:1], /*#00ad7c*/
+                   [UIColor colorWithRed:0.541 green:0.588 blue:0.094 alpha:1], /*#8a9618*/
+                   [UIColor colorWithRed:0.494 green:0.341 blue:0 alpha:1], /*#7e5700*/
+                   [UIColor colorWithRed:0.153 green:0.349 blue:0.588 alpha:1], /*#275996*/
+                   [UIColor colorWithRed:0.867 green:0.478 blue:0.486 alpha:1], /*#dd7a7c*/
+                   [UIColor colorWithRed:0.463 green:0.282 blue:0.616 alpha:1], /*#76489d*/
+                   [UIColor colorWithRed:0.953 green:0.443 blue:0.129 alpha:1], /*#f37121*/
+                   [UIColor colorWithRed:0.808 green:0.596 blue:0.494 alpha:1], /*#ce987e*/
+                   [UIColor colorWithRed:0.396 green:0.459 blue:0.522 alpha:1], /*#657585*/
+                   [UIColor colorWithRed:0.435 green:0.761 blue:0.51 alpha:1], /*#6fc282*/
+                   [UIColor colorWithRed:0.941 green:0.286 blue:0.243 alpha:1], /*#f0493e*/
+                   [UIColor colorWithRed:0.725 green:0.369 blue:0.643 alpha:1], /*#b95ea4*/
+                   [UIColor colorWithRed:0 green:0.365 blue:0.133 alpha:1], /*#005d22*/
+                   [UIColor colorWithRed:0.749 green:0.286 blue:0.122 alpha:1], /*#bf491f*/
+                   [UIColor colorWithRed:0.518 green:0.027 blue:0.082 alpha:1], /*#840715*/
+                   [UIColor colorWithRed:0.02 green:0.141 blue:0.376 alpha:1], /*#052460*/
+                   [UIColor colorWithRed:0.486 green:0.259 blue:0 alpha:1], /*#7c4200*/
+                   [UIColor colorWithRed:0.761 green:0.529 blue:0.063 alpha:1], /*#c28710*/
+                   [UIColor colorWithRed:0.353 green:0.333 blue:0.325 alpha:1], /*#5a5553*/
+                   [UIColor colorWithRed:0.278 green:0 blue:0.329 alpha:1], /*#470054*/
+                   [UIColor colorWithRed:0.843 green:0.702 blue:0.059 alpha:1], /*#d7b30f*/
+                   [UIColor colorWithRed:0.573 green:0.784 blue:0.243 alpha:1], /*#92c83e*/
+                   [UIColor colorWithRed:0.463 green:0.812 blue:0.906 alpha:1], /*#76cfe7*/
+                   [UIColor colorWithRed:0.667 green:0.522 blue:0.647 alpha:1], /*#aa85a5*/
+                   [UIColor colorWithRed:0.478 green:0.424 blue:0.325 alpha:1], /*#7a6c53*/
+                   [UIColor colorWithRed:0.255 green:0.635 blue:0.682 alpha:1], /*#41a2ae*/
+                   [UIColor colorWithRed:0.698 green:0.663 blue:0.655 alpha:1]]; /*#b2a9a7*/
+    });
+    return colors;
+}
+
++ (NSString *)characterForStatus:(NSInteger)status onClient:(IRCClient *)client
+{
+    switch(status) {
+        case VOICE:
+            return [client.userModeCharacters objectForKey:@"v"];
+            break;
+        case HALFOP:
+            return [client.userModeCharacters objectForKey:@"h"];
+            break;
+        case OPERATOR:
+            return [client.userModeCharacters objectForKey:@"o"];
+            break;
+        case ADMIN:
+            return [client.userModeCharacters objectForKey:@"a"];
+            break;
+        case OWNER:
+            return [client.userModeCharacters objectForKey:@"q"];
+            break;
+        case IRCOP:
+            return [client.userModeCharacters objectForKey:@"y"];
+            break;
+    }
+    return @"";
+}
+
+- (UIColor *)colorForNick:(NSString *)nick
+{
+    // This is a temporal workaround
+    if (!nick)
+        return [UIColor blueColor];
+    
+    return [[ChatRenderedMessage userColors] objectAtIndex:(int)floor(FNV32(nick.UTF8String) / 300000000)];
+}
+
+- (NSArray *)getMentions:(NSString *)string
+{
+    // Highlight?
+    if (_highlighted) {
+        _backgroundColor = [InterfaceLayoutDefinitions highlightedMessageBackgroundColour];
+    }
+    
+    IRCChannel *channel = (IRCChannel*)_message.conversation;
+
+    /* The channel keeps a matcher over the nicknames of its users, which finds them all in one pass over the message. */
+    return [channel.mentionMatcher rangesOfMentionsInString:string];
+}
+
+- (NSString *)setEmoticons:(NSString *)string
+{
+    NSDictionary *emoticons = [[AppPreferences sharedPrefs] getEmoticons];
+    NSCharacterSet *wordBoundries = [[NSCharacterSet alphanumericCharacterSet] invertedSet];
+    for (NSString *key in emoticons.allKeys) {
+        NSRange range = [string rangeOfString:key];
+        if (range.location != NSNotFound &&
+            (range.location == 0 || [[string substringWithRange:NSMakeRange(range.location-1, 1)] rangeOfCharacterFromSet:wordBoundries].location != NSNotFound) &&
+            (range.location+range.length+1 > string.length || [[string substringWithRange:NSMakeRange(range.location+range.length, 1)] rangeOfCharacterFromSet:wordBoundries].location != NSNotFound)) {
+            string = [string stringByReplacingOccurrencesOfString:key withString:emoticons[key]];
+        }
+
+    }
+    return string;
+}
+
+- (NSAttributedString *)setLinks:(NSString *)string
+{
+    /* Data detectors and regular expressions are immutable once created, so one of each is shared by every message. */
+    static NSDataDetector *detector;
+    static NSRegularExpression *regex;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        detector = [NSDataDetector dataDetectorWithTypes:NSTextCheckingTypeLink error:nil];
+        regex = [NSRegularExpression regularExpressionWithPattern:@"(?<!\\S)[#&]\\w+(?!\\S)" options:NSRegularExpressionCaseInsensitive error:nil];
+    });
+    
+    NSMutableArray *ranges      = [[NSMutableArray alloc] init];
+    NSMutableArray *offsets     = [[NSMutableArray alloc] init];
+    NSMutableArray *links       = [[NSMutableArray alloc] init];
+    NSArray *matches = [detector matchesInString:string options:0 range:NSMakeRange(0, [string length])];
+    NSString *newString = string;
+
+    for (NSTextCheckingResult *match in matches) {
+        NSRange matchRange = [match range];
+        NSString *urlString = [string substringWithRange:matchRange];
+        NSString *replace = [[NSString stringWithFormat:@"%@", urlString] stringByTruncatingToWidth:250.0
+                                                                                       withAttributes:@{NSFontAttributeName:[UIFont systemFontOfSize:12.0]}];
+        
+        // Tricky solution to avoid line breaks
+        replace = [replace stringByReplacingOccurrencesOfString:@"/" withString:@"\u2060/\u2060"];
+        replace = [replace stringByReplacingOccurrencesOfString:@"." withString:@"\u2060.\u2060"];
+        replace = [replace stringByReplacingOccurrencesOfString:@"…" withString:@"\u2060…\u2060"];
+        replace = [replace stringByReplacingOccurrencesOfString:@"-" withString:@"\u2060-\u2060"];
+        replace = [replace stringByReplacingOccurrencesOfString:@"?" withString:@"\u2060?\u2060"];
+        
+        newString = [newString stringByReplacingOccurrencesOfString:urlString withString:replace];
+        [ranges addObject:[NSValue valueWithRange:NSMakeRange(matchRange.location, replace.length)]];
+        [offsets addObject:[NSNumber numberWithInteger:urlString.length-replace.length]];
+        [links addObject:match.URL];
+
+        BOOL enableImages = [[NSUserDefaults standardUserDefaults] boolForKey:@"inline_preference"];
+        if (enableImages && _message.messageType == ET_PRIVMSG && [self isImageLink:match.URL])
+            [_imageLinks addObject:[self getImageLink:match.URL]];
+    }
+
+
+    NSMutableAttributedString *attributedString = [[NSMutableAttributedString alloc] initWithString:newString];
+
+    int offset = 0;
+    for (int i=0; i<ranges.count; i++) {
+        NSRange range = [ranges[i] rangeValue];
+        [attributedString addAttribute:NSLinkAttributeName value:links[i] range:NSMakeRange(range.location-offset, range.length)];
+        [attributedString addAttribute:NSForegroundColorAttributeName value:[UIColor blueColor] range:NSMakeRange(range.location-offset, range.length)];
+        
+        offset += [offsets[i] intValue];
+    }
+    
+    // Search for mentions of channel names
+    [regex enumerateMatchesInString:string
+                            options:NSMatchingReportCompletion
+                              range:NSMakeRange(0, string.length)
+                         usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
+                             NSURL *link = [NSURL URLWithString:[NSString stringWithFormat:@"irc://%@", [string substringWithRange:result.range]]];
+                             [attributedString addAttribute:NSLinkAttributeName value:link range:result.range];
+                             [attributedString addAttribute:NSForegroundColorAttributeName value:[UIColor blueColor] range:result.range];
+                         }];
+
+    return attributedString;
+    
+}
+
+- (NSAttributedString *)formattedString
+{
+
+    IRCUser *user = _message.sender;
+    
+    NSString *msg;
+    BOOL enableEmoji = [[NSUserDefaults standardUserDefaults] boolForKey:@"emoji_preference"];
+    if (enableEmoji)
+        msg = [self setEmoticons:_message.message];
+    else
+        msg = _message.message;
+
+    NSMutableAttributedString *string;
+    NSString *status = _status;
+    
+    switch(_message.messageType) {
+        case ET_JOIN: {
+
+            string = [[NSMutableAttributedString alloc] initWithString:[NSString stringWithFormat:@"→ %@ (%@@%@) %@",
+                                                                        user.nick,
+                                                                        user.username,
+                                                                        user.hostname,
+                                                                        NSLocalizedString(@"joined the channel", @"joined the channel")]];
+            
+            NSMutableParagraphStyle *paragraphStyle = [[NSMutableParagraphStyle alloc] init];
+            paragraphStyle.lineBreakMode = NSLineBreakByCharWrapping;
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[InterfaceLayoutDefinitions eventMessageFont]
+                           range:NSMakeRange(0, string.length)];
+
+            [string addAttribute:NSParagraphStyleAttributeName
+                           value:paragraphStyle
+                           range:NSMakeRange(0, string.length)];
+
+            [string addAttribute:NSFontAttributeName
+                           value:[InterfaceLayoutDefinitions eventMessageNicknameFont]
+                           range:NSMakeRange(0, user.nick.length + 2)];
+            break;
+        }
+        case ET_PART: {
+            
+            string = [[NSMutableAttributedString alloc] initWithString:[NSString stringWithFormat:@"← %@ (%@@%@) %@ (%@)",
+                                                                        user.nick,
+                                                                        user.username,
+                                                                        user.hostname,
+                                                                        NSLocalizedString(@"left the channel", @"left the channel"),
+                                                                        msg]];
+
+            NSMutableParagraphStyle *paragraphStyle = [[NSMutableParagraphStyle alloc] init];
+            paragraphStyle.lineBreakMode = NSLineBreakByCharWrapping;
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont systemFontOfSize:10.0]
+                           range:NSMakeRange(0, string.length)];
+
+            [string addAttribute:NSParagraphStyleAttributeName
+                           value:paragraphStyle
+                           range:NSMakeRange(0, string.length)];
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont boldSystemFontOfSize:10.0]
+                           range:NSMakeRange(0, user.nick.length + 2)];
+            break;
+        }
+        case ET_QUIT: {
+            
+            string = [[NSMutableAttributedString alloc] initWithString:[NSString stringWithFormat:@"← %@ (%@@%@) %@ (%@)",
+                                                                        user.nick,
+                                                                        user.username,
+                                                                        user.hostname,
+                                                                        NSLocalizedString(@"left IRC", @"left IRC"),
+                                                                        msg]];
+            
+            NSMutableParagraphStyle *paragraphStyle = [[NSMutableParagraphStyle alloc] init];
+            paragraphStyle.lineBreakMode = NSLineBreakByCharWrapping;
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont systemFontOfSize:10.0]
+                           range:NSMakeRange(0, string.length)];
+
+            [string addAttribute:NSParagraphStyleAttributeName
+                           value:paragraphStyle
+                           range:NSMakeRange(0, string.length)];
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont boldSystemFontOfSize:10.0]
+                           range:NSMakeRange(0, user.nick.length + 2)];
+            break;
+        }
+        case ET_NICK: {
+            string = [[NSMutableAttributedString alloc] initWithString:[NSString stringWithFormat:@"· %@ %@ %@",
+                                                                        user.nick,
+                                                                        NSLocalizedString(@"is now known as", @"is now known as"),
+                                                                        msg]];
+            
+            NSMutableParagraphStyle *paragraphStyle = [[NSMutableParagraphStyle alloc] init];
+            paragraphStyle.lineBreakMode = NSLineBreakByWordWrapping;
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont systemFontOfSize:10.0]
+                           range:NSMakeRange(0, string.length)];
+            
+            [string addAttribute:NSParagraphStyleAttributeName
+                           value:paragraphStyle
+                           range:NSMakeRange(0, string.length)];
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont boldSystemFontOfSize:10.0]
+                           range:NSMakeRange(0, user.nick.length + 2)];
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont boldSystemFontOfSize:10.0]
+                           range:NSMakeRange(string.length-msg.length, msg.length)];
+            break;
+        }
+        case ET_MODE: {
+            string = [[NSMutableAttributedString alloc] initWithString:[NSString stringWithFormat:@"· %@ %@ %@",
+                                                                        user.nick,
+                                                                        NSLocalizedString(@"sets mode", @"sets mode"),
+                                                                        msg]];
+            
+            NSMutableParagraphStyle *paragraphStyle = [[NSMutableParagraphStyle alloc] init];
+            paragraphStyle.lineBreakMode = NSLineBreakByWordWrapping;
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont systemFontOfSize:10.0]
+                           range:NSMakeRange(0, string.length)];
+            
+            [string addAttribute:NSParagraphStyleAttributeName
+                           value:paragraphStyle
+                           range:NSMakeRange(0, string.length)];
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont boldSystemFontOfSize:10.0]
+                           range:NSMakeRange(0, user.nick.length + 2)];
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont boldSystemFontOfSize:10.0]
+                           range:NSMakeRange(string.length-msg.length, msg.length)];
+            break;
+        }
+        case ET_KICK: {
+
+            msg = [NSString stringWithFormat:NSLocalizedString(@"%@ kicked %@ from the channel (%@)", nil), _message.sender.nick, _message.kickedUser.nick, _message.message];
+            
+            string = [[NSMutableAttributedString alloc] initWithString:[NSString stringWithFormat:@"← %@", msg]];
+            
+            NSMutableParagraphStyle *paragraphStyle = [[NSMutableParagraphStyle alloc] init];
+            paragraphStyle.lineBreakMode = NSLineBreakByWordWrapping;
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont systemFontOfSize:10.0]
+                           range:NSMakeRange(0, string.length)];
+            
+            [string addAttribute:NSParagraphStyleAttributeName
+                           value:paragraphStyle
+                           range:NSMakeRange(0, string.length)];
+            
+            [string addAttribute:NSForegroundColorAttributeName
+                           value:[UIColor redColor]
+                           range:NSMakeRange(0, string.length)];
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont boldSystemFontOfSize:10.0]
+                           range:NSMakeRange(0, _message.sender.nick.length + 2)];
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont boldSystemFontOfSize:10.0]
+                           range:[string.string rangeOfString:_message.kickedUser.nick]];
+            
+
+            break;
+        }
+        case ET_TOPIC: {
+
+            string = [[NSMutableAttributedString alloc] initWithAttributedString:[self setLinks:[NSString stringWithFormat:@"%@ %@ %@",
+                                                                        user.nick,
+                                                                        NSLocalizedString(@"changed the topic to", @"changed the topic to"),
+                                                                        msg]]];
+            
+            msg = [[self setLinks:msg] string];
+            NSMutableParagraphStyle *paragraphStyle = [[NSMutableParagraphStyle alloc] init];
+            paragraphStyle.lineBreakMode = NSLineBreakByWordWrapping;
+            [string addAttribute:NSParagraphStyleAttributeName
+                           value:paragraphStyle
+                           range:NSMakeRange(0, string.length)];
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont boldSystemFontOfSize:12.0]
+                           range:NSMakeRange(0, user.nick.length)];
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont boldSystemFontOfSize:12.0]
+                           range:NSMakeRange(string.length-msg.length, msg.length)];
+            
+            break;
+        }
+        case ET_ACTION: {
+            
+            string = [[NSMutableAttributedString alloc] initWithAttributedString:[self setLinks:[[NSString alloc] initWithFormat:@"· %@ %@", user.nick, msg]]];
+
+            NSMutableParagraphStyle *paragraphStyle = [[NSMutableParagraphStyle alloc] init];
+            paragraphStyle.lineBreakMode = NSLineBreakByWordWrapping;
+
+            [string addAttribute:NSParagraphStyleAttributeName
+                           value:paragraphStyle
+                           range:NSMakeRange(0, string.length)];
+ 
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont boldSystemFontOfSize:12.0]
+                           range:NSMakeRange(0, string.length)];
+            
+            [string addAttribute:NSForegroundColorAttributeName
+                           value:[self colorForNick:user.nick]
+                           range:NSMakeRange(0, string.length)];
+            
+            if ([_message.conversation isKindOfClass:[IRCChannel class]])
+                [self getMentions:msg];
+            
+            break;
+        }
+        case ET_NOTICE: {
+            
+            NSString *notice = NSLocalizedString(@"[Notice]", @"[Notice]");
+            string = [[NSMutableAttributedString alloc] initWithAttributedString:[self setLinks:[[NSString alloc] initWithFormat:@"%@ %@\n%@",
+                                                                                                 notice, user.nick, msg]]];
+
+            msg = [[self setLinks:msg] string];
+            NSMutableParagraphStyle *paragraphStyle = [[NSMutableParagraphStyle alloc] init];
+            paragraphStyle.lineBreakMode = NSLineBreakByWordWrapping;
+            [string addAttribute:NSParagraphStyleAttributeName
+                           value:paragraphStyle
+                           range:NSMakeRange(0, string.length)];
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont boldSystemFontOfSize:16.0]
+                           range:NSMakeRange(0, notice.length + user.nick.length + 1)];
+            
+            [string addAttribute:NSForegroundColorAttributeName
+                           value:[UIColor darkGrayColor]
+                           range:NSMakeRange(0, notice.length)];
+            
+            [string addAttribute:NSForegroundColorAttributeName
+                           value:[self colorForNick:user.nick]
+                           range:NSMakeRange(notice.length+1, user.nick.length)];
+
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont systemFontOfSize:12.0]
+                           range:NSMakeRange(user.nick.length + notice.length + 2, msg.length)];
+
+            // Mark sender's nick so we can respond to tap actions
+
+            [string addAttribute:NSLinkAttributeName
+                           value:user.nick
+                           range:NSMakeRange(0, status.length+user.nick.length)];
+            
+            break;
+        }
+        case ET_PRIVMSG: {
+            
+            string = [[NSMutableAttributedString alloc] initWithAttributedString:[self setLinks:[[NSString alloc] initWithFormat:@"%@%@\n%@", status, user.nick, msg]]];
+            msg = [string.string substringFromIndex:status.length+user.nick.length+1];
+            
+            NSMutableParagraphStyle *paragraphStyle = [[NSMutableParagraphStyle alloc] init];
+            paragraphStyle.lineBreakMode = NSLineBreakByWordWrapping;
+            [string addAttribute:NSParagraphStyleAttributeName
+                           value:paragraphStyle
+                           range:NSMakeRange(0, string.length)];
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont boldSystemFontOfSize:16.0]
+                           range:NSMakeRange(0, status.length+user.nick.length)];
+
+            [string addAttribute:NSForegroundColorAttributeName
+                           value:[self colorForNick:user.nick]
+                           range:NSMakeRange(0, status.length+user.nick.length)];
+
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont systemFontOfSize:12.0]
+                           range:NSMakeRange(status.length+user.nick.length+1, string.length-status.length-user.nick.length-1)];
+            
+            // Mark sender's nick so we can respond to tap actions
+            [string addAttribute:NSLinkAttributeName
+                           value:user
+                           range:NSMakeRange(0, status.length+user.nick.length)];
+
+            if ([_message.conversation isKindOfClass:[IRCChannel class]]) {
+                NSArray *mentions = [self getMentions:msg];
+                for (NSValue *range in mentions) {
+                    [string addAttribute:NSFontAttributeName
+                                   value:[UIFont boldSystemFontOfSize:12.0]
+                                   range:NSMakeRange(range.rangeValue.location+status.length+user.nick.length+1, range.rangeValue.length)];
+                }
+            }
+            break;
+        }
+        case ET_CTCP: {
+            
+            string = [[NSMutableAttributedString alloc] initWithAttributedString:[self setLinks:[[NSString alloc] initWithFormat:@"%@%@\n%@", status, user.nick, msg]]];
+            msg = [string.string substringFromIndex:status.length+user.nick.length+1];
+            
+            NSMutableParagraphStyle *paragraphStyle = [[NSMutableParagraphStyle alloc] init];
+            paragraphStyle.lineBreakMode = NSLineBreakByWordWrapping;
+            [string addAttribute:NSParagraphStyleAttributeName
+                           value:paragraphStyle
+                           range:NSMakeRange(0, string.length)];
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont boldSystemFontOfSize:16.0]
+                           range:NSMakeRange(0, status.length+user.nick.length)];
+            
+            [string addAttribute:NSForegroundColorAttributeName
+                           value:[self colorForNick:user.nick]
+                           range:NSMakeRange(0, status.length+user.nick.length)];
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont boldSystemFontOfSize:12.0]
+                           range:NSMakeRange(status.length+user.nick.length+1, string.length-status.length-user.nick.length-1)];
+            
+            _backgroundColor = [UIColor colorWithRed:0.7 green:0.7 blue:0.7 alpha:1];
+            
+            if ([_message.conversation isKindOfClass:[IRCChannel class]]) {
+                NSArray *mentions = [self getMentions:msg];
+                for (NSValue *range in mentions) {
+                    [string addAttribute:NSFontAttributeName
+                                   value:[UIFont boldSystemFontOfSize:12.0]
+                                   range:NSMakeRange(range.rangeValue.location+status.length+user.nick.length+1, range.rangeValue.length)];
+                }
+            }
+            break;
+        }
+        case ET_ERROR: {
+            string = [[NSMutableAttributedString alloc] initWithString:[NSString stringWithFormat:@"⚠ %@", msg]];
+            NSMutableParagraphStyle *paragraphStyle = [[NSMutableParagraphStyle alloc] init];
+            paragraphStyle.lineBreakMode = NSLineBreakByWordWrapping;
+            [string addAttribute:NSParagraphStyleAttributeName
+                           value:paragraphStyle
+                           range:NSMakeRange(0, string.length)];
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont systemFontOfSize:12.0]
+                           range:NSMakeRange(0, string.length)];
+            
+            _backgroundColor = [UIColor colorWithRed:0.941 green:0.796 blue:0.796 alpha:1]; /*#f0cbcb*/
+            
+            break;
+            
+        }
+        default: {
+            string = [[NSMutableAttributedString alloc] initWithString:[NSString stringWithFormat:@"Message not handled yet"]];
+            NSMutableParagraphStyle *paragraphStyle = [[NSMutableParagraphStyle alloc] init];
+            paragraphStyle.lineBreakMode = NSLineBreakByWordWrapping;
+            
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont systemFontOfSize:10.0]
+                           range:NSMakeRange(0, string.length)];
+
+            [string addAttribute:NSParagraphStyleAttributeName
+                           value:paragraphStyle
+                           range:NSMakeRange(0, string.length)];
+            [string addAttribute:NSFontAttributeName
+                           value:[UIFont systemFontOfSize:10.0]
+                           range:NSMakeRange(0, string.length)];
+            
+            break;
+        }
+    }
+    
+    return string;
+}
+
+- (NSArray *)linkRangesInString:(NSAttributedString *)string
+{
+    NSMutableArray *ranges = [[NSMutableArray alloc] init];
+    [string enumerateAttribute:NSLinkAttributeName
+                       inRange:NSMakeRange(0, string.length)
+                       options:0
+                    usingBlock:^(id value, NSRange range, BOOL *stop) {
+                        if (value)
+                            [ranges addObject:[NSValue valueWithRange:range]];
+                    }];
+    return ranges;
+}
+
+- (void)layoutLines
+{
+    CTTypesetterRef typesetter = CTTypesetterCreateWithAttributedString((__bridge CFAttributedStringRef)_attributedString);
+    
+    NSMutableArray *lineRanges  = [[NSMutableArray alloc] init];
+    NSMutableArray *linkRects   = [[NSMutableArray alloc] init];
+    NSMutableArray *linkTargets = [[NSMutableArray alloc] init];
+    
+    CFIndex offset = 0, length;
+    CGFloat y = 0;
+    do {
+        length = CTTypesetterSuggestLineBreak(typesetter, offset, _width);
+        CTLineRef line = CTTypesetterCreateLine(typesetter, CFRangeMake(offset, length));
+        
+        CGFloat ascent, descent, leading;
+        CTLineGetTypographicBounds(line, &ascent, &descent, &leading);
+        
+        [lineRanges addObject:[NSValue valueWithRange:NSMakeRange(offset, length)]];
+        
+        /* Measure the runs carrying a link while we have the line, the view puts a tap target on each of them. */
+        if (_linkRanges.count > 0) {
+            CFArrayRef glyphRuns = CTLineGetGlyphRuns(line);
+            for (CFIndex i = 0; i < CFArrayGetCount(glyphRuns); i++) {
+                CTRunRef run = CFArrayGetValueAtIndex(glyphRuns, i);
+                id target = [(__bridge NSDictionary *)CTRunGetAttributes(run) objectForKey:NSLinkAttributeName];
+                if (!target)
+                    continue;
+                
+                CGFloat runAscent, runDescent;
+                CGRect runBounds;
+                runBounds.size.width = CTRunGetTypographicBounds(run, CFRangeMake(0, 0), &runAscent, &runDescent, NULL);
+                runBounds.size.height = runAscent + runDescent;
+                runBounds.origin.x = CTLineGetOffsetForStringIndex(line, CTRunGetStringRange(run).location, NULL);
+                runBounds.origin.y = y + ascent - runBounds.size.height;
+                
+                [linkRects addObject:[NSValue valueWithCGRect:runBounds]];
+                [linkTargets addObject:target];
+            }
+        }
+        
+        CFRelease(line);
+        
+        offset += length;
+        y += ascent + descent + leading;
+    } while (length > 0 && offset < [_attributedString length]);
+    
+    CFRelease(typesetter);
+    
+    _lineRanges = lineRanges;
+    _linkRects = linkRects;
+    _linkTargets = linkTargets;
+    _size = CGSizeMake(_width, ceil(y));
+}
+
+- (NSAttributedString *)timestamp
+{
+    static NSDateFormatter *timeFormat;
+    static NSDateFormatter *dateFormat;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        timeFormat = [[NSDateFormatter alloc] init];
+        [timeFormat setLocale:[NSLocale currentLocale]];
+        [timeFormat setTimeStyle:NSDateFormatterMediumStyle];
+        
+        dateFormat = [[NSDateFormatter alloc] init];
+        [dateFormat setLocale:[NSLocale currentLocale]];
+        [dateFormat setTimeStyle:NSDateFormatterMediumStyle];
+        [dateFormat setDateStyle:NSDateFormatterMediumStyle];
+    });
+    
+    NSString *time = @"";
+    if (_message.timestamp) {
+        NSDate *date = _message.timestamp;
+        if (date.isYesterday) {
+            time = [NSString stringWithFormat:@"%@ %@", NSLocalizedString(@"yesterday", @"yesterday"), [timeFormat stringFromDate:date]];
+        } else if (date.isToday) {
+            time = [timeFormat stringFromDate:date];
+        } else {
+            time = [dateFormat stringFromDate:date];
+        }
+    }
+    
+    NSMutableAttributedString *timestamp = [[NSMutableAttributedString alloc] initWithString:time];
+    
+    [timestamp addAttribute:NSFontAttributeName
+                      value:[UIFont systemFontOfSize:12.0]
+                      range:NSMakeRange(0, timestamp.length)];
+    
+    [timestamp addAttribute:NSForegroundColorAttributeName
+                      value:[InterfaceLayoutDefinitions labelTextColour]
+                      range:NSMakeRange(0, timestamp.length)];
+    
+    return timestamp;
+}
+
+@end
@@ -30,13 +30,40 @@
 
 #import <UIKit/UIKit.h>
 
+/* The number of messages a transcript keeps before dropping the oldest */
+#define Message_Limit 5000
+
 @class IRCMessage;
+@class IRCConversation;
 
 @interface ConversationContentView : UIScrollView
 
 @property (assign) CGFloat posY;
 
+/*!
+ *    @brief  The conversation this transcript belongs to, asked for older history when the user scrolls up.
+ */
+@property (nonatomic, weak) IRCConversation *conversation;
+
+/*!
+ *    @brief  The messages in the transcript, oldest first. Only the rows on screen have a view.
+ */
+@property (nonatomic, readonly) NSArray *messages;
+
+/*!
+ *    @brief  The ChatMessageView objects currently showing a row of the transcript.
+ */
+@property (nonatomic, readonly) NSArray *visibleMessageViews;
+
 - (void)addMessage:(IRCMessage *)message;
+
+/*!
+ *    @brief  Add messages from the history above the first row of the transcript.
+ *
+ *    @param messages   The messages to add, oldest first and all older than the first row.
+ *    @param completion Called on the main thread once the messages are in the transcript.
+ */
+- (void)insertHistoricMessages:(NSArray *)messages completion:(void (^)(void))completion;
 - (void)clear;
 
 @end
@@ -30,77 +30,173 @@
 
 #import "ConversationContentView.h"
 #import "ChatMessageView.h"
+#import "ChatHeightIndex.h"
+#import "IRCConversation.h"
 
-#define Message_Limit 300
+/* Rows are numbered from the middle of the range so older history can be put in front of the first row without renumbering. */
+#define First_Row_Number (NSUIntegerMax / 2)
 
-@implementation ConversationContentView
+@implementation ConversationContentView {
+    NSUInteger _generation;
+    NSMutableArray *_rows;
+    ChatHeightIndex *_heightIndex;
+    CGFloat _layoutWidth;
+    NSUInteger _firstRowNumber;
+    NSMutableDictionary *_visibleViews;
+    NSMutableArray *_reusableViews;
+}
 
-- (void)addMessage:(IRCMessage *)message
+- (id)initWithFrame:(CGRect)frame
 {
+    self = [super initWithFrame:frame];
+    
+    if(!self)
+        return nil;
+    
+    /* The transcript is a list of rendered messages with the height of every row kept in a height index.
+     Only the rows on screen get a ChatMessageView, which goes back to the reuse pool once it scrolls out of sight. */
+    _rows = [[NSMutableArray alloc] init];
+    _heightIndex = [[ChatHeightIndex alloc] init];
+    _layoutWidth = frame.size.width;
+    _firstRowNumber = First_Row_Number;
+    _visibleViews = [[NSMutableDictionary alloc] init];
+    _reusableViews = [[NSMutableArray alloc] init];
+    
+    return self;
+}
 
+- (BOOL)shouldShowMessage:(IRCMessage *)message
+{
     if (message.messageType == ET_LIST || message.messageType == ET_LISTEND)
-        return;
+        return NO;
     
     if ([[NSUserDefaults standardUserDefaults] boolForKey:@"hideevents_preference"] == YES &&
         (message.messageType == ET_JOIN || message.messageType == ET_PART || message.messageType == ET_QUIT ||
          message.messageType == ET_NICK || message.messageType == ET_KICK || message.messageType == ET_MODE)) {
-            return;
+            return NO;
         }
+    return YES;
+}
+
+- (void)addMessage:(IRCMessage *)message
+{
+    if ([self shouldShowMessage:message] == NO)
+        return;
     
-    ChatMessageView *messageView = [[ChatMessageView alloc] initWithFrame:CGRectMake(0, 0, message.conversation.contentView.frame.size.width, 15.0)
-                                                                  message:message];
-    messageView.autoresizingMask = UIViewAutoresizingFlexibleWidth;
-    
-    if(!_posY)
-        _posY = 5.0;
-    
-    if (self.subviews.count > Message_Limit) {
-        CGFloat posY = 0.0;
-        for (ChatMessageView *view in self.subviews) {
-            if ([NSStringFromClass(view.class) isEqualToString:@"ChatMessageView"]) {
-                if (posY == 0.0) {
-                    
-                    // Adjust scrolling position
-                    CGFloat offset = self.contentOffset.y - view.frame.size.height;
-                    self.contentOffset = CGPointMake(self.contentOffset.x, offset-5);
-                    [view removeFromSuperview];
-                    posY = 5.0;
-                    continue;
-                }
-                CGFloat height = view.frameHeight;
-                view.frame = CGRectMake(0.0, posY, messageView.frame.size.width, height);
-                if (view.message.messageType != ET_PRIVMSG)
-                    posY += height + 5.0;
-                else
-                    posY += height + 15.0;
-            }
-        }
-        _posY = posY;
-        self.contentSize = CGSizeMake(self.frame.size.width, _posY);
+    /* Formatting and line breaking happen on the layout queue, only the finished message comes back here to be placed. */
+    NSUInteger generation = _generation;
+    [ChatRenderedMessage renderMessage:message width:_layoutWidth - 20.0 completion:^(ChatRenderedMessage *renderedMessage) {
+        if (generation != _generation)
+            return;
+        
+        [self addRenderedMessage:renderedMessage];
+    }];
+}
+
+- (void)insertHistoricMessages:(NSArray *)messages completion:(void (^)(void))completion
+{
+    NSMutableArray *shownMessages = [[NSMutableArray alloc] initWithCapacity:messages.count];
+    for (IRCMessage *message in messages) {
+        if ([self shouldShowMessage:message])
+            [shownMessages addObject:message];
+    }
+    
+    NSUInteger generation = _generation;
+    [ChatRenderedMessage renderMessages:shownMessages width:_layoutWidth - 20.0 completion:^(NSArray *renderedMessages) {
+        if (generation == _generation)
+            [self insertRenderedMessagesAtFront:renderedMessages];
+        
+        if (completion)
+            completion();
+    }];
+}
+
+- (void)insertRenderedMessagesAtFront:(NSArray *)renderedMessages
+{
+    /* A message that was still on the layout queue when the page was read is in the transcript already. */
+    NSMutableSet *shownIds = [[NSMutableSet alloc] initWithCapacity:_rows.count];
+    for (ChatRenderedMessage *renderedMessage in _rows) {
+        if (renderedMessage.message.id)
+            [shownIds addObject:@(renderedMessage.message.id)];
+    }
+    if (shownIds.count > 0) {
+        renderedMessages = [renderedMessages filteredArrayUsingPredicate:[NSPredicate predicateWithBlock:^BOOL(ChatRenderedMessage *renderedMessage, NSDictionary *bindings) {
+            return [shownIds containsObject:@(renderedMessage.message.id)] == NO;
+        }]];
     }
     
-    CGFloat height = messageView.frameHeight;
-    messageView.frame = CGRectMake(0.0, _posY, messageView.frame.size.width, height);
+    /* Only as much history as still fits in the transcript, the newest of it is closest to what is already there. */
+    NSUInteger count = MIN(renderedMessages.count, Message_Limit - MIN(_rows.count, Message_Limit));
+    if (count == 0)
+        return;
+    renderedMessages = [renderedMessages subarrayWithRange:NSMakeRange(renderedMessages.count - count, count)];
     
-    [self addSubview:messageView];
-    [self layoutIfNeeded];
+    BOOL wasEmpty = _rows.count == 0;
+    CGFloat *heights = malloc(count * sizeof(CGFloat));
+    BOOL needsLayout = NO;
+    for (NSUInteger i = 0; i < count; i++) {
+        ChatRenderedMessage *renderedMessage = renderedMessages[i];
+        heights[i] = [self rowHeightOfMessage:renderedMessage];
+        needsLayout |= renderedMessage.width != _layoutWidth - 20.0;
+    }
+    [_heightIndex insertRowsAtFrontWithHeights:heights count:count];
+    free(heights);
     
-    if (messageView.message.messageType != ET_PRIVMSG)
-        _posY += height + 5.0;
-    else
-        _posY += height + 15.0;
+    [_rows insertObjects:renderedMessages atIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, count)]];
+    _firstRowNumber -= count;
     
-    // Increase content size if needed
-    if (_posY > self.contentSize.height) {
-        self.contentSize = CGSizeMake(self.frame.size.width, _posY);
+    CGFloat insertedHeight = [_heightIndex offsetOfRow:count] - [_heightIndex offsetOfRow:0];
+    _posY = _heightIndex.totalHeight;
+    self.contentSize = CGSizeMake(self.frame.size.width, _posY);
+    
+    /* Keep what was on screen where it was, or start at the bottom if this is all there is. */
+    if (wasEmpty) {
+        self.contentOffset = CGPointMake(0, MAX(_posY - self.bounds.size.height, 0.0));
+    } else {
+        self.contentOffset = CGPointMake(self.contentOffset.x, self.contentOffset.y + insertedHeight);
     }
     
+    /* The view was rotated while these messages were on the layout queue. */
+    if (needsLayout)
+        [self relayoutRows:NSMakeRange(0, count)];
+    [self setNeedsLayout];
+}
+
+- (CGFloat)heightOfMessageView:(ChatRenderedMessage *)renderedMessage
+{
+    /* Private messages get 5pt of padding above and below the text. */
+    if (renderedMessage.message.messageType == ET_PRIVMSG)
+        return renderedMessage.height + 10.0;
+    return renderedMessage.height;
+}
+
+- (CGFloat)rowHeightOfMessage:(ChatRenderedMessage *)renderedMessage
+{
+    return [ChatHeightIndex rowHeightForHeight:renderedMessage.height messageType:renderedMessage.message.messageType];
+}
+
+- (void)addRenderedMessage:(ChatRenderedMessage *)renderedMessage
+{
+    CGFloat height = [self rowHeightOfMessage:renderedMessage];
+    [_rows addObject:renderedMessage];
+    [_heightIndex appendRowWithHeight:height];
+    
+    if (_rows.count > Message_Limit)
+        [self removeRowsFromFront:_rows.count - Message_Limit];
+    
+    /* The view was rotated while this message was on the layout queue. */
+    if (renderedMessage.width != _layoutWidth - 20.0)
+        [self relayoutRows:NSMakeRange(_rows.count - 1, 1)];
+    
+    _posY = _heightIndex.totalHeight;
+    self.contentSize = CGSizeMake(self.frame.size.width, _posY);
+    [self setNeedsLayout];
+    
     // Scroll to bottom if content is bigger than view and user didnt scroll up
     ConversationListViewController *controller = ((AppDelegate *)[UIApplication sharedApplication].delegate).conversationsController;
-    if ([messageView.message.conversation isEqual:controller.currentConversation] &&
+    if ([renderedMessage.message.conversation isEqual:controller.currentConversation] &&
         self.contentSize.height > self.bounds.size.height) {
         
-        CGFloat height = messageView.bounds.size.height;
         if (self.contentOffset.y + height + 100.0 > self.contentSize.height - self.bounds.size.height) {
             CGPoint bottomOffset = CGPointMake(0, _posY - self.frame.size.height);
             [self setContentOffset:bottomOffset animated:YES];
@@ -108,16 +204,146 @@
     }
 }
 
-- (void)clear
+- (void)removeRowsFromFront:(NSUInteger)count
+{
+    CGFloat removedHeight = [_heightIndex offsetOfRow:count] - [_heightIndex offsetOfRow:0];
+    
+    [_rows removeObjectsInRange:NSMakeRange(0, count)];
+    [_heightIndex removeRowsFromFront:count];
+    _firstRowNumber += count;
+    
+    // Adjust scrolling position
+    self.contentOffset = CGPointMake(self.contentOffset.x, MAX(self.contentOffset.y - removedHeight, 0.0));
+}
+
+- (void)relayoutRows:(NSRange)range
 {
-    for (UIView *view in self.subviews) {
-        if ([NSStringFromClass(view.class) isEqualToString:@"ChatMessageView"]) {
-            ChatMessageView *messageView = (ChatMessageView*)view;
+    NSArray *messages = [[_rows subarrayWithRange:range] valueForKey:@"message"];
+    NSUInteger firstRowNumber = _firstRowNumber + range.location;
+    NSUInteger generation = _generation;
+    CGFloat width = _layoutWidth;
+    
+    [ChatRenderedMessage renderMessages:messages width:width - 20.0 completion:^(NSArray *renderedMessages) {
+        if (generation != _generation || width != _layoutWidth)
+            return;
+        
+        /* Keep the row at the top of the screen where it is, or stay at the bottom if that is where we were. */
+        BOOL isAtBottom = self.contentOffset.y + self.bounds.size.height >= self.contentSize.height - 5.0;
+        NSUInteger anchorRow = [_heightIndex rowAtOffset:self.contentOffset.y];
+        NSUInteger anchorRowNumber = _firstRowNumber + anchorRow;
+        CGFloat anchorOffset = self.contentOffset.y - [_heightIndex offsetOfRow:anchorRow];
+        
+        for (NSUInteger i = 0; i < renderedMessages.count; i++) {
+            /* Rows may have been trimmed from the front while these were being laid out. */
+            NSUInteger rowNumber = firstRowNumber + i;
+            if (rowNumber < _firstRowNumber)
+                continue;
+            
+            NSUInteger row = rowNumber - _firstRowNumber;
+            ChatRenderedMessage *renderedMessage = renderedMessages[i];
+            _rows[row] = renderedMessage;
+            [_heightIndex setHeight:[self rowHeightOfMessage:renderedMessage] ofRow:row];
+            
+            ChatMessageView *messageView = _visibleViews[@(rowNumber)];
+            messageView.renderedMessage = renderedMessage;
+        }
+        
+        _posY = _heightIndex.totalHeight;
+        self.contentSize = CGSizeMake(self.frame.size.width, _posY);
+        
+        if (isAtBottom) {
+            self.contentOffset = CGPointMake(0, MAX(_posY - self.bounds.size.height, 0.0));
+        } else if (anchorRowNumber >= _firstRowNumber && _rows.count > 0) {
+            self.contentOffset = CGPointMake(0, [_heightIndex offsetOfRow:anchorRowNumber - _firstRowNumber] + anchorOffset);
+        }
+        [self setNeedsLayout];
+    }];
+}
+
+- (void)layoutSubviews
+{
+    [super layoutSubviews];
+    
+    if (_rows.count == 0) {
+        _layoutWidth = self.bounds.size.width;
+        return;
+    }
+    
+    if (self.bounds.size.width != _layoutWidth) {
+        _layoutWidth = self.bounds.size.width;
+        [self relayoutRows:NSMakeRange(0, _rows.count)];
+    }
+    
+    /* Fetch the next page of history before the user reaches the top. */
+    if (self.contentOffset.y < self.bounds.size.height && _conversation.hasMoreHistory)
+        [_conversation loadEarlierHistory];
+    
+    NSUInteger firstRow = [_heightIndex rowAtOffset:self.contentOffset.y];
+    NSUInteger lastRow = [_heightIndex rowAtOffset:self.contentOffset.y + self.bounds.size.height];
+    
+    for (NSNumber *rowNumber in _visibleViews.allKeys) {
+        NSUInteger number = rowNumber.unsignedIntegerValue;
+        if (number < _firstRowNumber + firstRow || number > _firstRowNumber + lastRow) {
+            ChatMessageView *messageView = _visibleViews[rowNumber];
             [messageView removeFromSuperview];
+            [_reusableViews addObject:messageView];
+            [_visibleViews removeObjectForKey:rowNumber];
+        }
+    }
+    
+    for (NSUInteger row = firstRow; row <= lastRow; row++) {
+        NSNumber *rowNumber = @(_firstRowNumber + row);
+        ChatRenderedMessage *renderedMessage = _rows[row];
+        ChatMessageView *messageView = _visibleViews[rowNumber];
+        
+        if (!messageView) {
+            messageView = [_reusableViews lastObject];
+            if (messageView) {
+                [_reusableViews removeLastObject];
+            } else {
+                messageView = [[ChatMessageView alloc] initWithFrame:CGRectMake(0, 0, self.bounds.size.width, 15.0)];
+                messageView.autoresizingMask = UIViewAutoresizingFlexibleWidth;
+            }
+            messageView.renderedMessage = renderedMessage;
+            _visibleViews[rowNumber] = messageView;
+            [self addSubview:messageView];
         }
+        
+        messageView.frame = CGRectMake(0.0, [_heightIndex offsetOfRow:row], self.bounds.size.width, [self heightOfMessageView:renderedMessage]);
     }
+}
+
+- (NSArray *)messages
+{
+    NSMutableArray *messages = [[NSMutableArray alloc] initWithCapacity:_rows.count];
+    for (ChatRenderedMessage *renderedMessage in _rows) {
+        [messages addObject:renderedMessage.message];
+    }
+    return messages;
+}
+
+- (NSArray *)visibleMessageViews
+{
+    NSArray *rowNumbers = [_visibleViews.allKeys sortedArrayUsingSelector:@selector(compare:)];
+    return [_visibleViews objectsForKeys:rowNumbers notFoundMarker:[NSNull null]];
+}
+
+- (void)clear
+{
+    for (ChatMessageView *messageView in _visibleViews.allValues) {
+        [messageView removeFromSuperview];
+        [_reusableViews addObject:messageView];
+    }
+    [_visibleViews removeAllObjects];
+    [_rows removeAllObjects];
+    [_heightIndex removeAllRows];
+    _firstRowNumber = First_Row_Number;
+    
     self.contentSize = self.frame.size;
     _posY = 0.0;
+    
+    /* Messages still on the layout queue belong to the transcript we just cleared. */
+    _generation++;
 
 }
 
@@ -32,12 +32,16 @@
 #import "ILTranslucentView.h"
 #import "../../Helpers/UITableView+Methods.m"
 #import "IRCUser.h"
+#import "IRCChannel.h"
+#import "IRCUserlistChange.h"
 #import "UserListItemCell.h"
 #import "UserInfoViewController.h"
 #import <UIActionSheet+Blocks/UIActionSheet+Blocks.h>
 
 @interface UserListView ()
 @property (nonatomic) ILTranslucentView *translucentView;
+@property (nonatomic) NSMutableArray *users;
+@property (nonatomic) NSArray *currentSnapshot;
 @end
 
 @implementation UserListView
@@ -59,11 +63,80 @@
         [_translucentView addSubview:_tableview];
         [self addSubview:_translucentView];
         
+        _users = [[NSMutableArray alloc] init];
+        
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(userlistChanged:)
+                                                     name:@"userlistChanged"
+                                                   object:nil];
     }
     
     return self;
 }
 
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+- (void)setChannel:(IRCChannel *)channel
+{
+    _channel = channel;
+    _currentSnapshot = channel.userlistSnapshot;
+    _users = [_currentSnapshot mutableCopy] ?: [[NSMutableArray alloc] init];
+}
+
+- (void)userlistChanged:(NSNotification *)notification
+{
+    if (notification.object != _channel) {
+        return;
+    }
+    
+    NSDictionary *userInfo = notification.userInfo;
+    NSArray *changes = userInfo[@"changes"];
+    
+    /* The changes can only be applied on top of the snapshot they were made against, anything else is a full reload. */
+    if (changes == nil || userInfo[@"previousUsers"] != _currentSnapshot) {
+        _users = [userInfo[@"users"] mutableCopy];
+        _currentSnapshot = userInfo[@"users"];
+        [_tableview reloadData];
+        return;
+    }
+    
+    /* Each change is relative to the list as it was after the previous one, so they are applied one at a time. */
+    for (IRCUserlistChange *change in changes) {
+        [_tableview beginUpdates];
+        NSIndexPath *fromIndexPath = [NSIndexPath indexPathForRow:change.fromIndex inSection:0];
+        NSIndexPath *toIndexPath = [NSIndexPath indexPathForRow:change.toIndex inSection:0];
+        switch (change.type) {
+            case USERLIST_INSERT:
+                [_users insertObject:change.user atIndex:change.toIndex];
+                [_tableview insertRowsAtIndexPaths:@[toIndexPath] withRowAnimation:UITableViewRowAnimationFade];
+                break;
+                
+            case USERLIST_DELETE:
+                [_users removeObjectAtIndex:change.fromIndex];
+                [_tableview deleteRowsAtIndexPaths:@[fromIndexPath] withRowAnimation:UITableViewRowAnimationFade];
+                break;
+                
+            case USERLIST_MOVE:
+                /* Delete and insert rather than move, the cell identifier depends on the privilege that changed. */
+                [_users removeObjectAtIndex:change.fromIndex];
+                [_users insertObject:change.user atIndex:change.toIndex];
+                [_tableview deleteRowsAtIndexPaths:@[fromIndexPath] withRowAnimation:UITableViewRowAnimationFade];
+                [_tableview insertRowsAtIndexPaths:@[toIndexPath] withRowAnimation:UITableViewRowAnimationFade];
+                break;
+                
+            case USERLIST_UPDATE:
+                [_tableview reloadRowsAtIndexPaths:@[fromIndexPath] withRowAnimation:UITableViewRowAnimationNone];
+                break;
+        }
+        [_tableview endUpdates];
+    }
+    
+    _currentSnapshot = userInfo[@"users"];
+}
+
 - (void)layoutSubviews
 {
     [super layoutSubviews];
@@ -74,19 +147,19 @@
 
 - (NSInteger)tableView:(UITableView *)tableView numberOfRowsInSection:(NSInteger)section
 {
-    return _channel.users.count;
+    return _users.count;
 }
 
 - (UITableViewCell*)tableView:(UITableView *)tableView cellForRowAtIndexPath:(NSIndexPath *)indexPath
 {
     
-    NSString *identifier = [NSString stringWithFormat:@"%@%i", NSStringFromClass(UserListItemCell.class), (int)[_channel.users[indexPath.row] channelPrivilege]];
+    NSString *identifier = [NSString stringWithFormat:@"%@%i", NSStringFromClass(UserListItemCell.class), (int)[_users[indexPath.row] channelPrivilege]];
     UserListItemCell *cell = [tableView dequeueReusableCellWithIdentifier:identifier];
     if (cell == nil) {
         cell = [[UserListItemCell alloc] initWithStyle:UITableViewCellStyleValue1 reuseIdentifier:identifier];
     }
 
-    cell.user = _channel.users[indexPath.row];
+    cell.user = _users[indexPath.row];
     cell.client = _channel.client;
     
     return cell;
@@ -96,7 +169,7 @@
 - (void)tableView:(UITableView *)tableView didSelectRowAtIndexPath:(NSIndexPath *)indexPath
 {
     
-    IRCUser *user = _channel.users[indexPath.row];
+    IRCUser *user = _users[indexPath.row];
     
     __block ConversationListViewController *controller = ((AppDelegate *)[UIApplication sharedApplication].delegate).conversationsController;
     
@@ -112,7 +185,7 @@
                          [self removeFromSuperview];
                          switch (buttonIndex) {
                              case 0: {
-                                 IRCConversation *conversation = [controller createConversationWithName:[_channel.users[indexPath.row] nick] onClient:_channel.client];
+                                 IRCConversation *conversation = [controller createConversationWithName:user.nick onClient:_channel.client];
 
                                  if(!actionSheet.isHidden)
                                      [controller dismissViewControllerAnimated:NO completion:nil];
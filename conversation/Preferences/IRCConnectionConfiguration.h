@@ -44,6 +44,7 @@
 @property (nonatomic, copy) NSString *primaryNickname;
 @property (nonatomic, copy) NSString *secondaryNickname;
 @property (nonatomic, copy) NSString *serverAddress;
+@property (nonatomic, copy) NSArray *alternativeServerAddresses;
 @property (nonatomic, copy) NSString *disconnectMessage;
 @property (nonatomic, copy) NSString *channelDepartMessage;
 
@@ -53,6 +54,9 @@
 
 @property (nonatomic) unsigned long messageEncoding;
 
+@property (nonatomic, assign) double floodControlBurst;
+@property (nonatomic, assign) double floodControlRate;
+
 @property (nonatomic, assign) BOOL automaticallyReconnect;
 @property (nonatomic, assign) BOOL automaticallyConnect;
 @property (nonatomic, assign) BOOL connectUsingSecureLayer;
@@ -30,6 +30,7 @@
 
 #import "IRCConnectionConfiguration.h"
 #import "IRCChannelConfiguration.h"
+#import "IRCSendQueue.h"
 #import <objc/runtime.h>
 
 @implementation IRCConnectionConfiguration
@@ -45,6 +46,7 @@
         self.primaryNickname = [[NSUserDefaults standardUserDefaults] stringForKey:@"nickname_preference"];
         self.secondaryNickname = @"Guest_";
         self.serverAddress = @"irc.example.net";
+        self.alternativeServerAddresses = [[NSArray alloc] init];
         self.connectionPort = 6667;
         self.serverPasswordReference = @"";
         self.socketEncodingType = NSUTF8StringEncoding;
@@ -61,6 +63,9 @@
         self.lastMessageTime = 0;
         
         self.messageEncoding = (unsigned long) NSUTF8StringEncoding;
+        
+        self.floodControlBurst = IRC_SEND_QUEUE_DEFAULT_BURST;
+        self.floodControlRate = IRC_SEND_QUEUE_DEFAULT_RATE;
 
         self.channels = [[NSArray alloc] init];
         self.queries = [[NSArray alloc] init];
@@ -84,6 +89,7 @@
         self.primaryNickname = dict[@"primaryNickname"];
         self.secondaryNickname = dict[@"secondaryNickname"];
         self.serverAddress = dict[@"serverAddress"];
+        self.alternativeServerAddresses = dict[@"alternativeServerAddresses"] ? dict[@"alternativeServerAddresses"] : [[NSArray alloc] init];
         self.connectionPort = [dict[@"connectionPort"] integerValue];
         self.serverPasswordReference = dict[@"serverPasswordReference"];
         self.authenticationPasswordReference = dict[@"authenticationPasswordReference"];
@@ -101,6 +107,10 @@
         
         self.messageEncoding = (unsigned long) [dict[@"messageEncoding"] integerValue];
         
+        /* Configurations saved before flood control could be tuned get the defaults. */
+        self.floodControlBurst = dict[@"floodControlBurst"] ? [dict[@"floodControlBurst"] doubleValue] : IRC_SEND_QUEUE_DEFAULT_BURST;
+        self.floodControlRate = dict[@"floodControlRate"] ? [dict[@"floodControlRate"] doubleValue] : IRC_SEND_QUEUE_DEFAULT_RATE;
+        
         self.lastMessageTime = [dict[@"lastMessageTime"] longValue];
         
         NSMutableArray *channels = [[NSMutableArray alloc] init];
@@ -36,6 +36,47 @@
 #import "IRCChannel.h"
 #import "IRCMessage.h"
 #import "WHOIS.h"
+#import "IRCParser.h"
+#import "InputCommands.h"
+#import "IRCValidation.h"
+#import "ChatRenderedMessage.h"
+#import "ChatMessageView.h"
+#import "ConversationContentView.h"
+#import "ChatHeightIndex.h"
+#import "IRCMessageStore.h"
+#import "IRCSendQueue.h"
+#import "IRCCommandBatcher.h"
+#import "IRCReconnectEngine.h"
+#import "IRCLagMonitor.h"
+#import "IRCMessageResolver.h"
+
+#define ParserBenchmarkIterations 2000
+#define MessageSchemaBenchmarkRows 1000000
+#define MessageSchemaBenchmarkConversations 40
+#define MessageSchemaBenchmarkSenders 1000
+#define MessageSchemaBenchmarkBatchSize 500
+#define MessageSchemaBenchmarkEnvironment @"CONVERSATION_RUN_BENCHMARKS"
+
+/* A representative sample of the traffic a bouncer replays on connect */
+static const char *parserBenchmarkCorpus[] = {
+    "@time=2015-02-01T10:00:00.000Z :John!jappleseed@apple.com PRIVMSG #conversation :Good day, how is everyone doing?",
+    "@time=2015-02-01T10:00:01.000Z :Clinteger!~Clinteger@unaffiliated/clinteger PRIVMSG #conversation :\001ACTION waves\001",
+    "@time=2015-02-01T10:00:02.000Z :John!jappleseed@apple.com NOTICE #conversation :\002Reminder\002: meeting in \00304ten\003 minutes",
+    ":Clinteger!~Clinteger@unaffiliated/clinteger JOIN #conversation",
+    ":John!jappleseed@apple.com PART #conversation :Leaving",
+    ":John!jappleseed@apple.com MODE #conversation +o Clinteger",
+    ":holmes.freenode.net 353 UnitTest = #conversation :@John +Clinteger alice bob carol dave eve mallory",
+    ":holmes.freenode.net 352 UnitTest #conversation ~alice example.com holmes.freenode.net alice H :0 Alice",
+    ":holmes.freenode.net 005 UnitTest CHANTYPES=# PREFIX=(ov)@+ NICKLEN=16 CASEMAPPING=rfc1459 :are supported by this server",
+    "PING :holmes.freenode.net",
+};
+
+@interface IRCMessageStore (Benchmark)
+
+/* The write step of a batch, without the transaction and trimming around it. Rows are in the order of +rowForMessage:. */
+- (BOOL)writeOperations:(NSArray *)operations intoConversations:(NSMutableSet *)conversations inDatabase:(FMDatabase *)db;
+
+@end
 
 @interface conversationTests : XCTestCase
 
@@ -81,9 +122,9 @@
     IRCChannel *channel = [[IRCChannel alloc] initWithConfiguration:testChannel withClient:self.testClient];
     
     IRCUser *user = [[IRCUser alloc] initWithNickname:@"John" andUsername:@"jappleseed" andHostname:@"apple.com" andRealname:@"John AppleSeed" onClient:self.testClient];
-    [channel.users addObject:user];
+    [channel addUser:user];
     IRCUser *kickUser = [[IRCUser alloc] initWithNickname:@"Clinteger" andUsername:@"~Clinteger" andHostname:@"unaffiliated/clinteger" andRealname:@"" onClient:self.testClient];
-    [channel.users addObject:kickUser];
+    [channel addUser:kickUser];
     
     [self.testClient addChannel:channel];
     
@@ -467,4 +508,934 @@
     [self waitForExpectationsWithTimeout:5.0 handler:nil];
 }
 
+- (void)testLineParserComponents {
+    const char *testMessage = "@time=2015-02-01T10:00:00.000Z;znc.in/batch :John!jappleseed@apple.com PRIVMSG #conversation :Good  day";
+    IRCParsedLine line;
+    XCTAssertTrue(IRCParseLine(testMessage, strlen(testMessage), &line));
+    
+    NSMutableDictionary *tags = IRCDictionaryFromTagsRange(line.tags, nil);
+    XCTAssertEqualObjects(tags[@"time"], @"2015-02-01T10:00:00.000Z");
+    XCTAssertEqualObjects(tags[@"znc.in/batch"], @"1");
+    
+    XCTAssertEqualObjects(IRCStringFromByteRange(line.prefix, nil), @"John!jappleseed@apple.com");
+    XCTAssertEqualObjects(IRCStringFromByteRange(line.command, nil), @"PRIVMSG");
+    XCTAssertEqual(line.parameterCount, (NSUInteger)1);
+    XCTAssertEqualObjects(IRCStringFromByteRange(line.parameters[0], nil), @"#conversation");
+    XCTAssertTrue(line.hasTrailing);
+    XCTAssertEqualObjects(IRCStringFromByteRange(line.trailing, nil), @"Good  day");
+    
+    XCTAssertEqual(IRCNumericReplyFromCommand(line.command), (NSInteger)0);
+    XCTAssertTrue(IRCParseLine("PING :irc.freenode.net", 22, &line));
+    XCTAssertTrue(line.prefix.bytes == NULL);
+    XCTAssertTrue(IRCParseLine(":holmes.freenode.net 353 UnitTest = #conversation :@John", 56, &line));
+    XCTAssertEqual(IRCNumericReplyFromCommand(line.command), (NSInteger)353);
+    XCTAssertEqual(line.parameterCount, (NSUInteger)3);
+}
+
+- (void)testCommandIndexLookup {
+    XCTAssertEqual([IRCMessageIndex indexValueFromString:@"PRIVMSG"], (NSUInteger)PRIVMSG);
+    XCTAssertEqual([IRCMessageIndex indexValueFromString:@"privmsg"], (NSUInteger)PRIVMSG);
+    XCTAssertEqual([IRCMessageIndex indexValueFromBytes:"001" length:3], (NSUInteger)RPL_WELCOME);
+    XCTAssertEqual([IRCMessageIndex indexValueFromBytes:"467" length:3], (NSUInteger)ERR_KEYSET);
+    XCTAssertEqual([IRCMessageIndex indexValueFromBytes:"908" length:3], (NSUInteger)RPL_SASLMECHS);
+    XCTAssertEqual([IRCMessageIndex indexValueFromBytes:"999" length:3], (NSUInteger)NSNotFound);
+    XCTAssertEqual([IRCMessageIndex indexValueFromString:@"PRIVMSGS"], (NSUInteger)NSNotFound);
+    
+    XCTAssertEqual([IRCMessageIndex capIndexValueFromString:@"ACK"], (NSUInteger)CAP_ACK);
+    XCTAssertEqual([IRCMessageIndex capIndexValueFromString:@"LIST"], (NSUInteger)NSNotFound);
+    
+    XCTAssertEqual([InputCommands indexValueFromString:@"DEOP"], (NSUInteger)CMD_DEOP);
+    XCTAssertEqual([InputCommands indexValueFromString:@"DEHOP"], (NSUInteger)CMD_DEHALFOP);
+    XCTAssertEqual([InputCommands indexValueFromString:@"K"], (NSUInteger)CMD_K);
+    XCTAssertEqual([InputCommands indexValueFromString:@"KB"], (NSUInteger)CMD_KB);
+    XCTAssertEqualObjects([InputCommands inputCommandReference][CMD_WHOIS], @"WHOIS");
+}
+
+- (void)testCaseMappedNameKeys {
+    XCTAssertTrue([self.testClient keyForName:@"Tom[away]"] == [self.testClient keyForName:@"tom{AWAY}"]);
+    XCTAssertTrue([@"Tom^" isEqualToName:@"tom~" onClient:self.testClient]);
+    XCTAssertFalse([@"Tom" isEqualToName:@"Tim" onClient:self.testClient]);
+    XCTAssertNotNil([IRCConversation fromString:@"#CONVERSATION" withClient:self.testClient]);
+    
+    IRCChannel *channel = [self.testClient.channels objectAtIndex:0];
+    IRCUser *user = [[IRCUser alloc] initWithNickname:@"Tom[away]" andUsername:@"tom" andHostname:@"example.com" andRealname:@"Tom" onClient:self.testClient];
+    [channel addUser:user];
+
+    [self.testClient clientDidReceiveData:":irc.example.com 005 UnitTest NICKLEN=30 CASEMAPPING=ascii :are supported by this server"];
+    XCTAssertEqual(self.testClient.caseMapping, CASEMAPPING_ASCII);
+    XCTAssertFalse([@"Tom[away]" isEqualToName:@"tom{away}" onClient:self.testClient]);
+    XCTAssertTrue([@"Tom[away]" isEqualToName:@"TOM[AWAY]" onClient:self.testClient]);
+    XCTAssertEqual([IRCConversation fromString:@"#CONVERSATION" withClient:self.testClient], channel);
+    
+    /* The userlist is keyed again with the new casemapping */
+    XCTAssertEqual([channel userWithNickname:@"TOM[AWAY]"], user);
+    XCTAssertNil([channel userWithNickname:@"tom{away}"]);
+}
+
+- (void)testConversationLookupIndex {
+    IRCChannel *channel = [self.testClient.channels objectAtIndex:0];
+    XCTAssertEqual([self.testClient conversationWithIdentifier:channel.configuration.uniqueIdentifier], channel);
+
+    IRCConversation *query = [[IRCConversation alloc] initWithConfiguration:[[IRCChannelConfiguration alloc] init] withClient:self.testClient];
+    query.name = @"John";
+    XCTAssertTrue([self.testClient addQuery:query]);
+    XCTAssertFalse([self.testClient addQuery:query]);
+    XCTAssertEqual([IRCConversation fromString:@"JOHN" withClient:self.testClient], query);
+
+    [self.testClient clientDidReceiveData:":John!jappleseed@apple.com NICK :Johnny"];
+    XCTAssertNil([IRCConversation fromString:@"John" withClient:self.testClient]);
+    XCTAssertEqual([IRCConversation fromString:@"johnny" withClient:self.testClient], query);
+    XCTAssertEqualObjects(query.name, @"Johnny");
+
+    [self.testClient removeQuery:query];
+    XCTAssertNil([IRCConversation fromString:@"Johnny" withClient:self.testClient]);
+    XCTAssertNil([self.testClient conversationWithIdentifier:query.configuration.uniqueIdentifier]);
+}
+
+- (void)testNameValidation {
+    XCTAssertTrue([@"#conversation" isValidChannelName:self.testClient]);
+    XCTAssertTrue([@"~#conversation" isValidChannelName:self.testClient]);
+    XCTAssertFalse([@"conversation" isValidChannelName:self.testClient]);
+    XCTAssertFalse([@"#con,versation" isValidChannelName:self.testClient]);
+    XCTAssertFalse([@"" isValidChannelName:nil]);
+
+    NSString *nickname, *username, *hostname;
+    XCTAssertTrue([@"John!jappleseed@apple.com" getUserHostComponents:&nickname username:&username hostname:&hostname onClient:self.testClient]);
+    XCTAssertEqualObjects(nickname, @"John");
+    XCTAssertEqualObjects(username, @"jappleseed");
+    XCTAssertEqualObjects(hostname, @"apple.com");
+    XCTAssertFalse([@"irc.example.com" getUserHostComponents:&nickname username:&username hostname:&hostname onClient:self.testClient]);
+    XCTAssertFalse([@"John!j@ppleseed@apple.com" getUserHostComponents:&nickname username:&username hostname:&hostname onClient:self.testClient]);
+
+    [self.testClient clientDidReceiveData:":irc.example.com 005 UnitTest PREFIX=(ov)@+ NICKLEN=30 CHANTYPES=& :are supported by this server"];
+    XCTAssertFalse([@"#conversation" isValidChannelName:self.testClient]);
+    XCTAssertTrue([@"&conversation" isValidChannelName:self.testClient]);
+    XCTAssertTrue([@"AVeryLongNicknameOfTwentyFive" isValidNickname:self.testClient]);
+    XCTAssertFalse([@"AVeryLongNicknameOfTwentyFive" isValidNickname:nil]);
+}
+
+- (void)testMentionMatcher {
+    IRCChannel *channel = [self.testClient.channels objectAtIndex:0];
+    NSString *message = @"JOHN: have you seen Johnny or clinteger's patch?";
+
+    NSArray *mentions = [channel.mentionMatcher rangesOfMentionsInString:message];
+    XCTAssertEqual([mentions count], (NSUInteger)2);
+    XCTAssertTrue(NSEqualRanges([mentions[0] rangeValue], NSMakeRange(0, 4)));
+    XCTAssertTrue(NSEqualRanges([mentions[1] rangeValue], NSMakeRange(30, 9)));
+
+    [channel renameUser:[channel userWithNickname:@"John"] toNickname:@"Johnny"];
+    mentions = [channel.mentionMatcher rangesOfMentionsInString:message];
+    XCTAssertEqual([mentions count], (NSUInteger)2);
+    XCTAssertTrue(NSEqualRanges([mentions[0] rangeValue], NSMakeRange(20, 6)));
+
+    [channel removeUserByName:@"Clinteger"];
+    XCTAssertEqual([[channel.mentionMatcher rangesOfMentionsInString:message] count], (NSUInteger)1);
+
+    NSString *nickname = self.testClient.currentUserOnConnection.nick;
+    XCTAssertTrue([channel stringMentionsCurrentUser:[NSString stringWithFormat:@"hello %@!", [nickname uppercaseString]]]);
+    XCTAssertFalse([channel stringMentionsCurrentUser:[NSString stringWithFormat:@"hello %@s", nickname]]);
+}
+
+- (void)testRenderedMessageLayout {
+    IRCChannel *channel = [self.testClient.channels objectAtIndex:0];
+    IRCUser *sender = [channel userWithNickname:@"Clinteger"];
+    IRCMessage *message = [[IRCMessage alloc] initWithMessage:@"John: the patch is at http://example.com/patch, see #conversation"
+                                                       OfType:ET_PRIVMSG
+                                               inConversation:channel
+                                                     bySender:sender
+                                                       atTime:[NSDate date]
+                                                     withTags:nil
+                                              isServerMessage:NO
+                                                     onClient:self.testClient];
+    
+    ChatRenderedMessage *renderedMessage = [ChatRenderedMessage renderedMessageForMessage:message width:200.0];
+    XCTAssertTrue([renderedMessage.attributedString.string hasPrefix:@"Clinteger\nJohn: "]);
+    XCTAssertNotNil(renderedMessage.timeString);
+    XCTAssertEqual([renderedMessage.linkRanges count], (NSUInteger)3);
+    XCTAssertEqual([renderedMessage.linkRects count], [renderedMessage.linkTargets count]);
+    XCTAssertTrue([renderedMessage.linkRects count] >= [renderedMessage.linkRanges count]);
+    XCTAssertTrue(renderedMessage.size.height > 0);
+    
+    NSUInteger location = 0;
+    for (NSValue *line in renderedMessage.lineRanges) {
+        XCTAssertEqual(line.rangeValue.location, location);
+        location = NSMaxRange(line.rangeValue);
+    }
+    XCTAssertEqual(location, renderedMessage.attributedString.length);
+    
+    XCTAssertEqual([ChatRenderedMessage renderedMessageForMessage:message width:200.0], renderedMessage);
+    ChatRenderedMessage *narrowMessage = [ChatRenderedMessage renderedMessageForMessage:message width:100.0];
+    XCTAssertNotEqual(narrowMessage, renderedMessage);
+    XCTAssertTrue([narrowMessage.lineRanges count] > [renderedMessage.lineRanges count]);
+}
+
+- (void)testTranscriptOnlyMaterialisesVisibleRows {
+    IRCChannel *channel = [self.testClient.channels objectAtIndex:0];
+    IRCUser *sender = [channel userWithNickname:@"John"];
+    ConversationContentView *contentView = [[ConversationContentView alloc] initWithFrame:CGRectMake(0, 0, 320, 200)];
+    
+    IRCMessage *message;
+    for (int i = 0; i < 100; i++) {
+        message = [[IRCMessage alloc] initWithMessage:[NSString stringWithFormat:@"Message number %d", i]
+                                               OfType:ET_PRIVMSG
+                                       inConversation:channel
+                                             bySender:sender
+                                               atTime:[NSDate date]
+                                             withTags:nil
+                                      isServerMessage:NO
+                                             onClient:self.testClient];
+        [contentView addMessage:message];
+    }
+    
+    /* Rendered messages come back in order, so once this one arrives the transcript has all of the messages above. */
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Messages rendered"];
+    [ChatRenderedMessage renderMessage:message width:300.0 completion:^(ChatRenderedMessage *renderedMessage) {
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    [contentView layoutIfNeeded];
+    XCTAssertEqual([contentView.messages count], (NSUInteger)100);
+    XCTAssertTrue([contentView.visibleMessageViews count] > 0);
+    XCTAssertTrue([contentView.visibleMessageViews count] < 20);
+    XCTAssertTrue(contentView.posY > contentView.bounds.size.height);
+    
+    contentView.contentOffset = CGPointMake(0, contentView.posY - contentView.bounds.size.height);
+    [contentView layoutIfNeeded];
+    XCTAssertTrue([contentView.visibleMessageViews count] < 20);
+    XCTAssertEqual([(ChatMessageView *)[contentView.visibleMessageViews lastObject] message], message);
+    
+    [contentView clear];
+    XCTAssertEqual([contentView.messages count], (NSUInteger)0);
+    XCTAssertEqual([contentView.visibleMessageViews count], (NSUInteger)0);
+}
+
+- (void)testTranscriptHeightIndex {
+    ChatHeightIndex *index = [[ChatHeightIndex alloc] init];
+    NSMutableArray *heights = [[NSMutableArray alloc] init];
+    
+    for (int i = 0; i < 1000; i++) {
+        CGFloat height = [ChatHeightIndex rowHeightForHeight:(i % 7) * 10.0 + 12.0 messageType:(i % 3 == 0) ? ET_PRIVMSG : ET_JOIN];
+        [index appendRowWithHeight:height];
+        [heights addObject:@(height)];
+    }
+    
+    [index setHeight:100.0 ofRow:500];
+    heights[500] = @100.0;
+    [index removeRowsFromFront:300];
+    [heights removeObjectsInRange:NSMakeRange(0, 300)];
+    XCTAssertEqual(index.count, [heights count]);
+    
+    CGFloat offset = CHAT_TRANSCRIPT_TOP_MARGIN;
+    for (NSUInteger row = 0; row < [heights count]; row++) {
+        XCTAssertEqualWithAccuracy([index offsetOfRow:row], offset, 0.001);
+        XCTAssertEqual([index rowAtOffset:offset], row);
+        XCTAssertEqual([index rowAtOffset:offset + [heights[row] doubleValue] - 0.5], row);
+        offset += [heights[row] doubleValue];
+    }
+    XCTAssertEqualWithAccuracy(index.totalHeight, offset, 0.001);
+    XCTAssertEqual([index rowAtOffset:-50.0], (NSUInteger)0);
+    XCTAssertEqual([index rowAtOffset:offset + 50.0], index.count - 1);
+}
+
+- (void)testTranscriptHeightIndexInsertAtFront {
+    ChatHeightIndex *index = [[ChatHeightIndex alloc] init];
+    NSMutableArray *heights = [[NSMutableArray alloc] init];
+    
+    for (int i = 0; i < 200; i++) {
+        [index appendRowWithHeight:20.0 + i % 5];
+        [heights addObject:@(20.0 + i % 5)];
+    }
+    [index removeRowsFromFront:30];
+    [heights removeObjectsInRange:NSMakeRange(0, 30)];
+    
+    /* The first page fits in the removed rows, the second one does not. */
+    for (int page = 0; page < 2; page++) {
+        CGFloat pageHeights[100];
+        NSMutableArray *pageRows = [[NSMutableArray alloc] init];
+        for (int i = 0; i < 25 + page * 75; i++) {
+            pageHeights[i] = 15.0 + (i * 7) % 11;
+            [pageRows addObject:@(pageHeights[i])];
+        }
+        
+        CGFloat oldFirstOffset = [index offsetOfRow:0];
+        CGFloat oldTotalHeight = index.totalHeight;
+        [index insertRowsAtFrontWithHeights:pageHeights count:[pageRows count]];
+        [heights insertObjects:pageRows atIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, [pageRows count])]];
+        
+        CGFloat insertedHeight = [[pageRows valueForKeyPath:@"@sum.self"] doubleValue];
+        XCTAssertEqualWithAccuracy([index offsetOfRow:[pageRows count]], oldFirstOffset + insertedHeight, 0.001);
+        XCTAssertEqualWithAccuracy(index.totalHeight, oldTotalHeight + insertedHeight, 0.001);
+    }
+    XCTAssertEqual(index.count, [heights count]);
+    
+    CGFloat offset = CHAT_TRANSCRIPT_TOP_MARGIN;
+    for (NSUInteger row = 0; row < [heights count]; row++) {
+        XCTAssertEqualWithAccuracy([index offsetOfRow:row], offset, 0.001);
+        XCTAssertEqual([index rowAtOffset:offset + 1.0], row);
+        offset += [heights[row] doubleValue];
+    }
+}
+
+- (void)testSendQueuePriorities {
+    IRCSendQueue *sendQueue = [[IRCSendQueue alloc] initWithBurst:3.0 rate:1.0];
+    NSData *(^line)(NSString *) = ^(NSString *text) {
+        return [[text stringByAppendingString:@"\r\n"] dataUsingEncoding:NSUTF8StringEncoding];
+    };
+    
+    XCTAssertEqual([IRCSendQueue priorityOfLine:@"PONG :irc.example.net"], IRC_SEND_PRIORITY_URGENT);
+    XCTAssertEqual([IRCSendQueue priorityOfLine:@"@label=1 quit :Bye"], IRC_SEND_PRIORITY_URGENT);
+    XCTAssertEqual([IRCSendQueue priorityOfLine:@"NICK John"], IRC_SEND_PRIORITY_NORMAL);
+    XCTAssertEqual([IRCSendQueue priorityOfLine:@"JOIN #conversation"], IRC_SEND_PRIORITY_NORMAL);
+    XCTAssertEqual([IRCSendQueue priorityOfLine:@"PRIVMSG #conversation :Hello"], IRC_SEND_PRIORITY_NORMAL);
+    
+    /* Without throttling everything goes right away, in the order it was queued. */
+    NSTimeInterval delay;
+    NSArray *registration = @[@"PASS secret", @"CAP LS 302", @"NICK John", @"USER john 0 * :John", @"PONG :irc.example.net"];
+    for (NSString *text in registration) {
+        [sendQueue addLine:line(text) withPriority:[IRCSendQueue priorityOfLine:text]];
+    }
+    for (NSString *text in registration) {
+        XCTAssertEqualObjects([sendQueue nextLineAtTime:0 delay:&delay], line(text));
+    }
+    XCTAssertNil([sendQueue nextLineAtTime:0 delay:&delay]);
+    
+    [sendQueue setThrottled:YES atTime:100];
+    for (int i = 0; i < 200; i++) {
+        [sendQueue addLine:line([NSString stringWithFormat:@"PRIVMSG #conversation :Pasted line %d", i]) withPriority:IRC_SEND_PRIORITY_NORMAL];
+    }
+    
+    /* A full bucket lets two short lines through, the third has to wait for tokens. */
+    XCTAssertNotNil([sendQueue nextLineAtTime:100 delay:&delay]);
+    XCTAssertNotNil([sendQueue nextLineAtTime:100 delay:&delay]);
+    XCTAssertNil([sendQueue nextLineAtTime:100 delay:&delay]);
+    XCTAssertGreaterThan(delay, 0.0);
+    XCTAssertLessThan(delay, 2.0);
+    
+    /* A PONG queued behind the waiting paste goes first even with an empty bucket, a JOIN waits its turn. */
+    [sendQueue addLine:line(@"JOIN #conversation") withPriority:IRC_SEND_PRIORITY_NORMAL];
+    [sendQueue addLine:line(@"PONG :irc.example.net") withPriority:IRC_SEND_PRIORITY_URGENT];
+    XCTAssertEqualObjects([sendQueue nextLineAtTime:100 delay:&delay], line(@"PONG :irc.example.net"));
+    XCTAssertNil([sendQueue nextLineAtTime:100 delay:&delay]);
+    XCTAssertEqualObjects([sendQueue nextLineAtTime:100 + delay + 0.001 delay:&delay], line(@"PRIVMSG #conversation :Pasted line 2"));
+    XCTAssertEqual(sendQueue.count, (NSUInteger)198);
+    
+    /* Once the paste is paced the bucket never refills past its burst. */
+    NSData *next = [sendQueue nextLineAtTime:1000 delay:&delay];
+    XCTAssertEqualObjects(next, line(@"PRIVMSG #conversation :Pasted line 3"));
+    NSUInteger sent = 1;
+    while ([sendQueue nextLineAtTime:1000 delay:&delay]) {
+        sent++;
+    }
+    XCTAssertEqual(sent, (NSUInteger)2);
+    
+    [sendQueue removeAllLines];
+    XCTAssertEqual(sendQueue.count, (NSUInteger)0);
+}
+
+- (void)testSendQueueCoalescesLines {
+    IRCSendQueue *sendQueue = [[IRCSendQueue alloc] initWithBurst:3.0 rate:1.0];
+    NSData *(^line)(NSString *) = ^(NSString *text) {
+        return [[text stringByAppendingString:@"\r\n"] dataUsingEncoding:NSUTF8StringEncoding];
+    };
+    
+    NSTimeInterval delay;
+    XCTAssertNil([sendQueue linesAtTime:0 delay:&delay]);
+    
+    [sendQueue addLine:line(@"JOIN #conversation") withPriority:IRC_SEND_PRIORITY_NORMAL];
+    XCTAssertEqualObjects([sendQueue linesAtTime:0 delay:&delay], line(@"JOIN #conversation"));
+    
+    /* Everything the bucket allows comes out as one buffer, in the order it was queued. */
+    [sendQueue setThrottled:YES atTime:0];
+    [sendQueue addLine:line(@"PRIVMSG NickServ :IDENTIFY secret") withPriority:IRC_SEND_PRIORITY_NORMAL];
+    [sendQueue addLine:line(@"JOIN #conversation") withPriority:IRC_SEND_PRIORITY_NORMAL];
+    [sendQueue addLine:line(@"JOIN #ios") withPriority:IRC_SEND_PRIORITY_NORMAL];
+    [sendQueue addLine:line(@"ISON John Sarah") withPriority:IRC_SEND_PRIORITY_NORMAL];
+    [sendQueue addLine:line(@"PONG :irc.example.net") withPriority:IRC_SEND_PRIORITY_URGENT];
+    
+    /* The PONG joins the same write once the JOIN in front of it has to wait for tokens. */
+    NSData *lines = [sendQueue linesAtTime:0 delay:&delay];
+    NSString *text = [[NSString alloc] initWithData:lines encoding:NSUTF8StringEncoding];
+    XCTAssertEqualObjects(text, @"PRIVMSG NickServ :IDENTIFY secret\r\nJOIN #conversation\r\nPONG :irc.example.net\r\n");
+    XCTAssertGreaterThan(delay, 0.0);
+    XCTAssertEqual(sendQueue.count, (NSUInteger)2);
+    
+    text = [[NSString alloc] initWithData:[sendQueue linesAtTime:1000 delay:&delay] encoding:NSUTF8StringEncoding];
+    XCTAssertEqualObjects(text, @"JOIN #ios\r\nISON John Sarah\r\n");
+}
+
+- (void)testCommandBatcher {
+    NSDictionary *features = @{@"MODES": @"4", @"NICKLEN": @"9", @"TARGMAX": @"PRIVMSG:4,NOTICE:4,JOIN:3"};
+    IRCCommandBatcher *batcher = [[IRCCommandBatcher alloc] initWithFeatures:features nickname:@"John" username:@"john" hostname:@"example.com" encoding:NSUTF8StringEncoding];
+    XCTAssertEqual(batcher.prefixLength, (NSUInteger)(9 + 4 + 11 + 4));
+    XCTAssertEqual([batcher maximumTargetsForCommand:@"join"], (NSUInteger)3);
+    XCTAssertEqual([batcher maximumTargetsForCommand:@"KICK"], NSUIntegerMax);
+    
+    NSArray *joins = [batcher joinLinesForChannels:@[@"#a", @"#b", @"#c", @"#d"]];
+    XCTAssertEqualObjects(joins, (@[@"JOIN #a,#b,#c", @"JOIN #d"]));
+    
+    NSArray *modes = [batcher modeLinesForChannel:@"#a" adding:YES mode:@"o" arguments:@[@"u1", @"u2", @"u3", @"u4", @"u5"]];
+    XCTAssertEqualObjects(modes, (@[@"MODE #a +oooo u1 u2 u3 u4", @"MODE #a +o u5"]));
+    modes = [batcher modeLinesForChannel:@"#a" adding:NO mode:@"v" arguments:@[@"u1"]];
+    XCTAssertEqualObjects(modes, @[@"MODE #a -v u1"]);
+    
+    /* Without MODES the RFC1459 limit of three applies. */
+    IRCCommandBatcher *defaultBatcher = [[IRCCommandBatcher alloc] initWithFeatures:@{} nickname:@"John" username:nil hostname:nil encoding:NSUTF8StringEncoding];
+    XCTAssertEqual(defaultBatcher.modesPerLine, (NSUInteger)3);
+    
+    NSMutableArray *nicknames = [[NSMutableArray alloc] init];
+    for (int i = 0; i < 100; i++) {
+        [nicknames addObject:[NSString stringWithFormat:@"nickname%d", i]];
+    }
+    NSArray *isons = [batcher isonLinesForNicknames:nicknames];
+    XCTAssertEqual([isons count], (NSUInteger)3);
+    NSMutableArray *askedFor = [[NSMutableArray alloc] init];
+    for (NSString *line in isons) {
+        XCTAssertLessThanOrEqual([line lengthOfBytesUsingEncoding:NSUTF8StringEncoding], (NSUInteger)510);
+        [askedFor addObjectsFromArray:[[line substringFromIndex:6] componentsSeparatedByString:@" "]];
+    }
+    XCTAssertEqualObjects(askedFor, nicknames);
+    
+    /* Long messages are split at spaces, a word without spaces between two characters, and multibyte characters stay whole. */
+    NSString *head = @"PRIVMSG #a :";
+    NSString *text = [[@"" stringByPaddingToLength:300 withString:@"word " startingAtIndex:0] stringByAppendingString:[@"" stringByPaddingToLength:399 withString:@"é\U0001F600" startingAtIndex:0]];
+    NSArray *lines = [batcher linesForCommand:@"PRIVMSG" target:@"#a" text:text ctcp:nil];
+    XCTAssertGreaterThan([lines count], (NSUInteger)1);
+    NSMutableString *sent = [[NSMutableString alloc] init];
+    for (NSString *line in lines) {
+        XCTAssertTrue([line hasPrefix:head]);
+        XCTAssertLessThanOrEqual([line lengthOfBytesUsingEncoding:NSUTF8StringEncoding] + batcher.prefixLength, (NSUInteger)510);
+        XCTAssertNotNil([line dataUsingEncoding:NSUTF8StringEncoding allowLossyConversion:NO]);
+        [sent appendString:[line substringFromIndex:head.length]];
+    }
+    XCTAssertEqualObjects([sent stringByReplacingOccurrencesOfString:@" " withString:@""], [text stringByReplacingOccurrencesOfString:@" " withString:@""]);
+    XCTAssertTrue([lines[0] hasSuffix:@"word"]);
+    
+    lines = [batcher linesForCommand:@"PRIVMSG" target:@"#a" text:@"waves" ctcp:@"ACTION"];
+    XCTAssertEqualObjects(lines, @[@"PRIVMSG #a :\001ACTION waves\001"]);
+}
+
+- (void)testReconnectEngine {
+    __block NSTimeInterval now = 1000;
+    __block double jitter = 0.5;
+    IRCReconnectEngine *engine = [[IRCReconnectEngine alloc] initWithServers:@[@"irc1.example.net", @"irc2.example.net"]
+                                                                       clock:^NSTimeInterval{ return now; }
+                                                                      random:^double{ return jitter; }];
+    engine.maximumAttempts = 5;
+    engine.maximumDelay = 8.0;
+    
+    /* Failures back off exponentially with the jitter in the upper half, and alternate between the servers. */
+    XCTAssertEqualObjects([engine serverForNextAttempt], @"irc1.example.net");
+    XCTAssertEqualWithAccuracy([engine connectionDidFail], 0.75, 0.001);
+    XCTAssertEqualObjects([engine serverForNextAttempt], @"irc2.example.net");
+    XCTAssertEqualWithAccuracy([engine connectionDidFail], 1.5, 0.001);
+    XCTAssertEqualObjects([engine serverForNextAttempt], @"irc1.example.net");
+    jitter = 0.0;
+    XCTAssertEqualWithAccuracy([engine connectionDidFail], 2.0, 0.001);
+    XCTAssertEqual(engine.state, RECONNECT_STATE_WAITING);
+    
+    /* The server that lets us in goes first from now on and the backoff starts over. */
+    XCTAssertEqualObjects([engine serverForNextAttempt], @"irc2.example.net");
+    now += 2.5;
+    [engine connectionDidRegister];
+    XCTAssertEqual(engine.failedAttempts, (NSUInteger)0);
+    XCTAssertEqualObjects([[engine serversByHealth][0] address], @"irc2.example.net");
+    XCTAssertEqualWithAccuracy([[engine serversByHealth][0] averageRegistrationTime], 2.5, 0.001);
+    
+    /* Losing a connection that was up for a while retries right away, on the same server. */
+    now += 600;
+    XCTAssertEqual([engine connectionDidFail], 0.0);
+    XCTAssertEqualObjects([engine serverForNextAttempt], @"irc2.example.net");
+    
+    /* A connection that drops right after registering backs off like a failure. */
+    [engine connectionDidRegister];
+    now += 5;
+    XCTAssertEqualWithAccuracy([engine connectionDidFail], 0.5, 0.001);
+    
+    /* The engine gives up after the maximum number of attempts and starts over when told to connect again. */
+    for (int i = 0; i < 4; i++) {
+        [engine serverForNextAttempt];
+        XCTAssertGreaterThan([engine connectionDidFail], 0.0);
+    }
+    [engine serverForNextAttempt];
+    XCTAssertLessThan([engine connectionDidFail], 0.0);
+    XCTAssertEqual(engine.state, RECONNECT_STATE_STOPPED);
+    [engine serverForNextAttempt];
+    XCTAssertEqual(engine.failedAttempts, (NSUInteger)0);
+    
+    /* Health survives the list of servers being edited. */
+    [engine setServers:@[@"irc3.example.net", @"IRC2.example.net"]];
+    XCTAssertEqual([[engine serversByHealth] count], (NSUInteger)2);
+    XCTAssertTrue([[[engine serversByHealth] valueForKey:@"successes"] containsObject:@2]);
+}
+
+- (void)testLagMonitor {
+    __block NSTimeInterval now = 500;
+    IRCLagMonitor *monitor = [[IRCLagMonitor alloc] initWithPingInterval:60 pongTimeout:30 clock:^NSTimeInterval{ return now; }];
+    XCTAssertNil([monitor pingTokenIfDue]);
+    
+    /* The first PING goes out right away, the next one only after the interval and once the first was answered. */
+    [monitor start];
+    NSString *token = [monitor pingTokenIfDue];
+    XCTAssertNotNil(token);
+    XCTAssertNil([monitor pingTokenIfDue]);
+    
+    now += 0.25;
+    XCTAssertFalse([monitor receivedPongWithToken:@"irc.example.net"]);
+    XCTAssertTrue([monitor receivedPongWithToken:token]);
+    XCTAssertFalse([monitor receivedPongWithToken:token]);
+    XCTAssertEqualWithAccuracy(monitor.lag, 0.25, 0.001);
+    
+    now += 30;
+    XCTAssertNil([monitor pingTokenIfDue]);
+    now += 30;
+    NSString *nextToken = [monitor pingTokenIfDue];
+    XCTAssertNotNil(nextToken);
+    XCTAssertNotEqualObjects(nextToken, token);
+    now += 1.5;
+    XCTAssertTrue([monitor receivedPongWithToken:nextToken]);
+    XCTAssertEqualObjects(monitor.lagHistory, (@[@0.25, @1.5]));
+    
+    /* A PING without an answer for longer than the timeout means the connection is dead. */
+    now += 60;
+    [monitor pingTokenIfDue];
+    now += 29;
+    XCTAssertFalse([monitor pongIsOverdue]);
+    now += 1;
+    XCTAssertTrue([monitor pongIsOverdue]);
+    
+    /* Nothing is overdue once the connection has been closed, and a new connection starts a new history. */
+    [monitor stop];
+    XCTAssertFalse([monitor pongIsOverdue]);
+    [monitor start];
+    XCTAssertEqual([monitor.lagHistory count], (NSUInteger)0);
+    XCTAssertLessThan(monitor.lag, 0.0);
+}
+
+- (void)testMessageStoreTrimsHistory {
+    if ([FCModel databaseIsOpen] == NO)
+        return;
+    
+    IRCChannel *channel = [self.testClient.channels objectAtIndex:0];
+    IRCUser *user = [channel userWithNickname:@"John"];
+    IRCMessageStore *store = [IRCMessageStore sharedStore];
+    NSUInteger historyLimit = store.historyLimit;
+    store.historyLimit = 20;
+    
+    for (int i = 0; i < 75; i++) {
+        IRCMessage *message = [[IRCMessage alloc] initWithMessage:[NSString stringWithFormat:@"Message %d", i] OfType:ET_PRIVMSG inConversation:channel bySender:user atTime:[NSDate date] withTags:nil isServerMessage:NO onClient:self.testClient];
+        [store appendMessage:message];
+    }
+    [store flushAndWait];
+    store.historyLimit = historyLimit;
+    
+    NSString *identifier = channel.configuration.uniqueIdentifier;
+    NSArray *messages = [store messagesInConversation:identifier before:DBL_MAX messageId:0 limit:100];
+    XCTAssertEqual([messages count], (NSUInteger)20);
+    XCTAssertEqualObjects([[messages lastObject] message], @"Message 55");
+    XCTAssertEqualObjects([[messages firstObject] message], @"Message 74");
+    XCTAssertEqualObjects([[[messages firstObject] sender] fullhostmask], user.fullhostmask);
+    XCTAssertEqual([[messages firstObject] conversation], channel);
+    XCTAssertTrue([[messages firstObject] isConversationHistory]);
+    
+    IRCMessage *oldestMessage = messages[9];
+    NSArray *nextPage = [store messagesInConversation:identifier before:[oldestMessage.timestamp timeIntervalSince1970] messageId:oldestMessage.id limit:100];
+    XCTAssertEqualObjects([nextPage valueForKey:@"message"], [[messages subarrayWithRange:NSMakeRange(10, 10)] valueForKey:@"message"]);
+    
+    /* The transcript reads its pages without blocking the main thread. */
+    XCTestExpectation *pageExpectation = [self expectationWithDescription:@"Page loaded"];
+    [store messagesInConversation:identifier before:DBL_MAX messageId:0 limit:5 completion:^(NSArray *page) {
+        XCTAssertTrue([NSThread isMainThread]);
+        XCTAssertEqualObjects([page valueForKey:@"message"], [[messages subarrayWithRange:NSMakeRange(0, 5)] valueForKey:@"message"]);
+        [pageExpectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    [store removeMessagesInConversation:identifier];
+    [store flushAndWait];
+    XCTAssertEqual([[store messagesInConversation:identifier before:DBL_MAX messageId:0 limit:100] count], (NSUInteger)0);
+}
+
+- (void)testMessageStoreSearch {
+    if ([FCModel databaseIsOpen] == NO)
+        return;
+    
+    IRCChannel *channel = [self.testClient.channels objectAtIndex:0];
+    IRCUser *user = [channel userWithNickname:@"John"];
+    IRCMessageStore *store = [IRCMessageStore sharedStore];
+    NSString *word = [@"w" stringByAppendingString:[[[NSUUID UUID] UUIDString] stringByReplacingOccurrencesOfString:@"-" withString:@""]];
+    
+    NSArray *texts = @[[NSString stringWithFormat:@"%@ once", word],
+                       @"nothing to see here",
+                       [NSString stringWithFormat:@"%@ twice %@", word, word]];
+    for (NSString *text in texts) {
+        IRCMessage *message = [[IRCMessage alloc] initWithMessage:text OfType:ET_PRIVMSG inConversation:channel bySender:user atTime:[NSDate date] withTags:nil isServerMessage:NO onClient:self.testClient];
+        [store appendMessage:message];
+    }
+    
+    XCTestExpectation *searchExpectation = [self expectationWithDescription:@"Search finished"];
+    [store searchForText:[word uppercaseString] inConversation:channel.configuration.uniqueIdentifier onClient:nil offset:0 limit:10 completion:^(NSArray *messageIds) {
+        XCTAssertEqual([messageIds count], (NSUInteger)2);
+        XCTAssertEqualObjects([IRCMessage firstValueFromQuery:@"SELECT message FROM $T WHERE id = ?", [messageIds firstObject]], texts[2]);
+        XCTAssertEqualObjects([IRCMessage firstValueFromQuery:@"SELECT message FROM $T WHERE id = ?", [messageIds lastObject]], texts[0]);
+        [searchExpectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    
+    [store removeMessagesInConversation:channel.configuration.uniqueIdentifier];
+    [store flushAndWait];
+}
+
+- (void)testMessageStoreWritesInOrder {
+    if ([FCModel databaseIsOpen] == NO)
+        return;
+    
+    IRCChannel *channel = [self.testClient.channels objectAtIndex:0];
+    IRCUser *user = [channel userWithNickname:@"John"];
+    IRCMessageStore *store = [IRCMessageStore sharedStore];
+    NSString *identifier = channel.configuration.uniqueIdentifier;
+    
+    /* Clearing between two unwritten messages only removes the first one. */
+    IRCMessage *message = [[IRCMessage alloc] initWithMessage:@"Before clearing" OfType:ET_PRIVMSG inConversation:channel bySender:user atTime:[NSDate date] withTags:nil isServerMessage:NO onClient:self.testClient];
+    [store appendMessage:message];
+    [store removeMessagesInConversation:identifier];
+    message = [[IRCMessage alloc] initWithMessage:@"After clearing" OfType:ET_PRIVMSG inConversation:channel bySender:user atTime:[NSDate date] withTags:nil isServerMessage:NO onClient:self.testClient];
+    [store appendMessage:message];
+    
+    /* Reads see the last written state and do not wait for the queued batch. */
+    XCTAssertEqual([[store messagesInConversation:identifier before:DBL_MAX messageId:0 limit:100] count], (NSUInteger)0);
+    
+    [store flushAndWait];
+    NSArray *messages = [store messagesInConversation:identifier before:DBL_MAX messageId:0 limit:100];
+    XCTAssertEqualObjects([messages valueForKey:@"message"], @[@"After clearing"]);
+    
+    /* The message that was appended is given the id of its row, so the transcript can tell it apart from the same row read back. */
+    XCTestExpectation *idExpectation = [self expectationWithDescription:@"Row id assigned"];
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [idExpectation fulfill];
+    });
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    XCTAssertEqual(message.id, [[messages firstObject] id]);
+    
+    [store removeMessagesInConversation:identifier];
+    [store flushAndWait];
+}
+
+- (void)testMessageResolverReusesLiveObjects {
+    IRCMessageResolver *resolver = [IRCMessageResolver sharedResolver];
+    IRCChannel *channel = [self.testClient.channels objectAtIndex:0];
+    NSString *clientIdentifier = self.testClient.configuration.uniqueIdentifier;
+    NSString *channelIdentifier = channel.configuration.uniqueIdentifier;
+    
+    XCTAssertEqual([resolver clientWithIdentifier:clientIdentifier], self.testClient);
+    XCTAssertEqual([resolver conversationWithIdentifier:channelIdentifier onClient:self.testClient], channel);
+    XCTAssertEqual([resolver conversationWithIdentifier:channelIdentifier onClient:nil], channel);
+    XCTAssertNil([resolver clientWithIdentifier:[[NSUUID UUID] UUIDString]]);
+    
+    IRCUser *user = [resolver userWithHostmask:@"John!jappleseed@apple.com" onClient:self.testClient];
+    XCTAssertEqualObjects(user.nick, @"John");
+    XCTAssertEqualObjects(user.username, @"jappleseed");
+    XCTAssertEqualObjects(user.hostname, @"apple.com");
+    XCTAssertEqual([resolver userWithHostmask:@"John!jappleseed@apple.com" onClient:self.testClient], user);
+    
+    IRCUser *server = [resolver userWithHostmask:@"irc.example.com" onClient:self.testClient];
+    XCTAssertEqualObjects(server.nick, @"irc.example.com");
+    XCTAssertEqualObjects(server.hostname, @"");
+    XCTAssertNil([resolver userWithHostmask:@"" onClient:self.testClient]);
+}
+
+- (void)testChannelMembershipIndex {
+    IRCChannel *channel = [self.testClient.channels objectAtIndex:0];
+    IRCUser *user = [[IRCUser alloc] initWithNickname:@"Tom[away]" andUsername:@"tom" andHostname:@"example.com" andRealname:@"Tom" onClient:self.testClient];
+    [channel addUser:user];
+    
+    XCTAssertEqual([channel userWithNickname:@"tom{AWAY}"], user);
+    XCTAssertTrue([channel hasUserWithNick:@"TOM[AWAY]"]);
+    XCTAssertEqualObjects([IRCUser fromNickname:@"JOHN" onChannel:channel].nick, @"John");
+    
+    [channel renameUser:user toNickname:@"Tom"];
+    XCTAssertNil([channel userWithNickname:@"Tom[away]"]);
+    XCTAssertEqual([channel userWithNickname:@"tom"], user);
+    
+    NSUInteger count = [channel.users count];
+    [channel addUser:[[IRCUser alloc] initWithNickname:@"TOM" andUsername:@"tom" andHostname:@"example.com" andRealname:@"Tom" onClient:self.testClient]];
+    XCTAssertEqual([channel.users count], count);
+    
+    [channel removeUserByName:@"tOm"];
+    XCTAssertNil([channel userWithNickname:@"Tom"]);
+    XCTAssertEqual([channel.users count], count - 1);
+}
+
+- (void)testChannelUserlistOrdering {
+    IRCChannel *channel = [[IRCChannel alloc] initWithConfiguration:[[IRCChannelConfiguration alloc] init] withClient:self.testClient];
+    IRCUser *alice = [[IRCUser alloc] initWithNickname:@"alice" andUsername:@"alice" andHostname:@"example.com" andRealname:@"Alice" onClient:self.testClient];
+    IRCUser *bob = [[IRCUser alloc] initWithNickname:@"Bob" andUsername:@"bob" andHostname:@"example.com" andRealname:@"Bob" onClient:self.testClient];
+    IRCUser *carol = [[IRCUser alloc] initWithNickname:@"carol" andUsername:@"carol" andHostname:@"example.com" andRealname:@"Carol" onClient:self.testClient];
+
+    [channel addUser:carol];
+    [channel addUser:alice];
+    [channel addUser:bob];
+    XCTAssertEqualObjects(channel.users, (@[alice, bob, carol]));
+
+    [channel modifyUser:carol withChanges:^{
+        [carol setPrivilegeMode:"o" granted:YES];
+    }];
+    XCTAssertEqualObjects(channel.users, (@[carol, alice, bob]));
+
+    [channel renameUser:alice toNickname:@"dave"];
+    XCTAssertEqualObjects(channel.users, (@[carol, bob, alice]));
+
+    [channel removeUser:bob];
+    XCTAssertEqualObjects(channel.users, (@[carol, alice]));
+}
+
+- (void)testChannelNAMESStaging {
+    IRCChannel *channel = [self.testClient.channels objectAtIndex:0];
+    IRCUser *john = [channel userWithNickname:@"John"];
+
+    [self.testClient clientDidReceiveData:":irc.example.com 353 UnitTest = #conversation :@john +Bob alice"];
+    XCTAssertNil([channel userWithNickname:@"Bob"]);
+    XCTAssertNotNil([channel userWithNickname:@"Clinteger"]);
+
+    [self.testClient clientDidReceiveData:":irc.example.com 366 UnitTest #conversation :End of /NAMES list."];
+    XCTAssertEqual([channel.users count], (NSUInteger)3);
+    XCTAssertNil([channel userWithNickname:@"Clinteger"]);
+    XCTAssertEqual([channel userWithNickname:@"JOHN"], john);
+    XCTAssertEqualObjects(john.username, @"jappleseed");
+    XCTAssertTrue(john.op);
+    XCTAssertEqualObjects([[channel.users valueForKey:@"nick"] componentsJoinedByString:@" "], @"John Bob alice");
+}
+
+- (void)testWHOForNicknameIsNotStaged {
+    IRCChannel *channel = [self.testClient.channels objectAtIndex:0];
+    IRCUser *john = [channel userWithNickname:@"John"];
+
+    /* A WHO for a nickname lists it under a channel but ends for the nickname, it must not be applied later. */
+    [self.testClient clientDidReceiveData:":irc.example.com 352 UnitTest #conversation jappleseed apple.com irc.example.com John H@ :0 John AppleSeed"];
+    [self.testClient clientDidReceiveData:":irc.example.com 352 UnitTest #conversation ~bob example.com irc.example.com Bob H :0 Bob"];
+    [self.testClient clientDidReceiveData:":irc.example.com 315 UnitTest John :End of /WHO list."];
+    XCTAssertNil([channel stagedUserWithNickname:@"Bob" fromReply:USERLIST_REPLY_WHO]);
+
+    [self.testClient clientDidReceiveData:":irc.example.com 353 UnitTest = #conversation :John Clinteger"];
+    [self.testClient clientDidReceiveData:":irc.example.com 366 UnitTest #conversation :End of /NAMES list."];
+    XCTAssertEqual([channel.users count], (NSUInteger)2);
+    XCTAssertNil([channel userWithNickname:@"Bob"]);
+    XCTAssertFalse(john.op);
+}
+
+- (void)testEndOfListRepliesForQueries {
+    IRCConversation *query = [[IRCConversation alloc] initWithConfiguration:[[IRCChannelConfiguration alloc] init] withClient:self.testClient];
+    query.name = @"john";
+    XCTAssertTrue([self.testClient addQuery:query]);
+    XCTAssertNil([self.testClient channelWithName:@"John"]);
+    XCTAssertEqual([self.testClient channelWithName:@"#Conversation"], [self.testClient.channels objectAtIndex:0]);
+
+    /* A WHO or NAMES for a nickname with an open query must not be applied to the query. */
+    XCTAssertNoThrow([self.testClient clientDidReceiveData:":irc.example.com 352 UnitTest john jappleseed apple.com irc.example.com john H :0 John AppleSeed"]);
+    XCTAssertNoThrow([self.testClient clientDidReceiveData:":irc.example.com 315 UnitTest john :End of /WHO list."]);
+    XCTAssertNoThrow([self.testClient clientDidReceiveData:":irc.example.com 353 UnitTest = john :john"]);
+    XCTAssertNoThrow([self.testClient clientDidReceiveData:":irc.example.com 366 UnitTest john :End of /NAMES list."]);
+    XCTAssertEqual([[[self.testClient.channels objectAtIndex:0] users] count], (NSUInteger)2);
+}
+
+- (NSUInteger)runParserBenchmark:(void (^)(const char *line))parser {
+    NSUInteger corpusSize = sizeof(parserBenchmarkCorpus) / sizeof(parserBenchmarkCorpus[0]);
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (NSUInteger i = 0; i < ParserBenchmarkIterations; i++) {
+        @autoreleasepool {
+            for (NSUInteger j = 0; j < corpusSize; j++) {
+                parser(parserBenchmarkCorpus[j]);
+            }
+        }
+    }
+    CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+    NSUInteger lines = ParserBenchmarkIterations * corpusSize;
+    NSLog(@"Parsed %lu lines, %.0f lines/sec", (unsigned long)lines, lines / elapsed);
+    return lines;
+}
+
+- (unsigned long long)runMessageSchemaBenchmark:(NSString *)name schema:(NSArray *)schema write:(BOOL (^)(FMDatabase *db, NSRange rows))write {
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"benchmark-%@.sqlite3", name]];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    
+    FMDatabase *db = [FMDatabase databaseWithPath:path];
+    XCTAssertTrue([db open]);
+    [IRCMessageStore configureDatabase:db];
+    for (NSString *statement in schema) {
+        XCTAssertTrue([db executeUpdate:statement], @"%@", db.lastErrorMessage);
+    }
+    db.shouldCacheStatements = YES;
+    
+    /* One transaction per batch, the way the store flushes a busy connection. */
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (NSUInteger i = 0; i < MessageSchemaBenchmarkRows; i += MessageSchemaBenchmarkBatchSize) {
+        @autoreleasepool {
+            [db beginTransaction];
+            XCTAssertTrue(write(db, NSMakeRange(i, MIN(MessageSchemaBenchmarkBatchSize, MessageSchemaBenchmarkRows - i))), @"%@", db.lastErrorMessage);
+            [db commit];
+        }
+    }
+    CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+    [db executeStatements:@"PRAGMA wal_checkpoint(TRUNCATE);"];
+    [db close];
+    
+    unsigned long long size = [[[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil] fileSize];
+    NSLog(@"%@ schema: %d messages, %.0f messages/sec, %.1f MB", name, MessageSchemaBenchmarkRows, MessageSchemaBenchmarkRows / elapsed, size / 1048576.0);
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    return size;
+}
+
+- (void)testMessageSchemaBenchmark {
+    /* Writes two databases of a million messages, so it only runs when asked for. */
+    if ([[[NSProcessInfo processInfo] environment] objectForKey:MessageSchemaBenchmarkEnvironment] == nil)
+        return;
+    
+    /* The table layout before and after schema version 4, without the search index both have in the application. */
+    NSMutableArray *conversations = [[NSMutableArray alloc] init];
+    for (int i = 0; i < MessageSchemaBenchmarkConversations; i++) {
+        [conversations addObject:[[NSUUID UUID] UUIDString]];
+    }
+    NSMutableArray *senders = [[NSMutableArray alloc] init];
+    for (int i = 0; i < MessageSchemaBenchmarkSenders; i++) {
+        [senders addObject:[NSString stringWithFormat:@"user%d!~user%d@unaffiliated/user%d", i, i, i]];
+    }
+    NSString *client = [[NSUUID UUID] UUIDString];
+    NSArray *texts = @[@"Good day, how is everyone doing?", @"Has anyone tried the new build yet? It crashes when I rotate the device.",
+                       @"lol", @"See https://github.com/ConversationDevelopers/conversation for the source"];
+    NSDictionary *tags = @{@"time": @"2015-02-01T10:00:00.000Z"};
+    NSData *tagsData = [NSPropertyListSerialization dataWithPropertyList:tags format:NSPropertyListBinaryFormat_v1_0 options:0 error:NULL];
+    
+    /* Before version 4 every message was a row of its own strings. */
+    NSString *insert = @"INSERT INTO IRCMessage (client, sender, kickedUser, message, timestamp, conversation, messageType, tags, isServerMessage, isConversationHistory) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+    unsigned long long sizeBefore = [self runMessageSchemaBenchmark:@"v1" schema:@[
+        @"CREATE TABLE IRCMessage (id INTEGER PRIMARY KEY, client TEXT NOT NULL DEFAULT '', sender TEXT NOT NULL DEFAULT '', kickedUser TEXT NULL,"
+        @" message TEXT NOT NULL DEFAULT '', timestamp REAL NOT NULL, conversation TEXT NOT NULL, messageType INTEGER NOT NULL DEFAULT 0,"
+        @" tags TEXT NOT NULL DEFAULT '', isServerMessage NUMERIC NOT NULL DEFAULT 0, isConversationHistory NUMERIC NOT NULL DEFAULT 1);",
+        @"CREATE INDEX IDX_1 ON IRCMessage (timestamp, sender, message);"
+    ] write:^BOOL(FMDatabase *db, NSRange rows) {
+        BOOL success = YES;
+        for (NSUInteger i = rows.location; success && i < NSMaxRange(rows); i++) {
+            success = [db executeUpdate:insert withArgumentsInArray:@[client, senders[i % MessageSchemaBenchmarkSenders], [NSNull null], texts[i % [texts count]], @(1420070400.0 + i),
+                                                                      conversations[i % MessageSchemaBenchmarkConversations], @(ET_PRIVMSG), [tags description], @NO, @YES]];
+        }
+        return success;
+    }];
+    
+    /* From version 4 the rows go through the write step of the store, which interns the conversations and hostmasks as they come. */
+    IRCMessageStore *store = [[IRCMessageStore alloc] init];
+    unsigned long long sizeAfter = [self runMessageSchemaBenchmark:@"v4" schema:@[
+        @"CREATE TABLE IRCMessageConversation (id INTEGER PRIMARY KEY, identifier TEXT NOT NULL UNIQUE, client TEXT NOT NULL DEFAULT '');",
+        @"CREATE TABLE IRCMessageSender (id INTEGER PRIMARY KEY, hostmask TEXT NOT NULL UNIQUE);",
+        @"CREATE TABLE IRCMessage (id INTEGER PRIMARY KEY, conversation INTEGER NOT NULL, timestamp REAL NOT NULL, messageType INTEGER NOT NULL DEFAULT 0,"
+        @" sender INTEGER NULL, kickedUser INTEGER NULL, message TEXT NOT NULL DEFAULT '', tags BLOB NULL, isServerMessage NUMERIC NOT NULL DEFAULT 0);",
+        @"CREATE INDEX IDX_3 ON IRCMessage (conversation, timestamp);"
+    ] write:^BOOL(FMDatabase *db, NSRange rows) {
+        NSMutableArray *operations = [[NSMutableArray alloc] initWithCapacity:rows.length];
+        for (NSUInteger i = rows.location; i < NSMaxRange(rows); i++) {
+            [operations addObject:@[conversations[i % MessageSchemaBenchmarkConversations], client, @(1420070400.0 + i), @(ET_PRIVMSG),
+                                    senders[i % MessageSchemaBenchmarkSenders], [NSNull null], texts[i % [texts count]], tagsData, @NO]];
+        }
+        return [store writeOperations:operations intoConversations:[[NSMutableSet alloc] init] inDatabase:db];
+    }];
+    
+    XCTAssertLessThan(sizeAfter, sizeBefore);
+}
+
+- (void)testParserPerformanceWithComponentSplit {
+    /* The NSString based tokenizer previously used by clientDidReceiveData: */
+    IRCConnectionConfiguration *configuration = self.testClient.configuration;
+    [self measureBlock:^{
+        [self runParserBenchmark:^(const char *cline) {
+            NSString *line = [NSString stringWithCString:cline usingEncodingPreference:configuration];
+            line = [line removeIRCFormatting];
+            NSMutableArray *lineComponents = [[line componentsSeparatedByString:@" "] mutableCopy];
+            if ([line hasPrefix:@"@"]) {
+                NSArray *tags = [[[lineComponents objectAtIndex:0] substringFromIndex:1] componentsSeparatedByString:@";"];
+                for (NSString *tag in tags) {
+                    [tag componentsSeparatedByString:@"="];
+                }
+                [lineComponents removeObjectAtIndex:0];
+            }
+            if ([[lineComponents objectAtIndex:0] hasPrefix:@":"]) {
+                [[lineComponents objectAtIndex:0] substringFromIndex:1];
+                [lineComponents removeObjectAtIndex:0];
+            }
+            [lineComponents removeObjectAtIndex:0];
+            [[lineComponents objectAtIndex:0] hasPrefix:@":"];
+            [lineComponents removeObjectAtIndex:0];
+            [lineComponents componentsJoinedByString:@" "];
+        }];
+    }];
+}
+
+- (void)testParserPerformanceWithByteRanges {
+    IRCConnectionConfiguration *configuration = self.testClient.configuration;
+    [self measureBlock:^{
+        [self runParserBenchmark:^(const char *cline) {
+            IRCParsedLine line;
+            IRCParseLine(cline, strlen(cline), &line);
+            if (line.tags.bytes) {
+                IRCDictionaryFromTagsRange(line.tags, configuration);
+            }
+            IRCStringFromByteRange(line.prefix, configuration);
+            IRCStringFromByteRange(line.command, configuration);
+            IRCByteRange recipient = line.parameterCount > 0 ? line.parameters[0] : line.trailing;
+            IRCStringFromByteRange(recipient, configuration);
+            const char *messageStart = line.parameterCount > 1 ? line.parameters[1].bytes : recipient.bytes;
+            if (messageStart) {
+                [IRCStringFromByteRange((IRCByteRange){ messageStart, line.end - messageStart }, configuration) removeIRCFormatting];
+            }
+        }];
+    }];
+}
+
+- (void)testValidationPerformanceWithStrings {
+    /* The prefix and recipient validation previously done on every line by clientDidReceiveData: */
+    IRCConnectionConfiguration *configuration = self.testClient.configuration;
+    NSString *channelPrefixes = [IRCClient getChannelPrefixCharacters:self.testClient];
+    [self measureBlock:^{
+        [self runParserBenchmark:^(const char *cline) {
+            IRCParsedLine line;
+            IRCParseLine(cline, strlen(cline), &line);
+            
+            NSString *prefix = IRCStringFromByteRange(line.prefix, configuration);
+            NSArray *components = [prefix componentsSeparatedByCharactersInSet:[NSCharacterSet characterSetWithCharactersInString:@"!@"]];
+            if ([components count] == 3) {
+                [components[0] length];
+                [components[1] UTF8String];
+                [components[2] rangeOfCharacterFromSet:[NSCharacterSet controlCharacterSet]];
+            }
+            
+            NSString *recipient = IRCStringFromByteRange(line.parameterCount > 0 ? line.parameters[0] : line.trailing, configuration);
+            char *prefixes = malloc([channelPrefixes length] + 1);
+            strcpy(prefixes, [channelPrefixes UTF8String]);
+            char *channel = malloc(strlen([recipient UTF8String]) + 1);
+            strcpy(channel, [recipient UTF8String]);
+            strchr(prefixes, *channel);
+            strpbrk(channel, " \a,");
+            free(channel);
+            free(prefixes);
+        }];
+    }];
+}
+
+- (void)testValidationPerformanceWithByteRanges {
+    const IRCValidationTable *table = [self.testClient validationTable];
+    [self measureBlock:^{
+        [self runParserBenchmark:^(const char *cline) {
+            IRCParsedLine line;
+            IRCParseLine(cline, strlen(cline), &line);
+            
+            IRCByteRange nickname, username, hostname;
+            if (IRCSplitHostmask(line.prefix, &nickname, &username, &hostname)) {
+                IRCIsValidNickname(table, nickname);
+                IRCIsValidUsername(table, username);
+                IRCIsValidHostname(table, hostname);
+            }
+            
+            IRCIsValidChannelName(table, line.parameterCount > 0 ? line.parameters[0] : line.trailing);
+        }];
+    }];
+}
+
 @end